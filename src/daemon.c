@@ -0,0 +1,432 @@
+#ifdef __linux__
+// struct ucred of SO_PEERCRED
+#define _GNU_SOURCE
+#endif
+
+#include "daemon.h"
+
+#include "device_registry.h"
+#include "feature.h"
+#include "hid_utility.h"
+#include "status_shm.h"
+#include "utility.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static volatile sig_atomic_t daemon_running = 0;
+
+static void daemon_stop_handler(int signal_number)
+{
+    UNUSED(signal_number);
+    daemon_running = 0;
+}
+
+const char* daemon_socket_path()
+{
+    static char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+
+    const char* env = getenv("HEADSETCONTROL_SOCKET");
+    if (env && strlen(env) > 0) {
+        snprintf(path, sizeof(path), "%s", env);
+        return path;
+    }
+
+    const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (runtime_dir && strlen(runtime_dir) > 0)
+        snprintf(path, sizeof(path), "%s/headsetcontrol.sock", runtime_dir);
+    else
+        snprintf(path, sizeof(path), "/tmp/headsetcontrol-%u.sock", (unsigned)getuid());
+
+    return path;
+}
+
+static int socket_address(struct sockaddr_un* addr, const char* path)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+/// Whether the other end of a connected socket runs as this user, the socket may be in /tmp
+static bool peer_is_user(int fd)
+{
+#ifdef __linux__
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 && cred.uid == geteuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    return getpeereid(fd, &uid, &gid) == 0 && uid == geteuid();
+#endif
+}
+
+/// Reads or writes exactly len bytes, retrying on EINTR and short transfers
+static int transfer_all(int fd, void* buf, size_t len, bool write_mode)
+{
+    char* p = buf;
+    while (len > 0) {
+        ssize_t r = write_mode ? write(fd, p, len) : read(fd, p, len);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+        p += r;
+        len -= r;
+    }
+    return 0;
+}
+
+static int listen_socket(const char* path)
+{
+    struct sockaddr_un addr;
+    if (socket_address(&addr, path) != 0)
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    // only the owning user may talk to the daemon, from the moment the socket exists
+    mode_t old_umask = umask(S_IRWXG | S_IRWXO);
+
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        if (errno != EADDRINUSE) {
+            perror("bind");
+            umask(old_umask);
+            close(fd);
+            return -1;
+        }
+
+        // A socket file exists, check if another daemon still listens on it
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (probe >= 0 && connect(probe, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+            fprintf(stderr, "A daemon is already listening on %s\n", path);
+            umask(old_umask);
+            close(probe);
+            close(fd);
+            return -1;
+        }
+        if (probe >= 0)
+            close(probe);
+
+        // stale socket of a daemon that did not shut down cleanly
+        unlink(path);
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            perror("bind");
+            umask(old_umask);
+            close(fd);
+            return -1;
+        }
+    }
+
+    umask(old_umask);
+
+    if (listen(fd, 16) != 0) {
+        perror("listen");
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+
+    return fd;
+}
+
+/// Latest results published to the shared status, kept while requests don't ask for them
+static FeatureRequest published[NUM_CAPABILITIES];
+
+/**
+ * @brief Processes one request on the device the daemon owns
+ *
+ * @param have_device whether device_found holds a connected device, reset when the device vanished
+ */
+static void daemon_process(const struct daemon_request* request, struct daemon_response* response,
+    struct device* device_found, bool* have_device, int test_device)
+{
+    memset(response, 0, sizeof(*response));
+    response->version = DAEMON_PROTOCOL_VERSION;
+
+    if (!*have_device) {
+        // enumerate again, the headset may have been plugged in since the last request
+        hid_snapshot_free();
+        *have_device = find_device(device_found, test_device) == 0;
+    }
+
+    if (!*have_device) {
+        memset(published, 0, sizeof(published));
+        status_shm_publish(NULL, NULL, 0, NUM_CAPABILITIES);
+
+        response->found = 1;
+        return;
+    }
+
+    device_found->timeout_ms = request->timeout;
+
+    response->found     = 0;
+    response->idVendor  = device_found->idVendor;
+    response->idProduct = device_found->idProduct;
+
+    bool device_failed = false;
+    begin_feature_pass(device_found);
+
+    for (int cap = 0; cap < NUM_CAPABILITIES; cap++) {
+        const struct daemon_request_item* item = &request->items[cap];
+        struct daemon_result_item* result_item = &response->items[cap];
+
+        bool should_process = item->should_process;
+        if (request->all_info && capabilities_type[cap] == CAPABILITYTYPE_INFO && has_capability(device_found->capabilities, cap))
+            should_process = true;
+
+        if (!should_process)
+            continue;
+
+        if (cap == CAP_EQUALIZER && (item->bands_count < 0 || item->bands_count > DAEMON_MAX_BANDS)) {
+            result_item->processed = 1;
+            result_item->status    = FEATURE_ERROR;
+            snprintf(result_item->message, sizeof(result_item->message), "Invalid number of equalizer bands");
+            continue;
+        }
+
+        int param = item->param;
+        struct equalizer_settings equalizer;
+        void* param_ptr = &param;
+
+        if (cap == CAP_EQUALIZER) {
+            equalizer.size         = item->bands_count;
+            equalizer.bands_values = (float*)item->bands;
+            param_ptr              = &equalizer;
+        }
+
+        hid_device* device_handle = NULL;
+        FeatureResult result      = handle_feature(device_found, &device_handle, cap, param_ptr);
+
+        result_item->processed = 1;
+        result_item->status    = result.status;
+        result_item->value     = result.value;
+        result_item->status2   = result.status2;
+        snprintf(result_item->message, sizeof(result_item->message), "%s", result.message);
+
+        published[cap].cap            = cap;
+        published[cap].should_process = true;
+        published[cap].result         = result;
+
+        if (result.status == FEATURE_DEVICE_FAILED_OPEN)
+            device_failed = true;
+    }
+
+    if (end_feature_pass(device_found) < 0)
+        fprintf(stderr, "Failed to write the settings to the headset\n");
+
+    wcsncpy(response->device_hid_vendorname, device_found->device_hid_vendorname, 64);
+    wcsncpy(response->device_hid_productname, device_found->device_hid_productname, 64);
+
+    FeatureRequest* const published_requests[] = { published };
+    status_shm_publish(device_found, published_requests, 1, NUM_CAPABILITIES);
+
+    if (device_failed) {
+        // forget the device, the next request looks for it again
+        hid_pool_close_all();
+        *have_device = false;
+    }
+}
+
+int daemon_main(const char* socket_path, int test_device)
+{
+    if (socket_path == NULL)
+        socket_path = daemon_socket_path();
+
+    int listen_fd = listen_socket(socket_path);
+    if (listen_fd < 0)
+        return 1;
+
+    // no SA_RESTART, so that accept() returns on a signal
+    struct sigaction act;
+    memset(&act, 0, sizeof(act));
+    act.sa_handler = daemon_stop_handler;
+    sigaction(SIGINT, &act, NULL);
+    sigaction(SIGTERM, &act, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    fprintf(stderr, "HeadsetControl daemon listening on %s\n", socket_path);
+
+    static struct device device_found;
+    bool have_device = false;
+
+    static struct daemon_request request;
+    static struct daemon_response response;
+
+    daemon_running = 1;
+    while (daemon_running) {
+        int client_fd = accept(listen_fd, NULL, NULL);
+        if (client_fd < 0) {
+            if (errno != EINTR)
+                perror("accept");
+            continue;
+        }
+
+        if (!peer_is_user(client_fd)) {
+            close(client_fd);
+            continue;
+        }
+
+        // don't let a stuck or mismatched client block the daemon
+        struct timeval receive_timeout = { 1, 0 };
+        setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &receive_timeout, sizeof(receive_timeout));
+
+        if (transfer_all(client_fd, &request, sizeof(request), false) == 0) {
+            if (request.version != DAEMON_PROTOCOL_VERSION) {
+                memset(&response, 0, sizeof(response));
+                response.version = DAEMON_PROTOCOL_VERSION;
+            } else {
+                daemon_process(&request, &response, &device_found, &have_device, test_device);
+            }
+
+            transfer_all(client_fd, &response, sizeof(response), true);
+        }
+
+        close(client_fd);
+    }
+
+    close(listen_fd);
+    unlink(socket_path);
+    status_shm_close();
+
+    fprintf(stderr, "HeadsetControl daemon stopped\n");
+    terminate_hid(NULL, NULL);
+    return 0;
+}
+
+int daemon_client_request(FeatureRequest* featureRequests, int size, bool all_info, struct device* device_found)
+{
+    struct sockaddr_un addr;
+    if (socket_address(&addr, daemon_socket_path()) != 0)
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    // a socket in /tmp may have been created by another user
+    if (!peer_is_user(fd)) {
+        fprintf(stderr, "The daemon on %s runs as another user, ignoring it\n", addr.sun_path);
+        close(fd);
+        return -1;
+    }
+
+    static struct daemon_request request;
+    static struct daemon_response response;
+    memset(&request, 0, sizeof(request));
+
+    request.version  = DAEMON_PROTOCOL_VERSION;
+    request.timeout  = hsc_device_timeout;
+    request.all_info = all_info;
+
+    for (int i = 0; i < size; i++) {
+        struct daemon_request_item* item = &request.items[featureRequests[i].cap];
+
+        item->should_process = featureRequests[i].should_process;
+        item->type           = featureRequests[i].type;
+        if (!item->should_process)
+            continue;
+
+        if (featureRequests[i].cap == CAP_EQUALIZER) {
+            struct equalizer_settings* equalizer = featureRequests[i].param;
+
+            if (equalizer->size > DAEMON_MAX_BANDS) {
+                fprintf(stderr, "Daemon supports up to %d equalizer bands\n", DAEMON_MAX_BANDS);
+                close(fd);
+                return -1;
+            }
+
+            item->bands_count = equalizer->size;
+            memcpy(item->bands, equalizer->bands_values, sizeof(float) * equalizer->size);
+        } else {
+            item->param = *(int*)featureRequests[i].param;
+        }
+    }
+
+    if (transfer_all(fd, &request, sizeof(request), true) != 0
+        || transfer_all(fd, &response, sizeof(response), false) != 0) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    if (response.version != DAEMON_PROTOCOL_VERSION) {
+        fprintf(stderr, "Daemon protocol version mismatch, ignoring daemon\n");
+        return -1;
+    }
+
+    if (response.found != 0 || get_device(device_found, response.idVendor, response.idProduct) != 0)
+        return 1;
+
+    wcsncpy(device_found->device_hid_vendorname, response.device_hid_vendorname, 64);
+    wcsncpy(device_found->device_hid_productname, response.device_hid_productname, 64);
+
+    for (int i = 0; i < size; i++) {
+        const struct daemon_result_item* item = &response.items[featureRequests[i].cap];
+
+        featureRequests[i].should_process = item->processed;
+        if (!item->processed)
+            continue;
+
+        featureRequests[i].result.status  = item->status;
+        featureRequests[i].result.value   = item->value;
+        featureRequests[i].result.status2 = item->status2;
+        snprintf(featureRequests[i].result.message, sizeof(featureRequests[i].result.message), "%s", item->message);
+    }
+
+    return 0;
+}
+
+#else // _WIN32: Unix sockets are not supported by this implementation
+
+const char* daemon_socket_path()
+{
+    return NULL;
+}
+
+int daemon_main(const char* socket_path, int test_device)
+{
+    UNUSED(socket_path);
+    UNUSED(test_device);
+    fprintf(stderr, "The daemon is not supported on this platform\n");
+    return 1;
+}
+
+int daemon_client_request(FeatureRequest* featureRequests, int size, bool all_info, struct device* device_found)
+{
+    UNUSED(featureRequests);
+    UNUSED(size);
+    UNUSED(all_info);
+    UNUSED(device_found);
+    return -1;
+}
+
+#endif
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "device.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wchar.h>
+
+/**
+ * The daemon owns the connected headset and keeps its HID connections open.
+ * Clients send the same FeatureRequest list the CLI would process locally,
+ * and get the FeatureResults back over a local Unix socket.
+ *
+ * Both sides are the same binary, so messages are fixed-size structs;
+ * the protocol version guards against a daemon of another build. Both sides
+ * only talk to processes of the same user.
+ */
+
+#define DAEMON_PROTOCOL_VERSION 1
+#define DAEMON_MAX_BANDS        64
+#define DAEMON_MESSAGE_SIZE     256
+
+struct daemon_request_item {
+    int32_t should_process;
+    /// enum capabilitytype of the request, the daemon uses its own capabilities_type
+    int32_t type;
+    /// Integer parameter of the capability (most capabilities)
+    int32_t param;
+    /// Equalizer bands, only used for CAP_EQUALIZER
+    int32_t bands_count;
+    float bands[DAEMON_MAX_BANDS];
+};
+
+struct daemon_request {
+    uint32_t version;
+    /// Read timeout (hsc_device_timeout) of the client
+    int32_t timeout;
+    /// Process all INFO capabilities the device supports (for JSON/YAML/ENV output)
+    int32_t all_info;
+    struct daemon_request_item items[NUM_CAPABILITIES];
+};
+
+struct daemon_result_item {
+    int32_t processed;
+    int32_t status;
+    int32_t value;
+    int32_t status2;
+    char message[DAEMON_MESSAGE_SIZE];
+};
+
+struct daemon_response {
+    uint32_t version;
+    /// 0 when the daemon found a supported device
+    int32_t found;
+    uint16_t idVendor;
+    uint16_t idProduct;
+    wchar_t device_hid_vendorname[64];
+    wchar_t device_hid_productname[64];
+    struct daemon_result_item items[NUM_CAPABILITIES];
+};
+
+/**
+ * @brief Returns the socket path of the daemon
+ *
+ * HEADSETCONTROL_SOCKET when set, otherwise headsetcontrol.sock in XDG_RUNTIME_DIR,
+ * falling back to /tmp/headsetcontrol-UID.sock. A daemon of another user
+ * listening there is ignored by the clients
+ */
+const char* daemon_socket_path();
+
+/**
+ * @brief Runs the daemon in the foreground until SIGINT/SIGTERM
+ *
+ * @param socket_path path of the socket to listen on, or NULL for daemon_socket_path()
+ * @param test_device serve the built-in test device
+ * @return 0 on clean shutdown, 1 on error
+ */
+int daemon_main(const char* socket_path, int test_device);
+
+/**
+ * @brief Sends the feature requests to a running daemon
+ *
+ * On success, the results are stored in featureRequests,
+ * should_process is updated to what the daemon processed, and device_found
+ * is filled from the local device registry.
+ *
+ * @param featureRequests requests to send
+ * @param size size of featureRequests
+ * @param all_info process all INFO capabilities the device supports
+ * @param device_found filled with the device the daemon serves
+ * @return 0 on success, 1 when the daemon has no supported device, -1 when no daemon is reachable
+ */
+int daemon_client_request(FeatureRequest* featureRequests, int size, bool all_info, struct device* device_found);
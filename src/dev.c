@@ -1,16 +1,22 @@
 #include "dev.h"
 
+#include "device_registry.h"
+#include "feature.h"
 #include "hid_utility.h"
+#include "output.h"
 
 #include "utility.h"
 
 #include <hidapi.h>
 
+#include <fcntl.h>
 #include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <wchar.h>
 
 /**
  * @brief Print information of devices
@@ -41,6 +47,318 @@ static void print_devices(unsigned short vendorid, unsigned short productid)
     hid_free_enumeration(devs);
 }
 
+#ifdef HSC_NATIVE_HIDRAW
+#define BACKEND_NAME "native hidraw"
+#else
+#define BACKEND_NAME "hidapi"
+#endif
+
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void print_timing(const char* name, const double* samples, int count)
+{
+    double min = samples[0], max = samples[0], sum = 0;
+    for (int i = 0; i < count; i++) {
+        sum += samples[i];
+        if (samples[i] < min)
+            min = samples[i];
+        if (samples[i] > max)
+            max = samples[i];
+    }
+
+    printf("  %-12s avg %8.3f ms  min %8.3f ms  max %8.3f ms  (%d runs)\n", name, sum / count, min, max, count);
+}
+
+/**
+ * @brief Times the HID backend, to compare builds with and without HSC_NATIVE_HIDRAW
+ *
+ * Always times a full enumeration. With a device path, also times opening it and,
+ * when send data is given, a write followed by reading the reply.
+ *
+ * @param iterations number of runs of every step
+ * @param hid_path the device, or NULL
+ * @param sendbuffer data for the round trip
+ * @param send size of sendbuffer, 0 to skip the round trip
+ * @param timeout read timeout of the round trip
+ * @return 0 on success, 1 when a step failed
+ */
+static int run_benchmark(int iterations, const char* hid_path, const unsigned char* sendbuffer, int send, int timeout)
+{
+    double* samples = malloc(iterations * sizeof(double));
+    if (!samples) {
+        fprintf(stderr, "Unable to allocate benchmark samples\n");
+        return 1;
+    }
+
+    printf("Benchmark of the %s backend\n", BACKEND_NAME);
+
+    int num_devices = 0;
+    for (int i = 0; i < iterations; i++) {
+        double start = now_ms();
+
+        struct hid_device_info* devs = hid_enumerate(0, 0);
+        samples[i]                   = now_ms() - start;
+
+        num_devices = 0;
+        for (struct hid_device_info* cur_dev = devs; cur_dev; cur_dev = cur_dev->next)
+            num_devices++;
+        hid_free_enumeration(devs);
+    }
+    print_timing("enumerate", samples, iterations);
+    printf("  %d HID devices\n", num_devices);
+
+    if (!hid_path) {
+        free(samples);
+        return 0;
+    }
+
+    for (int i = 0; i < iterations; i++) {
+        double start = now_ms();
+
+        hid_device* device_handle = hid_open_path(hid_path);
+        if (!device_handle) {
+            fprintf(stderr, "Couldn't open device: %ls\n", hid_error(NULL));
+            free(samples);
+            return 1;
+        }
+        hid_close(device_handle);
+
+        samples[i] = now_ms() - start;
+    }
+    print_timing("open+close", samples, iterations);
+
+    if (!send) {
+        free(samples);
+        return 0;
+    }
+
+    hid_device* device_handle = hid_open_path(hid_path);
+    if (!device_handle) {
+        fprintf(stderr, "Couldn't open device: %ls\n", hid_error(NULL));
+        free(samples);
+        return 1;
+    }
+
+    unsigned char receivebuffer[64];
+    int ret = 0;
+    for (int i = 0; i < iterations; i++) {
+        double start = now_ms();
+
+        if (hid_write(device_handle, sendbuffer, send) < 0) {
+            fprintf(stderr, "Failed to send data: %ls\n", hid_error(device_handle));
+            ret = 1;
+            break;
+        }
+
+        int read = hid_read_timeout(device_handle, receivebuffer, sizeof(receivebuffer), timeout);
+        if (read <= 0) {
+            fprintf(stderr, "No reply to the round trip: %ls\n", read < 0 ? hid_error(device_handle) : L"timeout");
+            ret = 1;
+            break;
+        }
+
+        samples[i] = now_ms() - start;
+    }
+    if (ret == 0)
+        print_timing("round trip", samples, iterations);
+
+    hid_close(device_handle);
+    free(samples);
+    return ret;
+}
+
+/**
+ * @brief Times rendering the documents of --output for MAX_HEADSETS test devices
+ *
+ * The results are made up, no device is opened. Error messages with quotes
+ * and a backslash make the strings need escaping. The documents are written
+ * to /dev/null, their sizes are printed too.
+ *
+ * @param iterations number of documents of every format
+ * @return 0 on success, 1 when the output couldn't be redirected
+ */
+static int run_output_benchmark(int iterations)
+{
+    static struct device devices[MAX_HEADSETS];
+    static FeatureRequest requests[MAX_HEADSETS][3];
+    static DeviceList lists[MAX_HEADSETS];
+
+    int value = 1;
+
+    for (int i = 0; i < MAX_HEADSETS; i++) {
+        if (get_device(&devices[i], VENDOR_TESTDEVICE, PRODUCT_TESTDEVICE) != 0) {
+            fprintf(stderr, "Test device not found\n");
+            return 1;
+        }
+        swprintf(devices[i].device_hid_serialnumber, sizeof(devices[i].device_hid_serialnumber) / sizeof(wchar_t), L"BENCH%04d", i);
+
+        FeatureRequest device_requests[3] = {
+            { CAP_SIDETONE, CAPABILITYTYPE_ACTION, &value, true, { FEATURE_ERROR, 0, 0, "Failed to set \"sidetone\" (C:\\hid)" } },
+            { CAP_BATTERY_STATUS, CAPABILITYTYPE_INFO, &value, true, { FEATURE_INFO, 80, BATTERY_AVAILABLE, "" } },
+            { CAP_CHATMIX_STATUS, CAPABILITYTYPE_INFO, &value, true, { FEATURE_ERROR, 0, 0, "Error \"retrieving\" chatmix status" } },
+        };
+        memcpy(requests[i], device_requests, sizeof(device_requests));
+
+        lists[i] = (DeviceList) { requests[i], 3, &devices[i], MAX_HEADSETS };
+    }
+
+    const OutputType types[] = { OUTPUT_JSON, OUTPUT_YAML, OUTPUT_ENV, OUTPUT_CBOR };
+    const char* type_names[] = { "json", "yaml", "env", "cbor" };
+    const int num_types      = sizeof(types) / sizeof(types[0]);
+    long sizes[sizeof(types) / sizeof(types[0])];
+
+    // the timings are printed once stdout is restored
+    double* samples = malloc(num_types * iterations * sizeof(double));
+    if (!samples) {
+        fprintf(stderr, "Unable to allocate benchmark samples\n");
+        return 1;
+    }
+
+    // one document of every format goes to sizes_file, to tell their sizes
+    FILE* sizes_file = tmpfile();
+
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int null_fd      = open("/dev/null", O_WRONLY);
+    if (!sizes_file || saved_stdout < 0 || null_fd < 0) {
+        fprintf(stderr, "Unable to redirect the output to /dev/null\n");
+        free(samples);
+        return 1;
+    }
+
+    long written = 0;
+    for (int t = 0; t < num_types; t++) {
+        dup2(fileno(sizes_file), STDOUT_FILENO);
+        output(lists, false, types[t]);
+        fflush(stdout);
+
+        long end = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+        sizes[t] = end - written;
+        written  = end;
+
+        dup2(null_fd, STDOUT_FILENO);
+        for (int i = 0; i < iterations; i++) {
+            double start = now_ms();
+            output(lists, false, types[t]);
+            samples[t * iterations + i] = now_ms() - start;
+        }
+    }
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    close(null_fd);
+    fclose(sizes_file);
+
+    printf("Benchmark of the output of %d headsets\n", MAX_HEADSETS);
+    for (int t = 0; t < num_types; t++)
+        print_timing(type_names[t], &samples[t * iterations], iterations);
+    for (int t = 0; t < num_types; t++)
+        printf("  %-12s %ld bytes\n", type_names[t], sizes[t]);
+
+    free(samples);
+    return 0;
+}
+
+/**
+ * @brief The lookup before the sorted registry: a scan over the product ids of every driver
+ *
+ * Only kept as the baseline of run_registry_benchmark().
+ */
+static const struct device* scan_devices(uint16_t idVendor, uint16_t idProduct)
+{
+    struct device* device;
+    for (int i = 0; iterate_devices(i, &device) == 0; i++) {
+        if (device->idVendor != idVendor)
+            continue;
+
+        for (int y = 0; y < device->numIdProducts; y++) {
+            if (device->idProductsSupported[y] == idProduct)
+                return device;
+        }
+    }
+    return NULL;
+}
+
+#define REGISTRY_BENCHMARK_IDS 256
+
+/**
+ * @brief Times lookup_device() against a scan of every driver, for supported and unsupported ids
+ *
+ * The hits are all registered vendor+product ids, the misses as many unsupported
+ * product ids of the SteelSeries vendor id. Every run looks up all of them once.
+ *
+ * @param iterations number of runs
+ * @return 0 on success, 1 when the samples couldn't be allocated
+ */
+static int run_registry_benchmark(int iterations)
+{
+    static uint16_t hit_vendors[REGISTRY_BENCHMARK_IDS];
+    static uint16_t hit_products[REGISTRY_BENCHMARK_IDS];
+    static uint16_t miss_products[REGISTRY_BENCHMARK_IDS];
+
+    int num_ids = 0;
+    struct device* device;
+    for (int i = 0; iterate_devices(i, &device) == 0; i++) {
+        for (int y = 0; y < device->numIdProducts && num_ids < REGISTRY_BENCHMARK_IDS; y++) {
+            hit_vendors[num_ids]  = device->idVendor;
+            hit_products[num_ids] = device->idProductsSupported[y];
+            num_ids++;
+        }
+    }
+
+    int num_misses = 0;
+    for (uint16_t product = 0xffff; num_misses < num_ids; product--) {
+        if (lookup_device(VENDOR_STEELSERIES, product) == NULL)
+            miss_products[num_misses++] = product;
+    }
+
+    const char* names[] = { "lookup hit", "lookup miss", "scan hit", "scan miss" };
+    const int num_names = sizeof(names) / sizeof(names[0]);
+
+    double* samples = malloc(num_names * iterations * sizeof(double));
+    if (!samples) {
+        fprintf(stderr, "Unable to allocate benchmark samples\n");
+        return 1;
+    }
+
+    // the results are summed up, so the lookups can't be left out
+    volatile uintptr_t sink = 0;
+    for (int n = 0; n < num_names; n++) {
+        const struct device* (*lookup)(uint16_t, uint16_t) = n < 2 ? lookup_device : scan_devices;
+        const bool hits                                    = n % 2 == 0;
+
+        for (int i = 0; i < iterations; i++) {
+            double start = now_ms();
+            for (int k = 0; k < num_ids; k++) {
+                if (hits)
+                    sink += (uintptr_t)lookup(hit_vendors[k], hit_products[k]);
+                else
+                    sink += (uintptr_t)lookup(VENDOR_STEELSERIES, miss_products[k]);
+            }
+            samples[n * iterations + i] = now_ms() - start;
+        }
+    }
+
+    printf("Benchmark of the device registry, %d lookups per run\n", num_ids);
+    for (int n = 0; n < num_names; n++)
+        print_timing(names[n], &samples[n * iterations], iterations);
+    for (int n = 0; n < num_names; n++) {
+        double sum = 0;
+        for (int i = 0; i < iterations; i++)
+            sum += samples[n * iterations + i];
+        printf("  %-12s %8.1f ns per lookup\n", names[n], sum / iterations / num_ids * 1000000.0);
+    }
+
+    free(samples);
+    return 0;
+}
+
 /**
  * @brief check if number inside range
  *
@@ -136,6 +454,13 @@ static void print_help()
            "\tTry to receive a report for REPORTID.\n");
     printf("  --repeat SECS\n"
            "\tRepeat command every SECS.\n");
+    printf("  --benchmark RUNS\n"
+           "\tTimes enumeration, and with --device opening it and a --send/reply round trip (--timeout, default 1000)\n"
+           "\tCompare builds with and without the CMake option HSC_NATIVE_HIDRAW\n");
+    printf("  --benchmark-output RUNS\n"
+           "\tTimes rendering the json, yaml, env and cbor output of many headsets, and prints their sizes\n");
+    printf("  --benchmark-registry RUNS\n"
+           "\tTimes looking up supported and unsupported ids in the device registry, against scanning every driver\n");
     printf("\n");
 
     printf("  --dev-help\n"
@@ -174,6 +499,10 @@ int dev_main(int argc, char* argv[])
 
     int repeat_seconds = 0;
 
+    int benchmark_runs          = 0;
+    int benchmark_output_runs   = 0;
+    int benchmark_registry_runs = 0;
+
     int print_deviceinfo = 0;
 
 #define BUFFERLENGTH 1024
@@ -196,6 +525,9 @@ int dev_main(int argc, char* argv[])
         { "timeout", required_argument, NULL, 't' },
         { "dev-help", no_argument, NULL, 'h' },
         { "repeat", required_argument, NULL, 0 },
+        { "benchmark", required_argument, NULL, 0 },
+        { "benchmark-output", required_argument, NULL, 0 },
+        { "benchmark-registry", required_argument, NULL, 0 },
         { 0, 0, 0, 0 }
     };
 
@@ -323,6 +655,27 @@ int dev_main(int argc, char* argv[])
                     fprintf(stderr, "--repeat SECS cannot be smaller than 1\n");
                     return 1;
                 }
+            } else if (strcmp(opts[option_index].name, "benchmark") == 0) { // --benchmark RUNS
+                benchmark_runs = strtol(optarg, NULL, 10);
+
+                if (benchmark_runs < 1) {
+                    fprintf(stderr, "--benchmark RUNS cannot be smaller than 1\n");
+                    return 1;
+                }
+            } else if (strcmp(opts[option_index].name, "benchmark-output") == 0) { // --benchmark-output RUNS
+                benchmark_output_runs = strtol(optarg, NULL, 10);
+
+                if (benchmark_output_runs < 1) {
+                    fprintf(stderr, "--benchmark-output RUNS cannot be smaller than 1\n");
+                    return 1;
+                }
+            } else if (strcmp(opts[option_index].name, "benchmark-registry") == 0) { // --benchmark-registry RUNS
+                benchmark_registry_runs = strtol(optarg, NULL, 10);
+
+                if (benchmark_registry_runs < 1) {
+                    fprintf(stderr, "--benchmark-registry RUNS cannot be smaller than 1\n");
+                    return 1;
+                }
             }
             break;
         }
@@ -345,6 +698,29 @@ int dev_main(int argc, char* argv[])
     if (print_deviceinfo)
         print_devices(vendorid, productid);
 
+    if (benchmark_output_runs)
+        return run_output_benchmark(benchmark_output_runs);
+
+    if (benchmark_registry_runs)
+        return run_registry_benchmark(benchmark_registry_runs);
+
+    if (benchmark_runs) {
+        char* hid_path = NULL;
+        if (vendorid && productid) {
+            hid_path = get_hid_path(vendorid, productid, interfaceid, usagepage, usageid);
+            if (!hid_path) {
+                fprintf(stderr, "Could not find a device with this parameters:\n");
+                fprintf(stderr, "\t Vendor (%#x) Product (%#x) Interface (%#x) UsagePage (%#x) UsageID (%#x)\n",
+                    vendorid, productid, interfaceid, usagepage, usageid);
+                return 1;
+            }
+        }
+
+        int ret = run_benchmark(benchmark_runs, hid_path, sendbuffer, send, timeout < 0 ? 1000 : timeout);
+        terminate_hid(NULL, &hid_path);
+        return ret;
+    }
+
     if (!(send || send_feature || receive || receivereport))
         goto cleanup;
 
@@ -1,5 +1,29 @@
 #include "device.h"
 
+int hsc_device_timeout = 5000;
+
+int test_profile = 0;
+
+/// see device_current()
+static __thread struct device* current_device = NULL;
+
+struct device* device_current()
+{
+    return current_device;
+}
+
+struct device* device_set_current(struct device* device)
+{
+    struct device* previous = current_device;
+    current_device          = device;
+    return previous;
+}
+
+int device_timeout()
+{
+    return current_device ? current_device->timeout_ms : hsc_device_timeout;
+}
+
 const char* const capabilities_str[NUM_CAPABILITIES]
     = {
           [CAP_SIDETONE]                       = "sidetone",
@@ -57,3 +81,22 @@ const char capabilities_str_short[NUM_CAPABILITIES]
           [CAP_BT_WHEN_POWERED_ON] = '\0',
           [CAP_BT_CALL_VOLUME]     = '\0'
       };
+
+const enum capabilitytype capabilities_type[NUM_CAPABILITIES]
+    = {
+          [CAP_SIDETONE]                       = CAPABILITYTYPE_ACTION,
+          [CAP_BATTERY_STATUS]                 = CAPABILITYTYPE_INFO,
+          [CAP_NOTIFICATION_SOUND]             = CAPABILITYTYPE_ACTION,
+          [CAP_LIGHTS]                         = CAPABILITYTYPE_ACTION,
+          [CAP_INACTIVE_TIME]                  = CAPABILITYTYPE_ACTION,
+          [CAP_CHATMIX_STATUS]                 = CAPABILITYTYPE_INFO,
+          [CAP_VOICE_PROMPTS]                  = CAPABILITYTYPE_ACTION,
+          [CAP_ROTATE_TO_MUTE]                 = CAPABILITYTYPE_ACTION,
+          [CAP_EQUALIZER_PRESET]               = CAPABILITYTYPE_ACTION,
+          [CAP_EQUALIZER]                      = CAPABILITYTYPE_ACTION,
+          [CAP_MICROPHONE_MUTE_LED_BRIGHTNESS] = CAPABILITYTYPE_ACTION,
+          [CAP_MICROPHONE_VOLUME]              = CAPABILITYTYPE_ACTION,
+          [CAP_VOLUME_LIMITER]                 = CAPABILITYTYPE_ACTION,
+          [CAP_BT_WHEN_POWERED_ON]             = CAPABILITYTYPE_ACTION,
+          [CAP_BT_CALL_VOLUME]                 = CAPABILITYTYPE_ACTION
+      };
@@ -15,9 +15,12 @@
 /// Convert given number to bitmask
 #define B(X) (1 << X)
 
-/// global read timeout in millisecounds
+/// read timeout in millisecounds of the headsets found from now on, see device.timeout_ms
 extern int hsc_device_timeout;
 
+/// profile of the built-in test device found from now on (--test-device), see device.test_profile
+extern int test_profile;
+
 /** @brief A list of all features settable/queryable
  *         for headsets
  *
@@ -53,6 +56,8 @@ extern const char* const capabilities_str[NUM_CAPABILITIES];
 extern const char capabilities_str_short[NUM_CAPABILITIES];
 /// Enum name of every capability
 extern const char* const capabilities_str_enum[NUM_CAPABILITIES];
+/// Whether a capability sets something or reads a status
+extern const enum capabilitytype capabilities_type[NUM_CAPABILITIES];
 
 static inline bool has_capability(int device_capabilities, enum capabilities cap)
 {
@@ -119,17 +124,21 @@ typedef enum {
     FEATURE_ERROR,
     FEATURE_DEVICE_FAILED_OPEN,
     FEATURE_INFO, // For non-error, informational states like "charging"
-    FEATURE_NOT_PROCESSED
+    FEATURE_NOT_PROCESSED,
+    FEATURE_DEVICE_OFFLINE // Skipped, an earlier status read found the headset offline
 } FeatureStatus;
 
+/// Longest message of a result, including the terminating null
+#define FEATURE_MESSAGE_SIZE 256
+
 typedef struct {
     FeatureStatus status;
     /// Can hold battery level, error codes, or special status codes
     int value;
     /// Status depending on the feature (not used by all)
     int status2;
-    /// For error messages, "Charging", "Unavailable", etc. Should be free()d after use
-    char* message;
+    /// For error messages, "Charging", "Unavailable", etc. Empty when there is none
+    char message[FEATURE_MESSAGE_SIZE];
 } FeatureResult;
 
 typedef struct {
@@ -173,6 +182,17 @@ struct device {
     wchar_t device_hid_vendorname[64];
     wchar_t device_hid_productname[64];
 
+    /// Serial number telling several connected headsets of this model apart, empty for any
+    wchar_t device_hid_serialnumber[64];
+    /// Which of the connected headsets matching the ids and serial number is meant, in enumeration order
+    int device_instance;
+    /// Set during a pass once a status read found the headset offline
+    bool offline;
+    /// Read timeout of this headset in milliseconds, hsc_device_timeout when it was found (see device_timeout())
+    int timeout_ms;
+    /// Profile of the built-in test device, test_profile when it was found
+    int test_profile;
+
     /// Bitmask of currently supported features the software can currently handle
     int capabilities;
     /// Details of all capabilities (e.g. to which interface to connect)
@@ -393,4 +413,55 @@ struct device {
      *              -1                 HIDAPI error
      */
     int (*send_bluetooth_call_volume)(hid_device* hid_device, uint8_t num);
+
+    /** @brief Function pointer for persisting the settings on the headset
+     *
+     *  Optional; drivers sending a save command after every setting skip it
+     *  while a settings transaction is active (see hid_transaction_begin()),
+     *  this is called once when the transaction is committed instead
+     *
+     *  @param  device_handle   The hidapi handle. Must be the same
+     *                          device as defined here (same ids)
+     *
+     *  @returns    >= 0        on success
+     *              -1          HIDAPI error
+     */
+    int (*commit_settings)(hid_device* hid_device);
+
+    /** @brief Function pointer for parsing input reports the headset sends on its own
+     *
+     *  Optional; used by --follow to wait for status changes instead of polling
+     *
+     *  @param  data            The input report as read from the device
+     *  @param  size            Size of the report
+     *  @param  battery         Set when the report contains the battery status
+     *  @param  chatmix         Set when the report contains the chatmix level
+     *
+     *  @returns    bitmask of B(CAP_BATTERY_STATUS) and B(CAP_CHATMIX_STATUS)
+     *              for the values set, 0 when the report is not a status report
+     */
+    int (*parse_input_report)(const unsigned char* data, int size, BatteryInfo* battery, int* chatmix);
 };
+
+/**
+ * @brief Returns the headset whose driver function runs on this thread
+ *
+ * Drivers only get the HID handle. handle_feature() and the other calls into a
+ * driver set the headset they are for, so that drivers read its own state (e.g.
+ * its timeout) while other threads drive other headsets, also of the same model.
+ *
+ * @return the headset, NULL outside of driver calls
+ */
+struct device* device_current();
+
+/**
+ * @brief Sets device_current() of this thread for the driver calls that follow
+ *
+ * @return the previous one, to be set again after the calls
+ */
+struct device* device_set_current(struct device* device);
+
+/**
+ * @brief Read timeout for drivers: the one of device_current(), otherwise hsc_device_timeout
+ */
+int device_timeout();
@@ -27,87 +27,135 @@
 #include "devices/steelseries_arctis_pro_wireless.h"
 
 #include <assert.h>
-#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-// Pointer to an array of pointers to device
-static struct device** devicelist = NULL;
-int num_devices                   = 0;
-
-void add_device(void (*init_func)(struct device**));
-
-void init_devices()
-{
+/// Init functions of all drivers, in the order devices are listed (e.g. for udev rules and the README)
+static void (*const device_inits[])(struct device**) = {
     // Corsair
-    add_device(void_init);
+    void_init,
     // HyperX
-    add_device(calphaw_init);
-    add_device(cflight_init);
-    add_device(hyperx_cloud3_init);
+    calphaw_init,
+    cflight_init,
+    hyperx_cloud3_init,
     // Logitech
-    add_device(g430_init);
-    add_device(g432_init);
-    add_device(g533_init);
-    add_device(g535_init);
-    add_device(g930_init);
-    add_device(g933_935_init);
-    add_device(gpro_init);
-    add_device(gpro_x2_init);
-    add_device(zone_wired_init);
+    g430_init,
+    g432_init,
+    g533_init,
+    g535_init,
+    g930_init,
+    g933_935_init,
+    gpro_init,
+    gpro_x2_init,
+    zone_wired_init,
     // SteelSeries
-    add_device(arctis_1_init);
-    add_device(arctis_7_init);
-    add_device(arctis_9_init);
-    add_device(arctis_pro_wireless_init);
+    arctis_1_init,
+    arctis_7_init,
+    arctis_9_init,
+    arctis_pro_wireless_init,
     // Roccat
-    add_device(elo71Air_init);
-    add_device(elo71USB_init);
+    elo71Air_init,
+    elo71USB_init,
     // SteelSeries
-    add_device(arctis_nova_3_init);
-    add_device(arctis_nova_5_init);
-    add_device(arctis_nova_7_init);
-    add_device(arctis_7_plus_init);
-    add_device(arctis_nova_pro_wireless_init);
+    arctis_nova_3_init,
+    arctis_nova_5_init,
+    arctis_nova_7_init,
+    arctis_7_plus_init,
+    arctis_nova_pro_wireless_init,
+
+    headsetcontrol_test_init,
+};
+
+#define NUM_DRIVERS (int)(sizeof(device_inits) / sizeof(device_inits[0]))
+
+/// Upper bound of vendor+product id combinations over all drivers
+#define MAX_REGISTRY_ENTRIES 256
+
+static struct device* devicelist[NUM_DRIVERS];
+static int num_devices = 0;
 
-    add_device(headsetcontrol_test_init);
+/// Lookup index, sorted by (vendor id << 16 | product id)
+struct registry_entry {
+    uint32_t id;
+    struct device* device;
+};
+
+static struct registry_entry registry[MAX_REGISTRY_ENTRIES];
+static int num_registry_entries = 0;
+
+static inline uint32_t registry_id(uint16_t idVendor, uint16_t idProduct)
+{
+    return ((uint32_t)idVendor << 16) | idProduct;
+}
+
+static int registry_entry_compare(const void* a, const void* b)
+{
+    const struct registry_entry* ea = a;
+    const struct registry_entry* eb = b;
+
+    if (ea->id != eb->id)
+        return ea->id < eb->id ? -1 : 1;
+    return 0;
 }
 
-void add_device(void (*init_func)(struct device**))
+void init_devices()
 {
-    // Reallocate memory to accommodate the new device
-    struct device** temp = realloc(devicelist, (num_devices + 1) * sizeof(struct device*));
-    if (temp == NULL) {
-        fprintf(stderr, "Failed to allocate memory for device list.\n");
-        abort();
+    if (num_devices > 0)
+        return;
+
+    for (int i = 0; i < NUM_DRIVERS; i++) {
+        device_inits[i](&devicelist[i]);
+
+        // one device file can contain multiple product ids, index all of them
+        for (int y = 0; y < devicelist[i]->numIdProducts; y++) {
+            assert(num_registry_entries < MAX_REGISTRY_ENTRIES && "init_devices: raise MAX_REGISTRY_ENTRIES");
+
+            registry[num_registry_entries].id     = registry_id(devicelist[i]->idVendor, devicelist[i]->idProductsSupported[y]);
+            registry[num_registry_entries].device = devicelist[i];
+            num_registry_entries++;
+        }
     }
-    devicelist = temp;
+    num_devices = NUM_DRIVERS;
 
-    // Initialize the new device
-    init_func(&devicelist[num_devices]);
-    num_devices++;
+    qsort(registry, num_registry_entries, sizeof(struct registry_entry), registry_entry_compare);
 }
 
-int get_device(struct device* device_found, uint16_t idVendor, uint16_t idProduct)
+const struct device* lookup_device(uint16_t idVendor, uint16_t idProduct)
 {
     assert(num_devices > 0);
 
-    // search for an implementation supporting one of the vendor+productid combination
-    for (int i = 0; i < num_devices; i++) {
-        if (devicelist[i]->idVendor == idVendor) {
-            // one device file can contain multiple product ids, iterate them
-            for (int y = 0; y < devicelist[i]->numIdProducts; y++) {
-                if (devicelist[i]->idProductsSupported[y] == idProduct) {
-                    // Set the actual found productid (of the set of available ones for this device file/struct)
-                    devicelist[i]->idProduct = idProduct;
-                    // copy struct to the destination in device_found
-                    memcpy(device_found, devicelist[i], sizeof(struct device));
-                    return 0;
-                }
-            }
-        }
+    const uint32_t id = registry_id(idVendor, idProduct);
+
+    int low = 0, high = num_registry_entries;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (registry[mid].id < id)
+            low = mid + 1;
+        else
+            high = mid;
     }
-    return 1;
+
+    if (low < num_registry_entries && registry[low].id == id)
+        return registry[low].device;
+
+    return NULL;
+}
+
+int get_device(struct device* device_found, uint16_t idVendor, uint16_t idProduct)
+{
+    const struct device* device = lookup_device(idVendor, idProduct);
+
+    if (device == NULL)
+        return 1;
+
+    // copy struct to the destination in device_found
+    memcpy(device_found, device, sizeof(struct device));
+    // Set the actual found productid (of the set of available ones for this device file/struct)
+    device_found->idProduct = idProduct;
+    // the state of this copy, while the registered device is shared
+    device_found->timeout_ms   = hsc_device_timeout;
+    device_found->test_profile = test_profile;
+    return 0;
 }
 
 int iterate_devices(int index, struct device** device_found)
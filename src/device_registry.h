@@ -3,9 +3,22 @@
 #include "device.h"
 
 /** @brief Inits the data of all supported devices
+ *
+ *  Runs every driver init function once and builds the sorted vendor+product id index.
+ *  Calling it again is a no-op.
  */
 void init_devices();
 
+/** @brief Looks up the driver of a vendor+product id combination
+ *
+ *  Binary search over the index built by init_devices(), without copying the device.
+ *
+ *  @param idVendor     USB Vendor id to search for
+ *  @param idProduct    USB Product id to search for
+ *  @return the registered device (shared, must not be modified) or NULL when not supported
+ */
+const struct device* lookup_device(uint16_t idVendor, uint16_t idProduct);
+
 /** @brief Provides data to a struct device when a supported device is found
  *
  *  Only matches when idVendor and idProduct correspond to a supported device.
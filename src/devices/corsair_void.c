@@ -54,6 +54,9 @@ static int void_send_sidetone(hid_device* device_handle, uint8_t num);
 static BatteryInfo void_request_battery(hid_device* device_handle);
 static int void_notification_sound(hid_device* device_handle, uint8_t soundid);
 static int void_lights(hid_device* device_handle, uint8_t on);
+static int void_parse_input_report(const unsigned char* data, int size, BatteryInfo* battery, int* chatmix);
+
+static BatteryInfo void_parse_battery(const unsigned char* data_read);
 
 void void_init(struct device** device)
 {
@@ -74,6 +77,8 @@ void void_init(struct device** device)
     device_void.notifcation_sound = &void_notification_sound;
     device_void.switch_lights     = &void_lights;
 
+    device_void.parse_input_report = &void_parse_input_report;
+
     *device = &device_void;
 }
 
@@ -115,7 +120,7 @@ static BatteryInfo void_request_battery(hid_device* device_handle)
     // read battery status
     unsigned char data_read[5];
 
-    r = hid_read_timeout(device_handle, data_read, 5, hsc_device_timeout);
+    r = hid_read_timeout(device_handle, data_read, 5, device_timeout());
 
     if (r < 0) {
         info.status = BATTERY_HIDERROR;
@@ -127,6 +132,13 @@ static BatteryInfo void_request_battery(hid_device* device_handle)
         return info;
     }
 
+    return void_parse_battery(data_read);
+}
+
+static BatteryInfo void_parse_battery(const unsigned char* data_read)
+{
+    BatteryInfo info = { .status = BATTERY_UNAVAILABLE, .level = -1 };
+
     if (data_read[4] == 0) {
         return info;
     }
@@ -158,6 +170,19 @@ static BatteryInfo void_request_battery(hid_device* device_handle)
     return info;
 }
 
+static int void_parse_input_report(const unsigned char* data, int size, BatteryInfo* battery, int* chatmix)
+{
+    UNUSED(chatmix);
+
+    // The headset sends the battery packet on its own when the level,
+    // charging state or microphone position changes
+    if (size < 5 || data[0] != 100)
+        return 0;
+
+    *battery = void_parse_battery(data);
+    return B(CAP_BATTERY_STATUS);
+}
+
 static int void_notification_sound(hid_device* device_handle, uint8_t soundid)
 {
     // soundid can be 0 or 1
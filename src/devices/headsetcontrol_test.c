@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 static struct device device_headsetcontrol_test;
 
@@ -42,8 +43,6 @@ static int headsetcontrol_test_volume_limiter(hid_device* device_handle, uint8_t
 static int headsetcontrol_test_bluetooth_when_powered_on(hid_device* device_handle, uint8_t num);
 static int headsetcontrol_test_bluetooth_call_volume(hid_device* device_handle, uint8_t num);
 
-extern int test_profile;
-
 void headsetcontrol_test_init(struct device** device)
 {
     if (test_profile < 0 || test_profile > 10) {
@@ -87,9 +86,16 @@ void headsetcontrol_test_init(struct device** device)
     *device = &device_headsetcontrol_test;
 }
 
+/// The profile of the test device the driver was called for
+static int profile()
+{
+    const struct device* device = device_current();
+    return device ? device->test_profile : test_profile;
+}
+
 static int headsetcontrol_test_send_sidetone(hid_device* device_handle, uint8_t num)
 {
-    if (test_profile == 1) {
+    if (profile() == 1) {
         return -1;
     }
 
@@ -100,7 +106,7 @@ static BatteryInfo headsetcontrol_test_request_battery(hid_device* device_handle
 {
     BatteryInfo info = { .status = BATTERY_UNAVAILABLE, .level = -1 };
 
-    switch (test_profile) {
+    switch (profile()) {
     case 0:
         info.status = BATTERY_AVAILABLE;
         info.level  = 42;
@@ -122,6 +128,14 @@ static BatteryInfo headsetcontrol_test_request_battery(hid_device* device_handle
     case 5:
         info.status = BATTERY_TIMEOUT;
         break;
+    case 6: {
+        // a wireless headset out of range, the read waits for its whole timeout
+        int timeout_ms     = device_timeout();
+        struct timespec ts = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+        nanosleep(&ts, NULL);
+        info.status = BATTERY_TIMEOUT;
+        break;
+    }
     }
 
     return info;
@@ -159,7 +173,7 @@ static int headsetcontrol_test_send_microphone_volume(hid_device* device_handle,
 
 static int headsetcontrol_test_switch_voice_prompts(hid_device* device_handle, uint8_t on)
 {
-    if (test_profile == 1) {
+    if (profile() == 1) {
         return -1;
     }
     return TESTBYTES_SEND;
@@ -172,9 +186,9 @@ static int headsetcontrol_test_switch_rotate_to_mute(hid_device* device_handle,
 
 static int headsetcontrol_test_request_chatmix(hid_device* device_handle)
 {
-    if (test_profile == 1) {
+    if (profile() == 1) {
         return -1;
-    } else if (test_profile == 2) {
+    } else if (profile() == 2) {
         return -1;
     }
 
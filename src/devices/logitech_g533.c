@@ -83,7 +83,7 @@ static BatteryInfo g533_request_battery(hid_device* device_handle)
     }
 
     uint8_t data_read[7];
-    r = hid_read_timeout(device_handle, data_read, 7, hsc_device_timeout);
+    r = hid_read_timeout(device_handle, data_read, 7, device_timeout());
     if (r < 0) {
         info.status = BATTERY_HIDERROR;
         return info;
@@ -138,7 +138,7 @@ static int g533_send_inactive_time(hid_device* device_handle, uint8_t num)
         return r;
 
     uint8_t data_read[7];
-    r = hid_read_timeout(device_handle, data_read, 7, hsc_device_timeout);
+    r = hid_read_timeout(device_handle, data_read, 7, device_timeout());
     if (r < 0)
         return r;
 
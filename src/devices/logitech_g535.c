@@ -101,7 +101,7 @@ static int g535_send_sidetone(hid_device* device_handle, uint8_t num)
         return ret;
     }
 
-    ret = hid_read_timeout(device_handle, buf, HIDPP_LONG_MESSAGE_LENGTH, hsc_device_timeout);
+    ret = hid_read_timeout(device_handle, buf, HIDPP_LONG_MESSAGE_LENGTH, device_timeout());
     if (ret < 0) {
         return ret;
     }
@@ -138,7 +138,7 @@ static BatteryInfo g535_request_battery(hid_device* device_handle)
         return info;
     }
 
-    ret = hid_read_timeout(device_handle, buf, HIDPP_LONG_MESSAGE_LENGTH, hsc_device_timeout);
+    ret = hid_read_timeout(device_handle, buf, HIDPP_LONG_MESSAGE_LENGTH, device_timeout());
     if (ret < 0) {
         info.status = BATTERY_HIDERROR;
         return info;
@@ -190,7 +190,7 @@ static int g535_send_inactive_time(hid_device* device_handle, uint8_t num)
         return ret;
     }
 
-    ret = hid_read_timeout(device_handle, buf, HIDPP_LONG_MESSAGE_LENGTH, hsc_device_timeout);
+    ret = hid_read_timeout(device_handle, buf, HIDPP_LONG_MESSAGE_LENGTH, device_timeout());
     if (ret < 0) {
         return ret;
     }
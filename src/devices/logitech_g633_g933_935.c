@@ -75,7 +75,7 @@ static BatteryInfo g933_935_request_battery(hid_device* device_handle)
     }
 
     uint8_t data_read[7];
-    r = hid_read_timeout(device_handle, data_read, 7, hsc_device_timeout);
+    r = hid_read_timeout(device_handle, data_read, 7, device_timeout());
     if (r < 0) {
         info.status = BATTERY_HIDERROR;
         return info;
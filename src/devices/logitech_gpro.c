@@ -84,7 +84,7 @@ static BatteryInfo gpro_request_battery(hid_device* device_handle)
         return info;
     }
 
-    r = hid_read_timeout(device_handle, buf, HIDPP_LONG_MESSAGE_LENGTH, hsc_device_timeout);
+    r = hid_read_timeout(device_handle, buf, HIDPP_LONG_MESSAGE_LENGTH, device_timeout());
     if (r < 0) {
         info.status = BATTERY_HIDERROR;
         return info;
@@ -120,7 +120,7 @@ static int gpro_send_inactive_time(hid_device* device_handle, uint8_t num)
     if (r < 0)
         return r;
 
-    r = hid_read_timeout(device_handle, buf, HIDPP_LONG_MESSAGE_LENGTH, hsc_device_timeout);
+    r = hid_read_timeout(device_handle, buf, HIDPP_LONG_MESSAGE_LENGTH, device_timeout());
     if (r < 0)
         return r;
 
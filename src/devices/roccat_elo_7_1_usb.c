@@ -45,7 +45,7 @@ static int send_receive(hid_device* hid_device, const uint8_t* data,
     r = hid_write(hid_device, data, size);
 
     if ((out_buffer != NULL) && (r >= 0)) {
-        r = hid_read_timeout(hid_device, out_buffer, 16, hsc_device_timeout);
+        r = hid_read_timeout(hid_device, out_buffer, 16, device_timeout());
     }
 
     ts.tv_sec  = 0;
@@ -93,7 +93,7 @@ static BatteryInfo arctis_1_request_battery(hid_device* device_handle)
     // read battery status
     unsigned char data_read[8];
 
-    r = hid_read_timeout(device_handle, data_read, 8, hsc_device_timeout);
+    r = hid_read_timeout(device_handle, data_read, 8, device_timeout());
 
     if (r < 0) {
         info.status = BATTERY_HIDERROR;
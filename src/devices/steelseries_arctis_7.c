@@ -98,7 +98,7 @@ static BatteryInfo arctis_7_request_battery(hid_device* device_handle)
     // read battery status
     unsigned char data_read[8];
 
-    r = hid_read_timeout(device_handle, data_read, 8, hsc_device_timeout);
+    r = hid_read_timeout(device_handle, data_read, 8, device_timeout());
 
     if (r < 0) {
         info.status = BATTERY_HIDERROR;
@@ -161,7 +161,7 @@ static int arctis_7_request_chatmix(hid_device* device_handle)
     // read chatmix level
     unsigned char data_read[8];
 
-    r = hid_read_timeout(device_handle, data_read, 8, hsc_device_timeout);
+    r = hid_read_timeout(device_handle, data_read, 8, device_timeout());
 
     if (r < 0)
         return r;
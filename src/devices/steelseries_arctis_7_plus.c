@@ -1,4 +1,5 @@
 #include "../device.h"
+#include "../hid_utility.h"
 #include "../utility.h"
 
 #include <hidapi.h>
@@ -100,7 +101,7 @@ static BatteryInfo arctis_7_plus_request_battery(hid_device* device_handle)
 {
     // read device info
     unsigned char data_read[STATUS_BUF_SIZE];
-    int r = arctis_7_plus_read_device_status(device_handle, data_read);
+    int r = hid_read_status_cached(device_handle, &arctis_7_plus_read_device_status, data_read, sizeof(data_read));
 
     BatteryInfo info = { .status = BATTERY_UNAVAILABLE, .level = -1 };
 
@@ -139,7 +140,7 @@ static int arctis_7_plus_request_chatmix(hid_device* device_handle)
     // neutral 0x64, 0x64
     // read device info
     unsigned char data_read[STATUS_BUF_SIZE];
-    int r = arctis_7_plus_read_device_status(device_handle, data_read);
+    int r = hid_read_status_cached(device_handle, &arctis_7_plus_read_device_status, data_read, sizeof(data_read));
 
     if (r < 0)
         return r;
@@ -221,5 +222,5 @@ int arctis_7_plus_read_device_status(hid_device* device_handle, unsigned char* d
     if (r < 0)
         return r;
 
-    return hid_read_timeout(device_handle, data_read, STATUS_BUF_SIZE, hsc_device_timeout);
+    return hid_read_timeout(device_handle, data_read, STATUS_BUF_SIZE, device_timeout());
 }
@@ -1,4 +1,5 @@
 #include "../device.h"
+#include "../hid_utility.h"
 #include "../utility.h"
 
 #include <hidapi.h>
@@ -84,7 +85,7 @@ static BatteryInfo arctis_9_request_battery(hid_device* device_handle)
 {
     // read device info
     unsigned char data_read[12];
-    int r = arctis_9_read_device_status(device_handle, data_read);
+    int r = hid_read_status_cached(device_handle, &arctis_9_read_device_status, data_read, sizeof(data_read));
 
     BatteryInfo info = { .status = BATTERY_UNAVAILABLE, .level = -1 };
 
@@ -133,7 +134,7 @@ static int arctis_9_request_chatmix(hid_device* device_handle)
 {
     // read device info
     unsigned char data_read[12];
-    int r = arctis_9_read_device_status(device_handle, data_read);
+    int r = hid_read_status_cached(device_handle, &arctis_9_read_device_status, data_read, sizeof(data_read));
 
     if (r < 0)
         return r;
@@ -165,5 +166,5 @@ int arctis_9_read_device_status(hid_device* device_handle, unsigned char* data_r
         return r;
 
     // read device info
-    return hid_read_timeout(device_handle, data_read, 12, hsc_device_timeout);
+    return hid_read_timeout(device_handle, data_read, 12, device_timeout());
 }
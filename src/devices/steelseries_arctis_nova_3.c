@@ -1,4 +1,5 @@
 #include "../device.h"
+#include "../hid_utility.h"
 
 #include <hidapi.h>
 #include <stdio.h>
@@ -24,6 +25,7 @@ static int arctis_nova_3_send_equalizer_preset(hid_device* device_handle, uint8_
 static int arctis_nova_3_send_equalizer(hid_device* device_handle, struct equalizer_settings* settings);
 static int arctis_nova_3_send_microphone_mute_led_brightness(hid_device* device_handle, uint8_t num);
 static int arctis_nova_3_send_microphone_volume(hid_device* device_handle, uint8_t num);
+static int arctis_nova_3_save_state(hid_device* device_handle);
 
 void arctis_nova_3_init(struct device** device)
 {
@@ -47,6 +49,7 @@ void arctis_nova_3_init(struct device** device)
     device_arctis.send_equalizer                      = &arctis_nova_3_send_equalizer;
     device_arctis.send_microphone_mute_led_brightness = &arctis_nova_3_send_microphone_mute_led_brightness;
     device_arctis.send_microphone_volume              = &arctis_nova_3_send_microphone_volume;
+    device_arctis.commit_settings                     = &arctis_nova_3_save_state;
 
     *device = &device_arctis;
 }
@@ -67,7 +70,7 @@ static int arctis_nova_3_send_sidetone(hid_device* device_handle, uint8_t num)
     uint8_t data[MSG_SIZE] = { 0x06, 0x39, num };
     hid_send_feature_report(device_handle, data, MSG_SIZE);
 
-    return hid_send_feature_report(device_handle, SAVE_DATA, MSG_SIZE);
+    return arctis_nova_3_save_state(device_handle);
 }
 
 static int arctis_nova_3_send_equalizer_preset(hid_device* device_handle, uint8_t num)
@@ -80,25 +83,25 @@ static int arctis_nova_3_send_equalizer_preset(hid_device* device_handle, uint8_
         uint8_t flat[MSG_SIZE] = { 0x06, 0x33, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14 };
         hid_send_feature_report(device_handle, flat, MSG_SIZE);
 
-        return hid_send_feature_report(device_handle, SAVE_DATA, MSG_SIZE);
+        return arctis_nova_3_save_state(device_handle);
     }
     case 1: {
         uint8_t bass[MSG_SIZE] = { 0x06, 0x33, 0x1c, 0x19, 0x11, 0x14, 0x14, 0x14 };
         hid_send_feature_report(device_handle, bass, MSG_SIZE);
 
-        return hid_send_feature_report(device_handle, SAVE_DATA, MSG_SIZE);
+        return arctis_nova_3_save_state(device_handle);
     }
     case 2: {
         uint8_t smiley[MSG_SIZE] = { 0x06, 0x33, 0x1a, 0x17, 0x0f, 0x12, 0x17, 0x1a };
         hid_send_feature_report(device_handle, smiley, MSG_SIZE);
 
-        return hid_send_feature_report(device_handle, SAVE_DATA, MSG_SIZE);
+        return arctis_nova_3_save_state(device_handle);
     }
     case 3: {
         uint8_t focus[MSG_SIZE] = { 0x06, 0x33, 0x0c, 0x0d, 0x11, 0x18, 0x1c, 0x14 };
         hid_send_feature_report(device_handle, focus, MSG_SIZE);
 
-        return hid_send_feature_report(device_handle, SAVE_DATA, MSG_SIZE);
+        return arctis_nova_3_save_state(device_handle);
     }
     default: {
         printf("Device only supports 0-3 range for presets.\n");
@@ -136,7 +139,7 @@ static int arctis_nova_3_send_microphone_mute_led_brightness(hid_device* device_
     uint8_t brightness[MSG_SIZE] = { 0x06, 0xae, num };
     hid_send_feature_report(device_handle, brightness, MSG_SIZE);
 
-    return hid_send_feature_report(device_handle, SAVE_DATA, MSG_SIZE);
+    return arctis_nova_3_save_state(device_handle);
 }
 
 static int arctis_nova_3_send_microphone_volume(hid_device* device_handle, uint8_t num)
@@ -169,5 +172,13 @@ static int arctis_nova_3_send_microphone_volume(hid_device* device_handle, uint8
     uint8_t volume[MSG_SIZE] = { 0x06, 0x37, num };
     hid_send_feature_report(device_handle, volume, MSG_SIZE);
 
+    return arctis_nova_3_save_state(device_handle);
+}
+
+static int arctis_nova_3_save_state(hid_device* device_handle)
+{
+    if (hid_transaction_defer_save(device_handle))
+        return 0;
+
     return hid_send_feature_report(device_handle, SAVE_DATA, MSG_SIZE);
 }
@@ -1,4 +1,5 @@
 #include "../device.h"
+#include "../hid_utility.h"
 #include "../utility.h"
 
 #include <hidapi.h>
@@ -82,6 +83,7 @@ void arctis_nova_5_init(struct device** device)
     device_arctis.send_volume_limiter                 = &set_volume_limiter;
     device_arctis.send_equalizer_preset               = &set_eq_preset;
     device_arctis.send_equalizer                      = &set_eq;
+    device_arctis.commit_settings                     = &save_state;
     *device                                           = &device_arctis;
 }
 
@@ -93,11 +95,14 @@ static int read_device_status(hid_device* device_handle, unsigned char* data_rea
     if (r < 0)
         return r;
 
-    return hid_read_timeout(device_handle, data_read, STATUS_BUF_SIZE, hsc_device_timeout);
+    return hid_read_timeout(device_handle, data_read, STATUS_BUF_SIZE, device_timeout());
 }
 
 static int save_state(hid_device* device_handle)
 {
+    if (hid_transaction_defer_save(device_handle))
+        return 0;
+
     int r = hid_write(device_handle, SAVE_DATA1, MSG_SIZE);
     if (r < 0)
         return r;
@@ -181,7 +186,7 @@ static int set_mic_mute_led_brightness(hid_device* device_handle, uint8_t num)
 static BatteryInfo get_battery(hid_device* device_handle)
 {
     unsigned char data_read[STATUS_BUF_SIZE];
-    int r = read_device_status(device_handle, data_read);
+    int r = hid_read_status_cached(device_handle, &read_device_status, data_read, sizeof(data_read));
 
     BatteryInfo info = { .status = BATTERY_UNAVAILABLE, .level = -1 };
 
@@ -225,7 +230,7 @@ static int get_chatmix(hid_device* device_handle)
     // neutral 0x64, 0x64
     // read device info
     unsigned char data_read[STATUS_BUF_SIZE];
-    int r = read_device_status(device_handle, data_read);
+    int r = hid_read_status_cached(device_handle, &read_device_status, data_read, sizeof(data_read));
 
     if (r < 0)
         return r;
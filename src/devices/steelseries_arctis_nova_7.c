@@ -1,4 +1,5 @@
 #include "../device.h"
+#include "../hid_utility.h"
 #include "../utility.h"
 
 #include <hidapi.h>
@@ -57,6 +58,11 @@ static int arctis_nova_7_bluetooth_call_volume(hid_device* device_handle, uint8_
 static int arctis_nova_7_mic_light(hid_device* device_handle, uint8_t num);
 static int arctis_nova_7_mic_volume(hid_device* device_handle, uint8_t num);
 static int arctis_nova_7_volume_limiter(hid_device* device_handle, uint8_t num);
+static int arctis_nova_7_parse_input_report(const unsigned char* data, int size, BatteryInfo* battery, int* chatmix);
+static int arctis_nova_7_save_state(hid_device* device_handle);
+
+static BatteryInfo arctis_nova_7_parse_battery(const unsigned char* data_read);
+static int arctis_nova_7_parse_chatmix(const unsigned char* data_read);
 
 int arctis_nova_7_read_device_status(hid_device* device_handle, unsigned char* data_read);
 
@@ -94,6 +100,8 @@ void arctis_nova_7_init(struct device** device)
     device_arctis.send_volume_limiter                 = &arctis_nova_7_volume_limiter;
     device_arctis.send_bluetooth_when_powered_on      = &arctis_nova_7_bluetooth_when_powered_on;
     device_arctis.send_bluetooth_call_volume          = &arctis_nova_7_bluetooth_call_volume;
+    device_arctis.commit_settings                     = &arctis_nova_7_save_state;
+    device_arctis.parse_input_report                  = &arctis_nova_7_parse_input_report;
 
     *device = &device_arctis;
 }
@@ -136,7 +144,7 @@ static BatteryInfo arctis_nova_7_request_battery(hid_device* device_handle)
 {
     // read device info
     unsigned char data_read[STATUS_BUF_SIZE];
-    int r = arctis_nova_7_read_device_status(device_handle, data_read);
+    int r = hid_read_status_cached(device_handle, &arctis_nova_7_read_device_status, data_read, sizeof(data_read));
 
     BatteryInfo info = { .status = BATTERY_UNAVAILABLE, .level = -1 };
 
@@ -150,6 +158,13 @@ static BatteryInfo arctis_nova_7_request_battery(hid_device* device_handle)
         return info;
     }
 
+    return arctis_nova_7_parse_battery(data_read);
+}
+
+static BatteryInfo arctis_nova_7_parse_battery(const unsigned char* data_read)
+{
+    BatteryInfo info = { .status = BATTERY_UNAVAILABLE, .level = -1 };
+
     if (data_read[3] == HEADSET_OFFLINE)
         return info;
 
@@ -177,7 +192,7 @@ static int arctis_nova_7_request_chatmix(hid_device* device_handle)
     // neutral 0x64, 0x64
     // read device info
     unsigned char data_read[STATUS_BUF_SIZE];
-    int r = arctis_nova_7_read_device_status(device_handle, data_read);
+    int r = hid_read_status_cached(device_handle, &arctis_nova_7_read_device_status, data_read, sizeof(data_read));
 
     if (r < 0)
         return r;
@@ -185,6 +200,11 @@ static int arctis_nova_7_request_chatmix(hid_device* device_handle)
     if (r == 0)
         return HSC_READ_TIMEOUT;
 
+    return arctis_nova_7_parse_chatmix(data_read);
+}
+
+static int arctis_nova_7_parse_chatmix(const unsigned char* data_read)
+{
     // it's a slider, but setting for game and chat
     // are reported as separate values, we combine
     // them back into one setting of the slider
@@ -270,14 +290,25 @@ int arctis_nova_7_read_device_status(hid_device* device_handle, unsigned char* d
     if (r < 0)
         return r;
 
-    return hid_read_timeout(device_handle, data_read, STATUS_BUF_SIZE, hsc_device_timeout);
+    return hid_read_timeout(device_handle, data_read, STATUS_BUF_SIZE, device_timeout());
+}
+
+static int arctis_nova_7_parse_input_report(const unsigned char* data, int size, BatteryInfo* battery, int* chatmix)
+{
+    // Status packets are also sent on their own, e.g. when the chatmix dial is turned
+    if (size < 6 || data[0] != 0xb0)
+        return 0;
+
+    *battery = arctis_nova_7_parse_battery(data);
+    *chatmix = arctis_nova_7_parse_chatmix(data);
+    return B(CAP_BATTERY_STATUS) | B(CAP_CHATMIX_STATUS);
 }
 
 static int arctis_nova_7_bluetooth_when_powered_on(hid_device* device_handle, uint8_t num)
 {
     unsigned char data[MSG_SIZE] = { 0x00, 0xb2, num };
     if (hid_write(device_handle, data, MSG_SIZE) >= 0) {
-        return hid_write(device_handle, SAVE_DATA, MSG_SIZE);
+        return arctis_nova_7_save_state(device_handle);
     }
     return HSC_READ_TIMEOUT;
 }
@@ -320,3 +351,11 @@ static int arctis_nova_7_volume_limiter(hid_device* device_handle, uint8_t num)
     unsigned char data[MSG_SIZE] = { 0x00, 0x3a, num };
     return hid_write(device_handle, data, MSG_SIZE);
 }
+
+static int arctis_nova_7_save_state(hid_device* device_handle)
+{
+    if (hid_transaction_defer_save(device_handle))
+        return 0;
+
+    return hid_write(device_handle, SAVE_DATA, MSG_SIZE);
+}
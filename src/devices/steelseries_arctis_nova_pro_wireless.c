@@ -1,4 +1,5 @@
 #include "../device.h"
+#include "../hid_utility.h"
 #include "../utility.h"
 
 #include <stdio.h>
@@ -57,6 +58,9 @@ static int set_lights(hid_device* device_handle, uint8_t on);
 static int set_inactive_time(hid_device* device_handle, uint8_t minutes);
 static int set_equalizer_preset(hid_device* device_handle, uint8_t num);
 static int set_equalizer(hid_device* device_handle, struct equalizer_settings* settings);
+static int parse_input_report(const unsigned char* data, int size, BatteryInfo* battery, int* chatmix);
+
+static BatteryInfo parse_battery(const unsigned char* data_read, int size);
 
 static int read_device_status(hid_device* device_handle, unsigned char* data_read);
 static int save_state(hid_device* device_handle);
@@ -86,6 +90,8 @@ void arctis_nova_pro_wireless_init(struct device** device)
     device_arctis.send_inactive_time    = &set_inactive_time;
     device_arctis.send_equalizer_preset = &set_equalizer_preset;
     device_arctis.send_equalizer        = &set_equalizer;
+    device_arctis.commit_settings       = &save_state;
+    device_arctis.parse_input_report    = &parse_input_report;
 
     *device = &device_arctis;
 }
@@ -110,7 +116,7 @@ static BatteryInfo get_battery(hid_device* device_handle)
 {
     // read device info
     unsigned char data_read[STATUS_BUF_SIZE];
-    int res = read_device_status(device_handle, data_read);
+    int res = hid_read_status_cached(device_handle, &read_device_status, data_read, sizeof(data_read));
 
     BatteryInfo info = { .status = BATTERY_UNAVAILABLE, .level = -1 };
 
@@ -124,7 +130,14 @@ static BatteryInfo get_battery(hid_device* device_handle)
         return info;
     }
 
-    if (res < 16)
+    return parse_battery(data_read, res);
+}
+
+static BatteryInfo parse_battery(const unsigned char* data_read, int size)
+{
+    BatteryInfo info = { .status = BATTERY_UNAVAILABLE, .level = -1 };
+
+    if (size < 16)
         return info;
 
     uint8_t status = data_read[15];
@@ -148,6 +161,18 @@ static BatteryInfo get_battery(hid_device* device_handle)
     return info;
 }
 
+static int parse_input_report(const unsigned char* data, int size, BatteryInfo* battery, int* chatmix)
+{
+    UNUSED(chatmix);
+
+    // The base station repeats the status packet on its own on changes
+    if (size < 16 || !(data[0] == 0x06 && data[1] == 0xb0))
+        return 0;
+
+    *battery = parse_battery(data, size);
+    return B(CAP_BATTERY_STATUS);
+}
+
 static int set_lights(hid_device* device_handle, uint8_t on)
 {
     uint8_t led_strength   = map(on, 0, 1, LED_MIN, LED_MAX);
@@ -248,7 +273,7 @@ static int read_device_status(hid_device* device_handle, unsigned char* data_rea
         return res;
 
     // read device info
-    res = hid_read_timeout(device_handle, data_read, STATUS_BUF_SIZE, hsc_device_timeout);
+    res = hid_read_timeout(device_handle, data_read, STATUS_BUF_SIZE, device_timeout());
 
     if (res < 0)
         return res;
@@ -263,6 +288,9 @@ static int read_device_status(hid_device* device_handle, unsigned char* data_rea
 
 static int save_state(hid_device* device_handle)
 {
+    if (hid_transaction_defer_save(device_handle))
+        return 0;
+
     uint8_t data[MSG_SIZE] = { 0x06, 0x09 };
 
     return hid_write(device_handle, data, MSG_SIZE);
@@ -90,7 +90,7 @@ static BatteryInfo arctis_pro_wireless_request_battery(hid_device* device_handle
         return info;
     }
 
-    r = hid_read_timeout(device_handle, data_read, 1, hsc_device_timeout);
+    r = hid_read_timeout(device_handle, data_read, 1, device_timeout());
     if (r < 0) {
         info.status = BATTERY_HIDERROR;
         return info;
@@ -134,7 +134,7 @@ int arctis_pro_wireless_read_device_status(hid_device* device_handle, unsigned c
         return r;
 
     // read device info
-    return hid_read_timeout(device_handle, data_read, 2, hsc_device_timeout);
+    return hid_read_timeout(device_handle, data_read, 2, device_timeout());
 }
 
 int arctis_pro_wireless_save_state(hid_device* device_handle)
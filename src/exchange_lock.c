@@ -0,0 +1,231 @@
+#include "exchange_lock.h"
+
+#include "utility.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// updated atomically, the headsets of one run may wait in parallel
+static int64_t total_wait_us = 0;
+static int total_waits       = 0;
+
+double exchange_lock_wait_ms(int* waits)
+{
+    if (waits)
+        *waits = __atomic_load_n(&total_waits, __ATOMIC_RELAXED);
+
+    return __atomic_load_n(&total_wait_us, __ATOMIC_RELAXED) / 1000.0;
+}
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define EXCHANGE_LOCK_MAGIC 0x4b4c5348 // "HSLK"
+/// Owners remembered for the stale check, more concurrent waiters only weaken that check
+#define EXCHANGE_LOCK_SLOTS 64
+
+struct exchange_lock_segment {
+    uint32_t magic;
+    uint32_t next_ticket;
+    uint32_t now_serving;
+    /// (ticket << 32 | pid) of the process holding or waiting with a ticket, pid 0 when it gave up
+    uint64_t owners[EXCHANGE_LOCK_SLOTS];
+};
+
+struct exchange_lock {
+    int fd;
+    struct exchange_lock_segment* segment;
+    uint32_t ticket;
+    bool held;
+};
+
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/// FNV-1a, to derive a file name from the HID path
+static uint32_t path_hash(const char* path)
+{
+    uint32_t hash = 2166136261u;
+    for (const char* p = path; *p; p++) {
+        hash ^= (uint8_t)*p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+struct exchange_lock* exchange_lock_open(const char* hid_path)
+{
+    char path[512];
+    const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+
+    if (runtime_dir && strlen(runtime_dir) > 0)
+        snprintf(path, sizeof(path), "%s/headsetcontrol-%08x.lock", runtime_dir, path_hash(hid_path));
+    else
+        snprintf(path, sizeof(path), "/tmp/headsetcontrol-%u-%08x.lock", (unsigned)getuid(), path_hash(hid_path));
+
+    // not a symbolic link or a file of another user, the fallback is in /tmp
+    int fd = open_private_file(path);
+    if (fd < 0)
+        return NULL;
+
+    // size and initialize the segment under the lock, another process may do the same
+    flock(fd, LOCK_EX);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (st.st_size != sizeof(struct exchange_lock_segment) && ftruncate(fd, sizeof(struct exchange_lock_segment)) != 0)) {
+        flock(fd, LOCK_UN);
+        close(fd);
+        return NULL;
+    }
+
+    void* map = mmap(NULL, sizeof(struct exchange_lock_segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        flock(fd, LOCK_UN);
+        close(fd);
+        return NULL;
+    }
+
+    struct exchange_lock_segment* segment = map;
+    if (segment->magic != EXCHANGE_LOCK_MAGIC) {
+        memset(segment, 0, sizeof(*segment));
+        segment->magic = EXCHANGE_LOCK_MAGIC;
+    }
+
+    flock(fd, LOCK_UN);
+
+    struct exchange_lock* lock = calloc(1, sizeof(struct exchange_lock));
+    if (!lock) {
+        munmap(map, sizeof(struct exchange_lock_segment));
+        close(fd);
+        return NULL;
+    }
+
+    lock->fd      = fd;
+    lock->segment = segment;
+    return lock;
+}
+
+/// Whether the ticket being served belongs to a process that is gone or gave up
+static bool ticket_abandoned(struct exchange_lock_segment* segment, uint32_t ticket)
+{
+    uint64_t owner = __atomic_load_n(&segment->owners[ticket % EXCHANGE_LOCK_SLOTS], __ATOMIC_ACQUIRE);
+
+    // the owner didn't register yet
+    if ((uint32_t)(owner >> 32) != ticket)
+        return false;
+
+    pid_t pid = (pid_t)(owner & 0xffffffff);
+    return pid == 0 || (kill(pid, 0) != 0 && errno == ESRCH);
+}
+
+void exchange_lock_acquire(struct exchange_lock* lock)
+{
+    if (!lock || lock->held)
+        return;
+
+    struct exchange_lock_segment* segment = lock->segment;
+
+    uint32_t ticket = __atomic_fetch_add(&segment->next_ticket, 1, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&segment->owners[ticket % EXCHANGE_LOCK_SLOTS], (uint64_t)ticket << 32 | (uint32_t)getpid(), __ATOMIC_RELEASE);
+
+    lock->ticket = ticket;
+    lock->held   = true;
+
+    uint32_t serving = __atomic_load_n(&segment->now_serving, __ATOMIC_ACQUIRE);
+    if (serving == ticket)
+        return;
+
+    double start          = now_ms();
+    struct timespec delay = { 0, 100000 };
+
+    while (serving != ticket) {
+        if (ticket_abandoned(segment, serving)) {
+            __atomic_compare_exchange_n(&segment->now_serving, &serving, serving + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+            continue;
+        }
+
+        if (now_ms() - start > EXCHANGE_LOCK_TIMEOUT_MS) {
+            fprintf(stderr, "Waited too long for another process using the device, continuing anyway\n");
+
+            // mark the ticket as given up, so that it is skipped when its turn comes
+            __atomic_store_n(&segment->owners[ticket % EXCHANGE_LOCK_SLOTS], (uint64_t)ticket << 32, __ATOMIC_RELEASE);
+
+            // skip the ticket being served too: its owner died before registering it, or its pid
+            // was reused, and every later process would wait the whole timeout for it as well
+            __atomic_compare_exchange_n(&segment->now_serving, &serving, serving + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+            lock->held = false;
+            break;
+        }
+
+        nanosleep(&delay, NULL);
+        // back off up to 2 ms, exchanges take a few milliseconds at least
+        if (delay.tv_nsec < 2000000)
+            delay.tv_nsec *= 2;
+
+        serving = __atomic_load_n(&segment->now_serving, __ATOMIC_ACQUIRE);
+    }
+
+    __atomic_fetch_add(&total_wait_us, (int64_t)((now_ms() - start) * 1000), __ATOMIC_RELAXED);
+    __atomic_fetch_add(&total_waits, 1, __ATOMIC_RELAXED);
+}
+
+void exchange_lock_release(struct exchange_lock* lock)
+{
+    if (!lock || !lock->held)
+        return;
+
+    // fails when a waiter considered this ticket abandoned and skipped it already
+    uint32_t expected = lock->ticket;
+    __atomic_compare_exchange_n(&lock->segment->now_serving, &expected, lock->ticket + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+
+    lock->held = false;
+}
+
+void exchange_lock_close(struct exchange_lock* lock)
+{
+    if (!lock)
+        return;
+
+    exchange_lock_release(lock);
+    munmap(lock->segment, sizeof(struct exchange_lock_segment));
+    close(lock->fd);
+    free(lock);
+}
+
+#else // _WIN32: exchanges are not serialized between processes
+
+struct exchange_lock* exchange_lock_open(const char* hid_path)
+{
+    UNUSED(hid_path);
+    return NULL;
+}
+
+void exchange_lock_acquire(struct exchange_lock* lock)
+{
+    UNUSED(lock);
+}
+
+void exchange_lock_release(struct exchange_lock* lock)
+{
+    UNUSED(lock);
+}
+
+void exchange_lock_close(struct exchange_lock* lock)
+{
+    UNUSED(lock);
+}
+
+#endif
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Inter-process lock serializing the exchanges (write, then read of the reply)
+ * of all HeadsetControl processes talking to the same HID device, so that one
+ * process can't consume the reply meant for another.
+ *
+ * Each device path has a small shared segment (a file in the runtime directory)
+ * holding a ticket lock: waiters are served in the order they arrived. Tickets of
+ * processes that died are skipped, and a waiter gives up after
+ * EXCHANGE_LOCK_TIMEOUT_MS and continues without the lock. It then skips the
+ * ticket it waited for as well, so that a ticket which is never released (its
+ * process died before registering it) only delays one waiter.
+ */
+
+/// Longest time to wait for other processes before continuing without the lock
+#define EXCHANGE_LOCK_TIMEOUT_MS 15000
+
+struct exchange_lock;
+
+/**
+ * @brief Opens the lock of a HID device path
+ *
+ * The segment is refused when it is a symbolic link or belongs to another user,
+ * see open_private_file().
+ *
+ * @return the lock, or NULL when the lock segment can't be created (exchanges are then not serialized)
+ */
+struct exchange_lock* exchange_lock_open(const char* hid_path);
+
+/**
+ * @brief Waits for the turn of this process, see EXCHANGE_LOCK_TIMEOUT_MS
+ */
+void exchange_lock_acquire(struct exchange_lock* lock);
+
+/**
+ * @brief Lets the next waiting process continue
+ */
+void exchange_lock_release(struct exchange_lock* lock);
+
+void exchange_lock_close(struct exchange_lock* lock);
+
+/**
+ * @brief Statistics of this process
+ *
+ * @param waits number of acquisitions that had to wait for another process
+ * @return total time spent waiting, in milliseconds
+ */
+double exchange_lock_wait_ms(int* waits);
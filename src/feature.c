@@ -0,0 +1,618 @@
+#include "feature.h"
+
+#include "device_registry.h"
+#include "hid_utility.h"
+#include "status_cache.h"
+#include "utility.h"
+
+#include <hidapi.h>
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+static const wchar_t* serial_of(const struct hid_device_info* dev)
+{
+    return dev->serial_number ? dev->serial_number : L"";
+}
+
+/// Names as enumerated, replaced by those of the connection once it is opened, and the serial number
+static void copy_names(struct device* device_found, const struct hid_device_info* cur_dev)
+{
+    if (cur_dev->manufacturer_string)
+        wcsncpy(device_found->device_hid_vendorname, cur_dev->manufacturer_string, sizeof(device_found->device_hid_vendorname) / sizeof(device_found->device_hid_vendorname[0]));
+    if (cur_dev->product_string)
+        wcsncpy(device_found->device_hid_productname, cur_dev->product_string, sizeof(device_found->device_hid_productname) / sizeof(device_found->device_hid_productname[0]));
+    wcsncpy(device_found->device_hid_serialnumber, serial_of(cur_dev), sizeof(device_found->device_hid_serialnumber) / sizeof(device_found->device_hid_serialnumber[0]) - 1);
+}
+
+/**
+ *  This function iterates through all HID devices of the enumeration snapshot.
+ *
+ *  @return 0 when a supported device is found
+ */
+int find_device(struct device* device_found, int test_device)
+{
+    if (test_device)
+        return get_device(device_found, VENDOR_TESTDEVICE, PRODUCT_TESTDEVICE);
+
+    struct hid_device_info* cur_dev;
+    cur_dev = hid_snapshot_devices();
+    while (cur_dev) {
+        // only copy the device struct once a supported device is found
+        if (lookup_device(cur_dev->vendor_id, cur_dev->product_id) != NULL) {
+            int res = get_device(device_found, cur_dev->vendor_id, cur_dev->product_id);
+
+            if (res == 0)
+                copy_names(device_found, cur_dev);
+
+            return res;
+        }
+
+        cur_dev = cur_dev->next;
+    }
+
+    return -1;
+}
+
+static bool selector_matches(const struct device_selector* selectors, int num_selectors, const struct hid_device_info* dev, int instance)
+{
+    for (int i = 0; i < num_selectors; i++) {
+        if (selectors[i].idVendor == dev->vendor_id && selectors[i].idProduct == dev->product_id
+            && (selectors[i].serial[0] == L'\0' || wcscmp(selectors[i].serial, serial_of(dev)) == 0)
+            && (selectors[i].instance < 0 || selectors[i].instance == instance))
+            return true;
+    }
+
+    return false;
+}
+
+int find_devices(struct device* devices, int max_devices, const struct device_selector* selectors, int num_selectors, int test_device)
+{
+    if (test_device)
+        return get_device(&devices[0], VENDOR_TESTDEVICE, PRODUCT_TESTDEVICE) == 0 ? 1 : 0;
+
+    struct hid_device_info* devs = hid_snapshot_devices();
+    int found                    = 0;
+
+    for (struct hid_device_info* cur_dev = devs; cur_dev && found < max_devices; cur_dev = cur_dev->next) {
+        if (lookup_device(cur_dev->vendor_id, cur_dev->product_id) == NULL)
+            continue;
+
+        // every interface of a headset is enumerated, only take each headset once;
+        // headsets without a serial number are told apart by their position (see get_hid_path_instance())
+        const wchar_t* sn = serial_of(cur_dev);
+        int instance      = hid_device_instance(devs, cur_dev, sn[0] != L'\0');
+
+        if (num_selectors > 0 && !selector_matches(selectors, num_selectors, cur_dev, instance))
+            continue;
+
+        bool known = false;
+        for (int i = 0; i < found && !known; i++) {
+            known = devices[i].idVendor == cur_dev->vendor_id && devices[i].idProduct == cur_dev->product_id
+                && devices[i].device_instance == instance && wcscmp(devices[i].device_hid_serialnumber, sn) == 0;
+        }
+        if (known)
+            continue;
+
+        struct device* device_found = &devices[found];
+        if (get_device(device_found, cur_dev->vendor_id, cur_dev->product_id) != 0)
+            continue;
+
+        copy_names(device_found, cur_dev);
+        device_found->device_instance = instance;
+        found++;
+    }
+
+    return found;
+}
+
+/**
+ * @brief Fills a selector for the headset an interface belongs to
+ *
+ * @param by_position select only this headset among those of the same ids and serial number,
+ *                    identical headsets without a serial number are only told apart by it
+ */
+static int select_interface(struct device_selector* selector, const struct hid_device_info* dev, bool by_position)
+{
+    if (!dev || lookup_device(dev->vendor_id, dev->product_id) == NULL)
+        return -1;
+
+    memset(selector, 0, sizeof(*selector));
+    selector->idVendor  = dev->vendor_id;
+    selector->idProduct = dev->product_id;
+    wcsncpy(selector->serial, serial_of(dev), sizeof(selector->serial) / sizeof(selector->serial[0]) - 1);
+    selector->instance = by_position ? hid_device_instance(hid_snapshot_devices(), dev, selector->serial[0] != L'\0') : -1;
+
+    return 0;
+}
+
+int select_device_by_serial(struct device_selector* selector, const wchar_t* serial)
+{
+    return select_interface(selector, hid_snapshot_find_serial(serial), false);
+}
+
+int select_device_by_path(struct device_selector* selector, const char* path)
+{
+    return select_interface(selector, hid_snapshot_find_path(path), true);
+}
+
+/**
+ * @brief Returns an open connection to the endpoint a capability needs
+ *
+ * A device - depending on the feature - needs differend Endpoints/Connections
+ * Connections are kept in the connection pool (see hid_utility.h), so every endpoint is only opened once
+ * The manufacturer and product strings are read once by the pool and copied into the device struct
+ *
+ * @param device headsetcontrol struct, containing vendor and productid
+ * @param cap which capability to use, to determine interfaceid and usageids
+ * @return hid_device pointer if successfull, or NULL (error in hid_error)
+ */
+hid_device* dynamic_connect(struct device* device, enum capabilities cap)
+{
+    const struct capability_detail* detail = &device->capability_details[cap];
+
+    struct hid_connection* connection = hid_pool_connect_instance(device, device->idVendor, device->idProduct, device->device_hid_serialnumber, device->device_instance,
+        detail->interface, detail->usagepage, detail->usageid);
+
+    if (connection == NULL) {
+        // The snapshot may be stale (e.g. device re-plugged during --follow), so enumerate again once
+        hid_snapshot_free();
+
+        connection = hid_pool_connect_instance(device, device->idVendor, device->idProduct, device->device_hid_serialnumber, device->device_instance,
+            detail->interface, detail->usagepage, detail->usageid);
+    }
+
+    if (connection == NULL) {
+        return NULL;
+    }
+
+    wcsncpy(device->device_hid_vendorname, connection->vendorname, sizeof(device->device_hid_vendorname) / sizeof(device->device_hid_vendorname[0]));
+    wcsncpy(device->device_hid_productname, connection->productname, sizeof(device->device_hid_productname) / sizeof(device->device_hid_productname[0]));
+
+    return connection->handle;
+}
+
+/// Whether two capabilities are reached through the same HID interface and usage
+static bool same_endpoint(const struct capability_detail* a, const struct capability_detail* b)
+{
+    return a->interface == b->interface && a->usagepage == b->usagepage && a->usageid == b->usageid;
+}
+
+void schedule_feature_requests(const struct device* device_found, const FeatureRequest* featureRequests, int size, int* order)
+{
+    int scheduled = 0;
+    bool done[NUM_CAPABILITIES] = { false };
+
+    assert(size <= NUM_CAPABILITIES);
+
+    for (int i = 0; i < size; i++) {
+        if (done[i])
+            continue;
+
+        // start a group with the first unscheduled request, and pull in all later requests of its endpoint
+        const struct capability_detail* endpoint = &device_found->capability_details[featureRequests[i].cap];
+        for (int j = i; j < size; j++) {
+            if (!done[j] && same_endpoint(endpoint, &device_found->capability_details[featureRequests[j].cap])) {
+                order[scheduled++] = j;
+                done[j]            = true;
+            }
+        }
+    }
+}
+
+void begin_feature_pass(struct device* device_found)
+{
+    hid_status_invalidate(device_found);
+    hid_transaction_begin(device_found);
+#ifdef HSC_NATIVE_HIDRAW
+    hid_batch_begin(device_found->timeout_ms);
+#endif
+    device_found->offline = false;
+}
+
+int end_feature_pass(struct device* device_found)
+{
+    struct device* previous = device_set_current(device_found);
+    int ret                 = hid_transaction_commit(device_found, device_found->commit_settings);
+    device_set_current(previous);
+#ifdef HSC_NATIVE_HIDRAW
+    // e.g. the save command of the transaction
+    if (hid_batch_end() < 0 && ret == 0)
+        ret = -1;
+#endif
+    return ret;
+}
+
+/**
+ * @brief Fills the result of a battery status
+ *
+ * @return false for HID errors, where result.message is left to the caller
+ */
+static bool battery_result(BatteryInfo battery, FeatureResult* result)
+{
+    result->status2    = battery.status;
+    result->message[0] = '\0';
+
+    if (battery.status == BATTERY_AVAILABLE) {
+        result->status = FEATURE_SUCCESS;
+        result->value  = battery.level;
+        snprintf(result->message, sizeof(result->message), "Battery: %d%%", battery.level);
+    } else if (battery.status == BATTERY_CHARGING) {
+        result->status = FEATURE_INFO;
+        result->value  = battery.level;
+        snprintf(result->message, sizeof(result->message), "Charging");
+    } else if (battery.status == BATTERY_UNAVAILABLE) {
+        result->status = FEATURE_INFO;
+        result->value  = BATTERY_UNAVAILABLE;
+        snprintf(result->message, sizeof(result->message), "Battery status unavailable");
+    } else if (battery.status == BATTERY_TIMEOUT) {
+        result->status = FEATURE_ERROR;
+        result->value  = BATTERY_TIMEOUT;
+        snprintf(result->message, sizeof(result->message), "Battery status request timed out");
+    } else {
+        result->status = FEATURE_ERROR;
+        result->value  = (int)battery.status;
+        return false;
+    }
+
+    return true;
+}
+
+static void chatmix_result(int chatmix, FeatureResult* result)
+{
+    result->status2 = 0;
+
+    if (chatmix >= 0) {
+        result->status = FEATURE_SUCCESS;
+        result->value  = chatmix;
+        snprintf(result->message, sizeof(result->message), "Chat-Mix: %d", chatmix);
+    } else {
+        result->status = FEATURE_ERROR;
+        result->value  = chatmix;
+        snprintf(result->message, sizeof(result->message), "Error retrieving chatmix status");
+    }
+}
+
+static FeatureResult run_feature(struct device* device_found, hid_device** device_handle, enum capabilities cap, void* param);
+
+/**
+ * @brief Handle a requested feature
+ *
+ * @param device_found the headset to use
+ * @param device_handle set to the (pooled) handle used for the feature, or to null
+ * @param cap requested feature
+ * @param param first parameter of the feature
+ * @return FeatureResult which saves the result or failure of the requested feature
+ */
+FeatureResult handle_feature(struct device* device_found, hid_device** device_handle, enum capabilities cap, void* param)
+{
+    FeatureResult result;
+
+    // Check if the headset implements the requested feature
+    if ((device_found->capabilities & B(cap)) == 0) {
+        result.status = FEATURE_ERROR;
+        result.value  = -1;
+        snprintf(result.message, sizeof(result.message), "This headset doesn't support %s", capabilities_str[cap]);
+        return result;
+    }
+
+    // Every further status read would only wait for the timeout
+    if (device_found->offline && capabilities_type[cap] == CAPABILITYTYPE_INFO) {
+        result.status  = FEATURE_DEVICE_OFFLINE;
+        result.value   = 0;
+        result.status2 = 0;
+        snprintf(result.message, sizeof(result.message), "Skipped, the headset is offline");
+        return result;
+    }
+
+    if (device_found->idProduct != PRODUCT_TESTDEVICE) {
+        *device_handle = dynamic_connect(device_found, cap);
+
+        if (!device_handle | !(*device_handle)) {
+            result.status = FEATURE_DEVICE_FAILED_OPEN;
+            result.value  = 0;
+            snprintf(result.message, sizeof(result.message), "Could not open device. Error: %ls", hid_error(*device_handle));
+            return result;
+        }
+    } else {
+        *device_handle = NULL;
+    }
+
+    // other processes must not read the replies meant for this one
+    hid_device* exchange_handle = *device_handle;
+    hid_exchange_begin(exchange_handle);
+    struct device* previous = device_set_current(device_found);
+
+    result = run_feature(device_found, device_handle, cap, param);
+
+    device_set_current(previous);
+    hid_exchange_end(exchange_handle);
+    return result;
+}
+
+/// Calls the driver for a feature on an open handle
+static FeatureResult run_feature(struct device* device_found, hid_device** device_handle, enum capabilities cap, void* param)
+{
+    FeatureResult result;
+    int ret;
+
+    switch (cap) {
+    case CAP_SIDETONE:
+        ret = device_found->send_sidetone(*device_handle, (uint8_t) * (int*)param);
+        break;
+
+    case CAP_BATTERY_STATUS: {
+        BatteryInfo battery = device_found->request_battery(*device_handle);
+
+        // the receiver answers for the headset, or nothing answered at all
+        if (battery.status == BATTERY_UNAVAILABLE || battery.status == BATTERY_TIMEOUT)
+            device_found->offline = true;
+
+        if (battery_result(battery, &result))
+            return result;
+
+        // Handle errors
+        if (device_found->idProduct != PRODUCT_TESTDEVICE) {
+            snprintf(result.message, sizeof(result.message), "Error retrieving battery status. Error: %ls", hid_error(*device_handle));
+            // the device may have disappeared, reopen it on the next request
+            hid_pool_drop(*device_handle);
+            *device_handle = NULL;
+        } else // dont call hid_error on test device
+            snprintf(result.message, sizeof(result.message), "Error retrieving battery status");
+
+        return result;
+    }
+
+    case CAP_NOTIFICATION_SOUND:
+        ret = device_found->notifcation_sound(*device_handle, (uint8_t) * (int*)param);
+        break;
+
+    case CAP_LIGHTS:
+        ret = device_found->switch_lights(*device_handle, (uint8_t) * (int*)param);
+        break;
+
+    case CAP_INACTIVE_TIME:
+        ret = device_found->send_inactive_time(*device_handle, (uint8_t) * (int*)param);
+        break;
+
+    case CAP_CHATMIX_STATUS:
+        ret = device_found->request_chatmix(*device_handle);
+        if (ret == HSC_READ_TIMEOUT)
+            device_found->offline = true;
+
+        chatmix_result(ret, &result);
+        return result;
+
+    case CAP_VOICE_PROMPTS:
+        ret = device_found->switch_voice_prompts(*device_handle, (uint8_t) * (int*)param);
+        break;
+
+    case CAP_ROTATE_TO_MUTE:
+        ret = device_found->switch_rotate_to_mute(*device_handle, (uint8_t) * (int*)param);
+        break;
+
+    case CAP_EQUALIZER_PRESET:
+        ret = device_found->send_equalizer_preset(*device_handle, (uint8_t) * (int*)param);
+        break;
+
+    case CAP_EQUALIZER:
+        ret = device_found->send_equalizer(*device_handle, (struct equalizer_settings*)param);
+        break;
+
+    case CAP_MICROPHONE_MUTE_LED_BRIGHTNESS:
+        ret = device_found->send_microphone_mute_led_brightness(*device_handle, (uint8_t) * (int*)param);
+        break;
+
+    case CAP_MICROPHONE_VOLUME:
+        ret = device_found->send_microphone_volume(*device_handle, (uint8_t) * (int*)param);
+        break;
+
+    case CAP_VOLUME_LIMITER:
+        ret = device_found->send_volume_limiter(*device_handle, (uint8_t) * (int*)param);
+        break;
+
+    case CAP_BT_WHEN_POWERED_ON:
+        ret = device_found->send_bluetooth_when_powered_on(*device_handle, (uint8_t) * (int*)param);
+        break;
+
+    case CAP_BT_CALL_VOLUME:
+        ret = device_found->send_bluetooth_call_volume(*device_handle, (uint8_t) * (int*)param);
+        break;
+
+    case NUM_CAPABILITIES:
+    default:
+        ret = -99; // silence warning
+        UNUSED(ret);
+
+        assert(0);
+        break;
+    }
+
+#ifdef HSC_NATIVE_HIDRAW
+    // the writes queued by the driver go out now, a failed one fails this request
+    if (hid_batch_flush() < 0 && ret >= 0)
+        ret = -1;
+#endif
+
+    // Handle success
+    if (ret >= 0) {
+        result.status     = FEATURE_SUCCESS;
+        result.value      = ret;
+        result.message[0] = '\0';
+        return result;
+    }
+
+    result.status = FEATURE_ERROR;
+    result.value  = ret;
+
+    switch (ret) {
+    case HSC_READ_TIMEOUT:
+        snprintf(result.message, sizeof(result.message), "Failed to set/request %s, because of timeout", capabilities_str[cap]);
+        break;
+    case HSC_ERROR:
+        snprintf(result.message, sizeof(result.message), "Failed to set/request %s. HeadsetControl Error", capabilities_str[cap]);
+        break;
+    case HSC_OUT_OF_BOUNDS:
+        snprintf(result.message, sizeof(result.message), "Failed to set/request %s. Provided parameter out of boundaries", capabilities_str[cap]);
+        break;
+    default: // Must be a HID error
+        if (device_found->idProduct != PRODUCT_TESTDEVICE) {
+            snprintf(result.message, sizeof(result.message), "Failed to set/request %s. Error: %d: %ls", capabilities_str[cap], ret, hid_error(*device_handle));
+            // the device may have disappeared, reopen it on the next request
+            hid_pool_drop(*device_handle);
+            *device_handle = NULL;
+        } else // dont call hid_error on test device, it will confuse users/devs because it will show success
+            snprintf(result.message, sizeof(result.message), "Failed to set/request %s. Error: %d", capabilities_str[cap], ret);
+
+        break;
+    }
+
+    return result;
+}
+
+/// Replaces the result of a request when the new one differs, returns whether it changed
+static bool update_result(FeatureRequest* request, FeatureResult* result)
+{
+    FeatureResult* old = &request->result;
+
+    if (old->status == result->status && old->value == result->value && old->status2 == result->status2)
+        return false;
+
+    *old = *result;
+    return true;
+}
+
+int read_input_report(struct device* device_found, FeatureRequest* featureRequests, int size, int timeout_ms)
+{
+    if (device_found->parse_input_report == NULL)
+        return HSC_ERROR;
+
+    // status reports arrive on the endpoint the status is requested on
+    enum capabilities cap = has_capability(device_found->capabilities, CAP_BATTERY_STATUS) ? CAP_BATTERY_STATUS : CAP_CHATMIX_STATUS;
+
+    hid_device* device_handle = dynamic_connect(device_found, cap);
+    if (!device_handle)
+        return -1;
+
+    unsigned char data[INPUT_REPORT_SIZE];
+    int res = hid_read_timeout(device_handle, data, sizeof(data), timeout_ms);
+
+    if (res < 0) {
+        hid_pool_drop(device_handle);
+        return res;
+    }
+
+    if (res == 0)
+        return 0;
+
+    BatteryInfo battery = { .status = BATTERY_UNAVAILABLE, .level = -1 };
+    int chatmix         = -1;
+    int updated         = device_found->parse_input_report(data, res, &battery, &chatmix);
+
+    int changed = 0;
+    for (int i = 0; i < size; i++) {
+        if (!featureRequests[i].should_process || (updated & B(featureRequests[i].cap)) == 0)
+            continue;
+
+        FeatureResult result;
+        if (featureRequests[i].cap == CAP_BATTERY_STATUS) {
+            if (!battery_result(battery, &result))
+                continue;
+        } else if (featureRequests[i].cap == CAP_CHATMIX_STATUS) {
+            chatmix_result(chatmix, &result);
+        } else {
+            continue;
+        }
+
+        if (update_result(&featureRequests[i], &result))
+            changed++;
+    }
+
+    return changed;
+}
+
+int run_feature_pass(struct device* device_found, FeatureRequest* featureRequests, int size, int cache_ttl, int due)
+{
+    // Requests are run grouped by the endpoint they use
+    int order[NUM_CAPABILITIES];
+    schedule_feature_requests(device_found, featureRequests, size, order);
+
+    hid_device* device_handle = NULL;
+
+    // status reports are shared by the requests of one pass,
+    // settings are saved on the headset once at its end
+    begin_feature_pass(device_found);
+
+    for (int n = 0; n < size; n++) {
+        FeatureRequest* request = &featureRequests[order[n]];
+
+        if (request->should_process && !(due & B(request->cap)))
+            continue;
+
+        if (request->should_process) {
+            bool cached = cache_ttl > 0 && capabilities_type[request->cap] == CAPABILITYTYPE_INFO;
+
+            if (!cached || !status_cache_lookup(device_found, request->cap, cache_ttl, &request->result)) {
+                request->result = handle_feature(device_found, &device_handle, request->cap, request->param);
+
+                if (cached)
+                    status_cache_store(device_found, request->cap, &request->result);
+            }
+        } else {
+            // Populate with a default "not processed" result
+            request->result.status = FEATURE_NOT_PROCESSED;
+            request->result.value  = 0;
+            snprintf(request->result.message, sizeof(request->result.message), "Not processed");
+        }
+    }
+
+    return end_feature_pass(device_found);
+}
+
+struct feature_pass_job {
+    struct device* device;
+    FeatureRequest* featureRequests;
+    int size;
+    int cache_ttl;
+    int due;
+    int result;
+};
+
+static void* feature_pass_thread(void* arg)
+{
+    struct feature_pass_job* job = arg;
+    job->result                  = run_feature_pass(job->device, job->featureRequests, job->size, job->cache_ttl, job->due);
+    return NULL;
+}
+
+void run_feature_passes(struct device* devices, FeatureRequest** requests, int num_devices, int size, int cache_ttl, const int* due, int* results)
+{
+    struct feature_pass_job jobs[MAX_HEADSETS];
+    pthread_t threads[MAX_HEADSETS];
+    bool started[MAX_HEADSETS];
+
+    assert(num_devices <= MAX_HEADSETS);
+
+    for (int i = 0; i < num_devices; i++) {
+        jobs[i].device          = &devices[i];
+        jobs[i].featureRequests = requests[i];
+        jobs[i].size            = size;
+        jobs[i].cache_ttl       = cache_ttl;
+        jobs[i].due             = due ? due[i] : ~0;
+
+        // the last headset is handled by the calling thread
+        started[i] = i + 1 < num_devices && pthread_create(&threads[i], NULL, feature_pass_thread, &jobs[i]) == 0;
+        if (!started[i])
+            feature_pass_thread(&jobs[i]);
+    }
+
+    for (int i = 0; i < num_devices; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        results[i] = jobs[i].result;
+    }
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "device.h"
+
+#include <hidapi.h>
+
+/// Largest input report read while waiting for status changes
+#define INPUT_REPORT_SIZE 64
+
+/// Most headsets used at once (--all-devices, --device)
+#define MAX_HEADSETS 32
+
+/**
+ *  @brief Looks for a supported device in the enumeration snapshot
+ *
+ *  @param device_found filled with the device data when a supported device is found
+ *  @param test_device  when set, the built-in test device is used instead
+ *  @return 0 when a supported device is found
+ */
+int find_device(struct device* device_found, int test_device);
+
+/**
+ *  @brief Selects connected headsets by their ids, and optionally their serial number or position
+ */
+struct device_selector {
+    uint16_t idVendor;
+    uint16_t idProduct;
+    /// Empty to select every headset with these ids
+    wchar_t serial[64];
+    /// Position among the headsets of these ids and serial number (see hid_device_instance()), -1 for all
+    int instance;
+};
+
+/**
+ *  @brief Looks for every connected supported headset
+ *
+ *  Several headsets of the same model are told apart by their serial numbers,
+ *  or by their position in the enumeration when they have none (see get_hid_path_instance()).
+ *
+ *  @param devices       filled with the headsets found
+ *  @param max_devices   size of devices
+ *  @param selectors     when num_selectors is not 0, only headsets matching one of them are used
+ *  @param num_selectors size of selectors
+ *  @param test_device   when set, the built-in test device is used instead
+ *  @return number of headsets found
+ */
+int find_devices(struct device* devices, int max_devices, const struct device_selector* selectors, int num_selectors, int test_device);
+
+/**
+ *  @brief Selects the connected headset with this serial number, without enumerating again
+ *
+ *  @return 0 when a supported headset with this serial number is connected
+ */
+int select_device_by_serial(struct device_selector* selector, const wchar_t* serial);
+
+/**
+ *  @brief Selects the connected headset one of whose HID interfaces has this path (e.g. /dev/hidraw3)
+ *
+ *  @return 0 when the path belongs to a supported headset
+ */
+int select_device_by_path(struct device_selector* selector, const char* path);
+
+/**
+ * @brief Returns an open connection to the endpoint a capability needs
+ *
+ * Connections are kept in the connection pool (see hid_utility.h)
+ *
+ * @param device headsetcontrol struct, containing vendor and productid
+ * @param cap which capability to use, to determine interfaceid and usageids
+ * @return hid_device pointer if successfull, or NULL (error in hid_error)
+ */
+hid_device* dynamic_connect(struct device* device, enum capabilities cap);
+
+/**
+ * @brief Orders the feature requests by the endpoint they are sent to
+ *
+ * Requests using the same interface / usage page / usage id (see capability_details)
+ * are grouped, so that each endpoint is opened and used in one go. Within a group,
+ * and between groups (by their first request), the original order is kept.
+ * Results still go to featureRequests, so output order doesn't change.
+ *
+ * @param device_found the headset the requests are for
+ * @param featureRequests requests to schedule
+ * @param size size of featureRequests and order
+ * @param order filled with the indices of featureRequests in execution order
+ */
+void schedule_feature_requests(const struct device* device_found, const FeatureRequest* featureRequests, int size, int* order);
+
+/**
+ * @brief Starts a pass over the requested features of a headset
+ *
+ * Forgets cached status reports and the offline state of the headset,
+ * and starts a settings transaction (see hid_transaction_begin()). With the
+ * native hidraw backend, the writes of a request are queued until it is done,
+ * together with those of the other headsets (see hid_batch_begin()).
+ */
+void begin_feature_pass(struct device* device_found);
+
+/**
+ * @brief Ends a pass, saving the settings applied during it
+ *
+ * @return 0 on success, < 0 when saving the settings or a batched write failed
+ */
+int end_feature_pass(struct device* device_found);
+
+/**
+ * @brief Runs one pass over the requested features of a headset
+ *
+ * The requests to process are run grouped by endpoint (see schedule_feature_requests())
+ * between begin_feature_pass() and end_feature_pass(), the others get FEATURE_NOT_PROCESSED.
+ *
+ * @param cache_ttl status results younger than this many milliseconds are shared
+ *                  with other invocations (see status_cache.h), 0 to always read them
+ * @param due       capabilities (see B()) to run, requests of other capabilities keep their results
+ * @return the result of end_feature_pass()
+ */
+int run_feature_pass(struct device* device_found, FeatureRequest* featureRequests, int size, int cache_ttl, int due);
+
+/**
+ * @brief Runs run_feature_pass() for several headsets at once, one thread per headset
+ *
+ * @param requests the requests of every headset, size each
+ * @param due      capabilities to run for every headset, NULL for all
+ * @param results  filled with the result of run_feature_pass() of every headset
+ */
+void run_feature_passes(struct device* devices, FeatureRequest** requests, int num_devices, int size, int cache_ttl, const int* due, int* results);
+
+/**
+ * @brief Handle a requested feature
+ *
+ * Once a status read finds the headset offline (battery unavailable or a
+ * read timeout), the remaining status reads of the pass are skipped with
+ * FEATURE_DEVICE_OFFLINE.
+ *
+ * @param device_found the headset to use
+ * @param device_handle set to the (pooled) handle used for the feature, or to null
+ * @param cap requested feature
+ * @param param first parameter of the feature
+ * @return FeatureResult which saves the result or failure of the requested feature
+ */
+FeatureResult handle_feature(struct device* device_found, hid_device** device_handle, enum capabilities cap, void* param);
+
+/**
+ * @brief Waits for an input report the device sends on its own
+ *
+ * The report is parsed by the parse_input_report hook of the device, and the
+ * results of the status requests it covers are replaced when they changed.
+ *
+ * @param device_found the headset to use, must implement parse_input_report
+ * @param featureRequests requests of the current invocation, only those with should_process are updated
+ * @param size size of featureRequests
+ * @param timeout_ms how long to wait for a report
+ * @return number of results that changed, 0 on timeout or unrelated reports, < 0 on HID errors
+ */
+int read_input_report(struct device* device_found, FeatureRequest* featureRequests, int size, int timeout_ms);
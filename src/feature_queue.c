@@ -0,0 +1,416 @@
+#include "feature_queue.h"
+
+#include "feature.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <unistd.h>
+#elif !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+struct feature_job {
+    struct feature_job* next;
+    struct feature_completion completion;
+    int64_t deadline_ms;
+    /// the copied param of the request
+    int value;
+    struct equalizer_settings equalizer;
+};
+
+/// Runs the requests of one headset
+struct feature_worker {
+    feature_queue* queue;
+    struct device* device;
+    pthread_t thread;
+    pthread_cond_t wake;
+    /// requests waiting to start, oldest first
+    struct feature_job* first;
+    struct feature_job* last;
+};
+
+struct feature_queue {
+    pthread_mutex_t lock;
+    /// signalled for every completion
+    pthread_cond_t completed;
+    struct feature_worker workers[MAX_HEADSETS];
+    int num_workers;
+    /// finished requests, oldest first
+    struct feature_job* first;
+    struct feature_job* last;
+    uint64_t last_id;
+    bool closing;
+    int read_fd;
+    int write_fd;
+};
+
+static int64_t monotonic_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void free_job(struct feature_job* job)
+{
+    free(job->equalizer.bands_values);
+    free(job);
+}
+
+/// Makes the fd readable, when the first completion is added
+static void fd_set_ready(feature_queue* queue)
+{
+#ifdef __linux__
+    uint64_t one = 1;
+    ssize_t res  = write(queue->write_fd, &one, sizeof(one));
+    (void)res;
+#elif !defined(_WIN32)
+    char byte   = 0;
+    ssize_t res = write(queue->write_fd, &byte, sizeof(byte));
+    (void)res;
+#endif
+}
+
+/// Makes the fd unreadable again, when the last completion was collected
+static void fd_clear_ready(feature_queue* queue)
+{
+#ifdef __linux__
+    uint64_t count;
+    ssize_t res = read(queue->read_fd, &count, sizeof(count));
+    (void)res;
+#elif !defined(_WIN32)
+    char byte;
+    ssize_t res = read(queue->read_fd, &byte, sizeof(byte));
+    (void)res;
+#endif
+}
+
+/// Called with the lock held
+static void add_completion(feature_queue* queue, struct feature_job* job)
+{
+    job->next = NULL;
+
+    if (queue->last) {
+        queue->last->next = job;
+    } else {
+        queue->first = job;
+        fd_set_ready(queue);
+    }
+    queue->last = job;
+
+    pthread_cond_broadcast(&queue->completed);
+}
+
+static void run_job(struct device* device, struct feature_job* job)
+{
+    FeatureRequest* request = &job->completion.request;
+    int64_t left            = job->deadline_ms - monotonic_ms();
+
+    if (left <= 0) {
+        request->result.status  = FEATURE_ERROR;
+        request->result.value   = request->cap == CAP_BATTERY_STATUS ? BATTERY_TIMEOUT : -1;
+        request->result.status2 = 0;
+        snprintf(request->result.message, sizeof(request->result.message), "Timed out waiting for the previous requests of the headset");
+        return;
+    }
+
+    device->timeout_ms          = (int)left;
+    job->completion.pass_result = run_feature_pass(device, request, 1, 0, ~0);
+}
+
+static void* worker_thread(void* arg)
+{
+    struct feature_worker* worker = arg;
+    feature_queue* queue          = worker->queue;
+
+    pthread_mutex_lock(&queue->lock);
+
+    for (;;) {
+        while (!worker->first && !queue->closing)
+            pthread_cond_wait(&worker->wake, &queue->lock);
+
+        // the waiting requests were dropped by feature_queue_close()
+        struct feature_job* job = worker->first;
+        if (!job)
+            break;
+
+        worker->first = job->next;
+        if (!worker->first)
+            worker->last = NULL;
+
+        pthread_mutex_unlock(&queue->lock);
+        run_job(worker->device, job);
+        pthread_mutex_lock(&queue->lock);
+
+        add_completion(queue, job);
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+    return NULL;
+}
+
+/// Returns the worker of a headset, started on first use. Called with the lock held
+static struct feature_worker* worker_of(feature_queue* queue, struct device* device)
+{
+    for (int i = 0; i < queue->num_workers; i++) {
+        if (queue->workers[i].device == device)
+            return &queue->workers[i];
+    }
+
+    if (queue->num_workers == MAX_HEADSETS)
+        return NULL;
+
+    struct feature_worker* worker = &queue->workers[queue->num_workers];
+    worker->queue                 = queue;
+    worker->device                = device;
+    worker->first                 = NULL;
+    worker->last                  = NULL;
+
+    pthread_cond_init(&worker->wake, NULL);
+    if (pthread_create(&worker->thread, NULL, worker_thread, worker) != 0) {
+        pthread_cond_destroy(&worker->wake);
+        return NULL;
+    }
+
+    queue->num_workers++;
+    return worker;
+}
+
+feature_queue* feature_queue_open()
+{
+    feature_queue* queue = calloc(1, sizeof(feature_queue));
+    if (!queue)
+        return NULL;
+
+#ifdef __linux__
+    queue->read_fd  = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    queue->write_fd = queue->read_fd;
+    if (queue->read_fd < 0) {
+        free(queue);
+        return NULL;
+    }
+#elif !defined(_WIN32)
+    int fds[2];
+    if (pipe(fds) != 0) {
+        free(queue);
+        return NULL;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    queue->read_fd  = fds[0];
+    queue->write_fd = fds[1];
+#else
+    queue->read_fd  = -1;
+    queue->write_fd = -1;
+#endif
+
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->completed, NULL);
+
+    return queue;
+}
+
+int feature_queue_fd(feature_queue* queue)
+{
+    return queue->read_fd;
+}
+
+uint64_t feature_queue_submit(feature_queue* queue, struct device* device, const FeatureRequest* request, int timeout_ms, void* user_data)
+{
+    struct feature_job* job = calloc(1, sizeof(struct feature_job));
+    if (!job)
+        return 0;
+
+    job->completion.device    = device;
+    job->completion.request   = *request;
+    job->completion.user_data = user_data;
+    job->deadline_ms          = monotonic_ms() + timeout_ms;
+
+    if (request->cap == CAP_EQUALIZER) {
+        const struct equalizer_settings* settings = request->param;
+
+        job->equalizer.size         = settings->size;
+        job->equalizer.bands_values = calloc(settings->size > 0 ? settings->size : 1, sizeof(float));
+        if (!job->equalizer.bands_values) {
+            free(job);
+            return 0;
+        }
+        if (settings->size > 0)
+            memcpy(job->equalizer.bands_values, settings->bands_values, settings->size * sizeof(float));
+
+        job->completion.request.param = &job->equalizer;
+    } else {
+        job->value                    = request->param ? *(const int*)request->param : 0;
+        job->completion.request.param = &job->value;
+    }
+
+    pthread_mutex_lock(&queue->lock);
+
+    struct feature_worker* worker = queue->closing ? NULL : worker_of(queue, device);
+    if (!worker) {
+        pthread_mutex_unlock(&queue->lock);
+        free_job(job);
+        return 0;
+    }
+
+    uint64_t id        = ++queue->last_id;
+    job->completion.id = id;
+
+    if (worker->last)
+        worker->last->next = job;
+    else
+        worker->first = job;
+    worker->last = job;
+
+    pthread_cond_signal(&worker->wake);
+    pthread_mutex_unlock(&queue->lock);
+
+    return id;
+}
+
+int feature_queue_cancel(feature_queue* queue, uint64_t id)
+{
+    pthread_mutex_lock(&queue->lock);
+
+    for (int i = 0; i < queue->num_workers; i++) {
+        struct feature_worker* worker = &queue->workers[i];
+        struct feature_job* previous  = NULL;
+
+        for (struct feature_job* job = worker->first; job; previous = job, job = job->next) {
+            if (job->completion.id != id)
+                continue;
+
+            if (previous)
+                previous->next = job->next;
+            else
+                worker->first = job->next;
+            if (worker->last == job)
+                worker->last = previous;
+
+            FeatureResult* result = &job->completion.request.result;
+            result->status        = FEATURE_NOT_PROCESSED;
+            result->value         = 0;
+            snprintf(result->message, sizeof(result->message), "Cancelled");
+
+            add_completion(queue, job);
+            pthread_mutex_unlock(&queue->lock);
+            return 0;
+        }
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+    return -1;
+}
+
+int feature_queue_complete(feature_queue* queue, struct feature_completion* completions, int max)
+{
+    int n = 0;
+
+    pthread_mutex_lock(&queue->lock);
+
+    while (n < max && queue->first) {
+        struct feature_job* job = queue->first;
+        queue->first            = job->next;
+
+        completions[n]               = job->completion;
+        completions[n].request.param = NULL;
+        n++;
+
+        free_job(job);
+    }
+
+    if (!queue->first) {
+        queue->last = NULL;
+        if (n > 0)
+            fd_clear_ready(queue);
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+    return n;
+}
+
+int feature_queue_wait(feature_queue* queue, int timeout_ms)
+{
+    pthread_mutex_lock(&queue->lock);
+
+    if (timeout_ms < 0) {
+        while (!queue->first)
+            pthread_cond_wait(&queue->completed, &queue->lock);
+    } else {
+        // pthread_cond_timedwait() takes a CLOCK_REALTIME deadline
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        while (!queue->first) {
+            if (pthread_cond_timedwait(&queue->completed, &queue->lock, &deadline) != 0)
+                break;
+        }
+    }
+
+    int ready = queue->first != NULL;
+    pthread_mutex_unlock(&queue->lock);
+
+    return ready;
+}
+
+void feature_queue_close(feature_queue* queue)
+{
+    if (!queue)
+        return;
+
+    pthread_mutex_lock(&queue->lock);
+    queue->closing = true;
+
+    for (int i = 0; i < queue->num_workers; i++) {
+        struct feature_worker* worker = &queue->workers[i];
+
+        while (worker->first) {
+            struct feature_job* job = worker->first;
+            worker->first           = job->next;
+            free_job(job);
+        }
+        worker->last = NULL;
+
+        pthread_cond_signal(&worker->wake);
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+
+    // running requests finish within their timeout
+    for (int i = 0; i < queue->num_workers; i++) {
+        pthread_join(queue->workers[i].thread, NULL);
+        pthread_cond_destroy(&queue->workers[i].wake);
+    }
+
+    while (queue->first) {
+        struct feature_job* job = queue->first;
+        queue->first            = job->next;
+        free_job(job);
+    }
+
+#ifdef __linux__
+    close(queue->read_fd);
+#elif !defined(_WIN32)
+    close(queue->read_fd);
+    close(queue->write_fd);
+#endif
+
+    pthread_cond_destroy(&queue->completed);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue);
+}
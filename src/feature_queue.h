@@ -0,0 +1,90 @@
+#pragma once
+
+#include "device.h"
+
+#include <stdint.h>
+
+/**
+ * Runs feature requests in the background, so that programs with an event loop
+ * (e.g. tray applications) never wait for a slow wireless headset.
+ *
+ * The requests of a headset run one after the other on a thread of that
+ * headset, different headsets run at once. Finished requests are collected with
+ * feature_queue_complete(). feature_queue_fd() is readable while some are
+ * waiting to be collected, for the poll() / select() of the caller.
+ *
+ * The headsets given to feature_queue_submit() must not be used elsewhere
+ * until feature_queue_close().
+ */
+
+typedef struct feature_queue feature_queue;
+
+struct feature_completion {
+    /// As returned by feature_queue_submit()
+    uint64_t id;
+    struct device* device;
+    /// The submitted request with its result, its param is no longer valid
+    FeatureRequest request;
+    /// What run_feature_pass() returned, < 0 when saving the settings failed
+    int pass_result;
+    void* user_data;
+};
+
+/**
+ * @brief Creates a queue, its threads are started by the first request of every headset
+ *
+ * @return the queue, NULL when out of memory or out of file descriptors
+ */
+feature_queue* feature_queue_open();
+
+/**
+ * @brief Returns a file descriptor which is readable while completions are waiting
+ *
+ * An eventfd on Linux, a pipe on other POSIX systems. It is only read by the
+ * queue. -1 on Windows, use feature_queue_wait() there.
+ */
+int feature_queue_fd(feature_queue* queue);
+
+/**
+ * @brief Queues a request, which runs once the previous requests of the headset are done
+ *
+ * The param of the request is copied (an int, or the equalizer settings with
+ * their bands for CAP_EQUALIZER).
+ *
+ * @param timeout_ms the request completes within about this time: it fails
+ *                   without touching the headset when it waits longer to start,
+ *                   and the reads of its driver get the time left
+ * @param user_data  given back with the completion
+ * @return id of the request (never 0), 0 when out of memory or the queue is closing
+ */
+uint64_t feature_queue_submit(feature_queue* queue, struct device* device, const FeatureRequest* request, int timeout_ms, void* user_data);
+
+/**
+ * @brief Cancels a request which didn't start yet
+ *
+ * It completes with FEATURE_NOT_PROCESSED. Running requests can't be
+ * interrupted, they complete within their timeout.
+ *
+ * @return 0 when the request was cancelled, -1 when it started or is unknown
+ */
+int feature_queue_cancel(feature_queue* queue, uint64_t id);
+
+/**
+ * @brief Collects finished requests, without waiting
+ *
+ * @return number of completions written, in the order the requests finished
+ */
+int feature_queue_complete(feature_queue* queue, struct feature_completion* completions, int max);
+
+/**
+ * @brief Waits until a completion is waiting to be collected
+ *
+ * @param timeout_ms -1 to wait without limit
+ * @return 1 when one is waiting, 0 after timeout_ms
+ */
+int feature_queue_wait(feature_queue* queue, int timeout_ms);
+
+/**
+ * @brief Drops the requests which didn't start, waits for the running ones and frees the queue
+ */
+void feature_queue_close(feature_queue* queue);
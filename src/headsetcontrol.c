@@ -0,0 +1,275 @@
+#include "headsetcontrol.h"
+
+#include "device.h"
+#include "device_registry.h"
+#include "feature.h"
+#include "feature_queue.h"
+#include "hid_utility.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the values of headsetcontrol.h are those of device.h
+#define SAME_VALUE(public, internal) typedef char same_value_##public[(int)(public) == (int)(internal) ? 1 : -1]
+
+SAME_VALUE(HSC_CAP_SIDETONE, CAP_SIDETONE);
+SAME_VALUE(HSC_CAP_BATTERY_STATUS, CAP_BATTERY_STATUS);
+SAME_VALUE(HSC_CAP_NOTIFICATION_SOUND, CAP_NOTIFICATION_SOUND);
+SAME_VALUE(HSC_CAP_LIGHTS, CAP_LIGHTS);
+SAME_VALUE(HSC_CAP_INACTIVE_TIME, CAP_INACTIVE_TIME);
+SAME_VALUE(HSC_CAP_CHATMIX_STATUS, CAP_CHATMIX_STATUS);
+SAME_VALUE(HSC_CAP_VOICE_PROMPTS, CAP_VOICE_PROMPTS);
+SAME_VALUE(HSC_CAP_ROTATE_TO_MUTE, CAP_ROTATE_TO_MUTE);
+SAME_VALUE(HSC_CAP_EQUALIZER_PRESET, CAP_EQUALIZER_PRESET);
+SAME_VALUE(HSC_CAP_EQUALIZER, CAP_EQUALIZER);
+SAME_VALUE(HSC_CAP_MICROPHONE_MUTE_LED_BRIGHTNESS, CAP_MICROPHONE_MUTE_LED_BRIGHTNESS);
+SAME_VALUE(HSC_CAP_MICROPHONE_VOLUME, CAP_MICROPHONE_VOLUME);
+SAME_VALUE(HSC_CAP_VOLUME_LIMITER, CAP_VOLUME_LIMITER);
+SAME_VALUE(HSC_CAP_BT_WHEN_POWERED_ON, CAP_BT_WHEN_POWERED_ON);
+SAME_VALUE(HSC_CAP_BT_CALL_VOLUME, CAP_BT_CALL_VOLUME);
+SAME_VALUE(HSC_NUM_CAPABILITIES, NUM_CAPABILITIES);
+
+SAME_VALUE(HSC_STATUS_SUCCESS, FEATURE_SUCCESS);
+SAME_VALUE(HSC_STATUS_ERROR, FEATURE_ERROR);
+SAME_VALUE(HSC_STATUS_DEVICE_FAILED_OPEN, FEATURE_DEVICE_FAILED_OPEN);
+SAME_VALUE(HSC_STATUS_INFO, FEATURE_INFO);
+SAME_VALUE(HSC_STATUS_NOT_PROCESSED, FEATURE_NOT_PROCESSED);
+SAME_VALUE(HSC_STATUS_DEVICE_OFFLINE, FEATURE_DEVICE_OFFLINE);
+
+SAME_VALUE(HSC_BATTERY_UNAVAILABLE, BATTERY_UNAVAILABLE);
+SAME_VALUE(HSC_BATTERY_CHARGING, BATTERY_CHARGING);
+SAME_VALUE(HSC_BATTERY_AVAILABLE, BATTERY_AVAILABLE);
+SAME_VALUE(HSC_BATTERY_HIDERROR, BATTERY_HIDERROR);
+SAME_VALUE(HSC_BATTERY_TIMEOUT, BATTERY_TIMEOUT);
+
+SAME_VALUE(HSC_MESSAGE_SIZE, FEATURE_MESSAGE_SIZE);
+
+struct hsc_context {
+    int flags;
+    int timeout_ms;
+    struct device devices[MAX_HEADSETS];
+    int num_devices;
+};
+
+/// The HID connections are shared by the contexts, and closed with the last one
+static int open_contexts = 0;
+
+hsc_context* hsc_open(int flags)
+{
+    hsc_context* ctx = calloc(1, sizeof(hsc_context));
+    if (!ctx)
+        return NULL;
+
+    ctx->flags      = flags;
+    ctx->timeout_ms = 5000;
+
+    init_devices();
+    __atomic_add_fetch(&open_contexts, 1, __ATOMIC_RELAXED);
+
+    return ctx;
+}
+
+void hsc_close(hsc_context* ctx)
+{
+    if (!ctx)
+        return;
+
+    free(ctx);
+
+    if (__atomic_sub_fetch(&open_contexts, 1, __ATOMIC_RELAXED) == 0)
+        terminate_hid(NULL, NULL);
+}
+
+int hsc_enumerate(hsc_context* ctx)
+{
+    // connections to and the snapshot of removed headsets are stale
+    hid_pool_close_all();
+    hid_snapshot_free();
+
+    ctx->num_devices = find_devices(ctx->devices, MAX_HEADSETS, NULL, 0, ctx->flags & HSC_OPEN_TEST_DEVICE);
+    return ctx->num_devices;
+}
+
+int hsc_device_info(hsc_context* ctx, int index, struct hsc_device_info* info)
+{
+    if (index < 0 || index >= ctx->num_devices)
+        return -1;
+
+    const struct device* device = &ctx->devices[index];
+
+    info->id_vendor     = device->idVendor;
+    info->id_product    = device->idProduct;
+    info->name          = device->device_name;
+    info->serial_number = device->device_hid_serialnumber;
+    info->capabilities  = (uint32_t)device->capabilities;
+
+    return 0;
+}
+
+void hsc_set_timeout(hsc_context* ctx, int timeout_ms)
+{
+    ctx->timeout_ms = timeout_ms;
+}
+
+static int fail(struct hsc_result* result, const char* message)
+{
+    memset(result, 0, sizeof(*result));
+    result->status = HSC_STATUS_ERROR;
+    snprintf(result->message, sizeof(result->message), "%s", message);
+
+    return -1;
+}
+
+/// Fills result from a request run by run_feature_pass(), which returned pass_result
+static int to_result(const FeatureRequest* request, int pass_result, struct hsc_result* result)
+{
+    if (pass_result < 0 && request->result.status == FEATURE_SUCCESS)
+        return fail(result, "Failed to save the settings of the headset");
+
+    result->status  = request->result.status;
+    result->value   = request->result.value;
+    result->status2 = request->result.status2;
+    snprintf(result->message, sizeof(result->message), "%s", request->result.message);
+
+    return request->result.status == FEATURE_SUCCESS || request->result.status == FEATURE_INFO ? 0 : -1;
+}
+
+/// Runs a single request in a pass of its own, see run_feature_pass()
+static int run_request(hsc_context* ctx, int index, enum hsc_capability cap, void* param, struct hsc_result* result)
+{
+    struct device* device = &ctx->devices[index];
+
+    FeatureRequest request = { (enum capabilities)cap, capabilities_type[cap], param, true, {} };
+
+    device->timeout_ms = ctx->timeout_ms;
+    int res            = run_feature_pass(device, &request, 1, 0, ~0);
+
+    return to_result(&request, res, result);
+}
+
+int hsc_query(hsc_context* ctx, int index, enum hsc_capability cap, struct hsc_result* result)
+{
+    if (index < 0 || index >= ctx->num_devices)
+        return fail(result, "No such headset");
+    if ((int)cap < 0 || cap >= HSC_NUM_CAPABILITIES || capabilities_type[cap] != CAPABILITYTYPE_INFO)
+        return fail(result, "Not a status");
+
+    int request = 1;
+    return run_request(ctx, index, cap, &request, result);
+}
+
+int hsc_apply(hsc_context* ctx, int index, enum hsc_capability cap, int value, struct hsc_result* result)
+{
+    if (index < 0 || index >= ctx->num_devices)
+        return fail(result, "No such headset");
+    if ((int)cap < 0 || cap >= HSC_NUM_CAPABILITIES || capabilities_type[cap] != CAPABILITYTYPE_ACTION || cap == HSC_CAP_EQUALIZER)
+        return fail(result, "Not a setting");
+
+    return run_request(ctx, index, cap, &value, result);
+}
+
+int hsc_apply_equalizer(hsc_context* ctx, int index, const float* bands, int bands_count, struct hsc_result* result)
+{
+    if (index < 0 || index >= ctx->num_devices)
+        return fail(result, "No such headset");
+
+    struct equalizer_settings settings = { bands_count, (float*)bands };
+    return run_request(ctx, index, HSC_CAP_EQUALIZER, &settings, result);
+}
+
+const char* hsc_capability_name(enum hsc_capability cap)
+{
+    if ((int)cap < 0 || cap >= HSC_NUM_CAPABILITIES)
+        return NULL;
+
+    return capabilities_str[cap];
+}
+
+struct hsc_queue {
+    hsc_context* ctx;
+    feature_queue* requests;
+};
+
+hsc_queue* hsc_queue_open(hsc_context* ctx)
+{
+    hsc_queue* queue = calloc(1, sizeof(hsc_queue));
+    if (!queue)
+        return NULL;
+
+    queue->ctx      = ctx;
+    queue->requests = feature_queue_open();
+    if (!queue->requests) {
+        free(queue);
+        return NULL;
+    }
+
+    return queue;
+}
+
+void hsc_queue_close(hsc_queue* queue)
+{
+    if (!queue)
+        return;
+
+    feature_queue_close(queue->requests);
+    free(queue);
+}
+
+int hsc_queue_fd(hsc_queue* queue)
+{
+    return feature_queue_fd(queue->requests);
+}
+
+uint64_t hsc_submit(hsc_queue* queue, const struct hsc_request* request)
+{
+    hsc_context* ctx        = queue->ctx;
+    enum hsc_capability cap = request->cap;
+
+    if (request->index < 0 || request->index >= ctx->num_devices || (int)cap < 0 || cap >= HSC_NUM_CAPABILITIES)
+        return 0;
+    if (cap == HSC_CAP_EQUALIZER && (!request->bands || request->bands_count <= 0))
+        return 0;
+
+    // both are copied by feature_queue_submit()
+    int value                          = request->value;
+    struct equalizer_settings settings = { request->bands_count, (float*)request->bands };
+    void* param                        = cap == HSC_CAP_EQUALIZER ? (void*)&settings : (void*)&value;
+
+    FeatureRequest feature = { (enum capabilities)cap, capabilities_type[cap], param, true, {} };
+    int timeout_ms         = request->timeout_ms > 0 ? request->timeout_ms : ctx->timeout_ms;
+
+    return feature_queue_submit(queue->requests, &ctx->devices[request->index], &feature, timeout_ms, request->user_data);
+}
+
+int hsc_cancel(hsc_queue* queue, uint64_t id)
+{
+    return feature_queue_cancel(queue->requests, id);
+}
+
+int hsc_completions(hsc_queue* queue, struct hsc_completion* completions, int max)
+{
+    struct feature_completion done[16];
+    int n = 0;
+
+    while (n < max) {
+        int count = feature_queue_complete(queue->requests, done, max - n < 16 ? max - n : 16);
+        if (count == 0)
+            break;
+
+        for (int i = 0; i < count; i++, n++) {
+            completions[n].id        = done[i].id;
+            completions[n].index     = (int)(done[i].device - queue->ctx->devices);
+            completions[n].cap       = (enum hsc_capability)done[i].request.cap;
+            completions[n].user_data = done[i].user_data;
+            to_result(&done[i].request, done[i].pass_result, &completions[n].result);
+        }
+    }
+
+    return n;
+}
+
+int hsc_queue_wait(hsc_queue* queue, int timeout_ms)
+{
+    return feature_queue_wait(queue->requests, timeout_ms);
+}
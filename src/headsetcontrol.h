@@ -0,0 +1,280 @@
+#pragma once
+
+#include <stdint.h>
+#include <wchar.h>
+
+/**
+ * libheadsetcontrol, HeadsetControl as a C library.
+ *
+ * A context enumerates the connected headsets and keeps their connections open
+ * between calls, so that programs (e.g. tray applications) query a status or
+ * apply a setting without starting headsetcontrol and parsing its output.
+ *
+ *     hsc_context* ctx = hsc_open(0);
+ *     struct hsc_result result;
+ *
+ *     if (ctx && hsc_enumerate(ctx) > 0 && hsc_query(ctx, 0, HSC_CAP_BATTERY_STATUS, &result) == 0)
+ *         printf("%d%%\n", result.value);
+ *     hsc_close(ctx);
+ *
+ * This header doesn't depend on hidapi or the other headers of HeadsetControl.
+ * Its values only change together with HSC_API_VERSION.
+ *
+ * A context must not be used by several threads at once. Separate contexts may
+ * be used by separate threads, as long as each headset is only used by one of
+ * them at a time: contexts finding the same headset share its HID connection,
+ * and the requests of two threads would mix their reports on it.
+ * hsc_enumerate(), and hsc_close() of the last context, close the HID
+ * connections shared by all contexts, so they must not run while other threads
+ * use a context.
+ *
+ * The calls above wait for the headset, up to the timeout of the context. A
+ * queue (see hsc_queue_open()) runs the requests in the background instead.
+ */
+
+#define HSC_API_VERSION 2
+
+/// Marks the functions exported by the shared library, everything else stays hidden
+#if defined(_WIN32)
+#ifdef HSC_BUILDING_SHARED
+#define HSC_EXPORT __declspec(dllexport)
+#else
+#define HSC_EXPORT
+#endif
+#elif defined(__GNUC__)
+#define HSC_EXPORT __attribute__((visibility("default")))
+#else
+#define HSC_EXPORT
+#endif
+
+/// Longest message of a result, including the terminating null
+#define HSC_MESSAGE_SIZE 256
+
+/// Use the built-in test device instead of the connected headsets
+#define HSC_OPEN_TEST_DEVICE 0x1
+
+/// Convert a capability to its bit in hsc_device_info.capabilities
+#define HSC_CAP_BIT(cap) (1u << (cap))
+
+/// Same values as enum capabilities
+enum hsc_capability {
+    HSC_CAP_SIDETONE = 0,
+    HSC_CAP_BATTERY_STATUS,
+    HSC_CAP_NOTIFICATION_SOUND,
+    HSC_CAP_LIGHTS,
+    HSC_CAP_INACTIVE_TIME,
+    HSC_CAP_CHATMIX_STATUS,
+    HSC_CAP_VOICE_PROMPTS,
+    HSC_CAP_ROTATE_TO_MUTE,
+    HSC_CAP_EQUALIZER_PRESET,
+    HSC_CAP_EQUALIZER,
+    HSC_CAP_MICROPHONE_MUTE_LED_BRIGHTNESS,
+    HSC_CAP_MICROPHONE_VOLUME,
+    HSC_CAP_VOLUME_LIMITER,
+    HSC_CAP_BT_WHEN_POWERED_ON,
+    HSC_CAP_BT_CALL_VOLUME,
+    HSC_NUM_CAPABILITIES
+};
+
+/// Same values as FeatureStatus
+enum hsc_status {
+    HSC_STATUS_SUCCESS,
+    HSC_STATUS_ERROR,
+    HSC_STATUS_DEVICE_FAILED_OPEN,
+    /// informational states, e.g. the battery charging
+    HSC_STATUS_INFO,
+    HSC_STATUS_NOT_PROCESSED,
+    HSC_STATUS_DEVICE_OFFLINE
+};
+
+/// Same values as enum battery_status, in hsc_result.status2 of HSC_CAP_BATTERY_STATUS
+enum hsc_battery_status {
+    HSC_BATTERY_UNAVAILABLE,
+    HSC_BATTERY_CHARGING,
+    HSC_BATTERY_AVAILABLE,
+    HSC_BATTERY_HIDERROR,
+    HSC_BATTERY_TIMEOUT
+};
+
+typedef struct hsc_context hsc_context;
+
+struct hsc_device_info {
+    uint16_t id_vendor;
+    uint16_t id_product;
+    /// Name of the model, valid until the next hsc_enumerate() or hsc_close()
+    const char* name;
+    /// Empty when the headset has none, valid like name
+    const wchar_t* serial_number;
+    /// HSC_CAP_BIT() of every capability the headset supports
+    uint32_t capabilities;
+};
+
+struct hsc_result {
+    /// enum hsc_status
+    int status;
+    /// e.g. the battery level, or an error code
+    int value;
+    /// depends on the capability, e.g. enum hsc_battery_status
+    int status2;
+    /// error message, or e.g. "Charging". Empty when there is none
+    char message[HSC_MESSAGE_SIZE];
+};
+
+/**
+ * @brief Opens a context, the headsets are enumerated by hsc_enumerate()
+ *
+ * @param flags HSC_OPEN_TEST_DEVICE or 0
+ * @return the context, NULL when out of memory
+ */
+HSC_EXPORT hsc_context* hsc_open(int flags);
+
+/**
+ * @brief Frees the context
+ *
+ * The HID connections are shared by all contexts, they are closed by
+ * hsc_close() of the last open context.
+ */
+HSC_EXPORT void hsc_close(hsc_context* ctx);
+
+/**
+ * @brief Looks for the connected supported headsets, again on every call
+ *
+ * @return number of headsets found, which are indexed from 0
+ */
+HSC_EXPORT int hsc_enumerate(hsc_context* ctx);
+
+/**
+ * @brief Describes a headset found by hsc_enumerate()
+ *
+ * @return 0, or -1 when there is no headset at index
+ */
+HSC_EXPORT int hsc_device_info(hsc_context* ctx, int index, struct hsc_device_info* info);
+
+/**
+ * @brief Sets the read timeout of the following calls (default 5000 ms)
+ */
+HSC_EXPORT void hsc_set_timeout(hsc_context* ctx, int timeout_ms);
+
+/**
+ * @brief Reads a status, e.g. HSC_CAP_BATTERY_STATUS
+ *
+ * @param result filled with the value or the error
+ * @return 0 when the status was read (HSC_STATUS_SUCCESS or HSC_STATUS_INFO), -1 otherwise
+ */
+HSC_EXPORT int hsc_query(hsc_context* ctx, int index, enum hsc_capability cap, struct hsc_result* result);
+
+/**
+ * @brief Applies a setting, e.g. HSC_CAP_SIDETONE
+ *
+ * Use hsc_apply_equalizer() for HSC_CAP_EQUALIZER.
+ *
+ * @param result filled with the outcome
+ * @return 0 when the setting was applied, -1 otherwise
+ */
+HSC_EXPORT int hsc_apply(hsc_context* ctx, int index, enum hsc_capability cap, int value, struct hsc_result* result);
+
+/**
+ * @brief Applies the values of every equalizer band
+ *
+ * @return 0 when the equalizer was applied, -1 otherwise
+ */
+HSC_EXPORT int hsc_apply_equalizer(hsc_context* ctx, int index, const float* bands, int bands_count, struct hsc_result* result);
+
+/**
+ * @brief Returns the long name of a capability, e.g. "battery", or NULL
+ */
+HSC_EXPORT const char* hsc_capability_name(enum hsc_capability cap);
+
+/**
+ * Asynchronous requests, for event loops which must never wait for a headset.
+ *
+ *     hsc_queue* queue           = hsc_queue_open(ctx);
+ *     struct hsc_request request = { .index = 0, .cap = HSC_CAP_BATTERY_STATUS, .timeout_ms = 1000 };
+ *     hsc_submit(queue, &request);
+ *
+ *     // once hsc_queue_fd(queue) is readable
+ *     struct hsc_completion completions[8];
+ *     int n = hsc_completions(queue, completions, 8);
+ *
+ * The requests of a headset run one after the other, different headsets run at
+ * once. While a queue is open, the headsets of its context are only used
+ * through the queue, and hsc_enumerate() must not be called.
+ */
+typedef struct hsc_queue hsc_queue;
+
+struct hsc_request {
+    /// The headset, see hsc_enumerate()
+    int index;
+    enum hsc_capability cap;
+    /// Value of a setting
+    int value;
+    /// Values of every band for HSC_CAP_EQUALIZER, copied by hsc_submit()
+    const float* bands;
+    int bands_count;
+    /// The request completes within about this time, 0 for the timeout of the context
+    int timeout_ms;
+    /// Given back with the completion
+    void* user_data;
+};
+
+struct hsc_completion {
+    /// As returned by hsc_submit()
+    uint64_t id;
+    int index;
+    enum hsc_capability cap;
+    void* user_data;
+    /// Like the result of hsc_query() / hsc_apply(), HSC_STATUS_NOT_PROCESSED when cancelled
+    struct hsc_result result;
+};
+
+/**
+ * @brief Opens a queue for the headsets of a context
+ *
+ * @return the queue, NULL when out of memory or file descriptors
+ */
+HSC_EXPORT hsc_queue* hsc_queue_open(hsc_context* ctx);
+
+/**
+ * @brief Drops the requests which didn't start, waits for the running ones and frees the queue
+ */
+HSC_EXPORT void hsc_queue_close(hsc_queue* queue);
+
+/**
+ * @brief Returns a file descriptor which is readable while completions are waiting
+ *
+ * For poll() / select() or the event loop of a toolkit, it must not be read.
+ * -1 on Windows, use hsc_queue_wait() there.
+ */
+HSC_EXPORT int hsc_queue_fd(hsc_queue* queue);
+
+/**
+ * @brief Queues a request, without waiting for the headset
+ *
+ * A request which can't start within its timeout, because the headset is
+ * still busy with the previous ones, fails without being sent.
+ *
+ * @return id of the request, 0 when the request is invalid (no completion follows)
+ */
+HSC_EXPORT uint64_t hsc_submit(hsc_queue* queue, const struct hsc_request* request);
+
+/**
+ * @brief Cancels a request which didn't start yet, it completes with HSC_STATUS_NOT_PROCESSED
+ *
+ * @return 0 when cancelled, -1 when it already started or completed
+ */
+HSC_EXPORT int hsc_cancel(hsc_queue* queue, uint64_t id);
+
+/**
+ * @brief Collects finished requests, without waiting
+ *
+ * @return number of completions written, at most max
+ */
+HSC_EXPORT int hsc_completions(hsc_queue* queue, struct hsc_completion* completions, int max);
+
+/**
+ * @brief Waits for a completion, for programs without an event loop
+ *
+ * @param timeout_ms -1 to wait without limit
+ * @return 1 when a completion is waiting, 0 after timeout_ms
+ */
+HSC_EXPORT int hsc_queue_wait(hsc_queue* queue, int timeout_ms);
@@ -1,14 +1,246 @@
 #include "hid_utility.h"
 
+#include "exchange_lock.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <wchar.h>
+
+/**
+ * One entry of the snapshot index, sorted by vendor id, product id and the
+ * position in which hidapi enumerated the device (so "first enumerated" keeps
+ * its meaning)
+ */
+struct snapshot_entry {
+    uint16_t vid;
+    uint16_t pid;
+    int seq;
+    struct hid_device_info* info;
+};
+
+static struct {
+    bool valid;
+    struct hid_device_info* devs;
+    struct snapshot_entry* index;
+    int count;
+    /// Open addressing hash tables of table_mask + 1 slots, by serial number and by path
+    struct hid_device_info** by_serial;
+    struct hid_device_info** by_path;
+    unsigned table_mask;
+} snapshot = { false, NULL, NULL, 0, NULL, NULL, 0 };
+
+/// Protects the snapshot, the connection pool and the transactions
+static pthread_mutex_t hid_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int snapshot_entry_compare(const void* a, const void* b)
+{
+    const struct snapshot_entry* ea = a;
+    const struct snapshot_entry* eb = b;
+
+    if (ea->vid != eb->vid)
+        return ea->vid < eb->vid ? -1 : 1;
+    if (ea->pid != eb->pid)
+        return ea->pid < eb->pid ? -1 : 1;
+    return ea->seq - eb->seq;
+}
+
+// FNV-1a
+static unsigned hash_serial(const wchar_t* serial)
+{
+    unsigned hash = 2166136261u;
+    for (; *serial; serial++)
+        hash = (hash ^ (unsigned)*serial) * 16777619u;
+    return hash;
+}
+
+static unsigned hash_path(const char* path)
+{
+    unsigned hash = 2166136261u;
+    for (; *path; path++)
+        hash = (hash ^ (unsigned char)*path) * 16777619u;
+    return hash;
+}
+
+/// Fills the hash tables, the first enumerated interface is kept for a serial number
+static void snapshot_build_tables()
+{
+    unsigned slots = 16;
+    while (slots < 2 * (unsigned)snapshot.count)
+        slots *= 2;
+
+    snapshot.by_serial = calloc(slots, sizeof(struct hid_device_info*));
+    snapshot.by_path   = calloc(slots, sizeof(struct hid_device_info*));
+    if (!snapshot.by_serial || !snapshot.by_path) {
+        fprintf(stderr, "Unable to allocate HID snapshot index.\n");
+        free(snapshot.by_serial);
+        free(snapshot.by_path);
+        snapshot.by_serial = NULL;
+        snapshot.by_path   = NULL;
+        return;
+    }
+    snapshot.table_mask = slots - 1;
+
+    for (struct hid_device_info* cur_dev = snapshot.devs; cur_dev; cur_dev = cur_dev->next) {
+        if (cur_dev->serial_number && cur_dev->serial_number[0] != L'\0') {
+            unsigned slot = hash_serial(cur_dev->serial_number) & snapshot.table_mask;
+            while (snapshot.by_serial[slot] && wcscmp(snapshot.by_serial[slot]->serial_number, cur_dev->serial_number) != 0)
+                slot = (slot + 1) & snapshot.table_mask;
+            if (!snapshot.by_serial[slot])
+                snapshot.by_serial[slot] = cur_dev;
+        }
+
+        if (cur_dev->path) {
+            unsigned slot = hash_path(cur_dev->path) & snapshot.table_mask;
+            while (snapshot.by_path[slot] && strcmp(snapshot.by_path[slot]->path, cur_dev->path) != 0)
+                slot = (slot + 1) & snapshot.table_mask;
+            if (!snapshot.by_path[slot])
+                snapshot.by_path[slot] = cur_dev;
+        }
+    }
+}
+
+static void snapshot_build()
+{
+    snapshot.devs  = hid_enumerate(0x0, 0x0);
+    snapshot.valid = true;
+    snapshot.count = 0;
+
+    for (struct hid_device_info* cur_dev = snapshot.devs; cur_dev; cur_dev = cur_dev->next)
+        snapshot.count++;
+
+    if (snapshot.count == 0)
+        return;
+
+    snapshot.index = malloc(snapshot.count * sizeof(struct snapshot_entry));
+    if (!snapshot.index) {
+        fprintf(stderr, "Unable to allocate HID snapshot index.\n");
+        snapshot.count = 0;
+        return;
+    }
+
+    int i = 0;
+    for (struct hid_device_info* cur_dev = snapshot.devs; cur_dev; cur_dev = cur_dev->next, i++) {
+        snapshot.index[i].vid  = cur_dev->vendor_id;
+        snapshot.index[i].pid  = cur_dev->product_id;
+        snapshot.index[i].seq  = i;
+        snapshot.index[i].info = cur_dev;
+    }
+
+    qsort(snapshot.index, snapshot.count, sizeof(struct snapshot_entry), snapshot_entry_compare);
+
+    snapshot_build_tables();
+}
+
+struct hid_device_info* hid_snapshot_devices()
+{
+    pthread_mutex_lock(&hid_mutex);
+    if (!snapshot.valid)
+        snapshot_build();
+    pthread_mutex_unlock(&hid_mutex);
+
+    return snapshot.devs;
+}
+
+static void snapshot_free()
+{
+    if (snapshot.devs)
+        hid_free_enumeration(snapshot.devs);
+
+    free(snapshot.index);
+    free(snapshot.by_serial);
+    free(snapshot.by_path);
+
+    snapshot.devs      = NULL;
+    snapshot.index     = NULL;
+    snapshot.by_serial = NULL;
+    snapshot.by_path   = NULL;
+    snapshot.count     = 0;
+    snapshot.valid     = false;
+}
+
+void hid_snapshot_free()
+{
+    pthread_mutex_lock(&hid_mutex);
+    snapshot_free();
+    pthread_mutex_unlock(&hid_mutex);
+}
+
+struct hid_device_info* hid_snapshot_find_serial(const wchar_t* serial)
+{
+    struct hid_device_info* found = NULL;
+
+    pthread_mutex_lock(&hid_mutex);
+    if (!snapshot.valid)
+        snapshot_build();
+
+    if (snapshot.by_serial && serial[0] != L'\0') {
+        unsigned slot = hash_serial(serial) & snapshot.table_mask;
+        while (snapshot.by_serial[slot] && wcscmp(snapshot.by_serial[slot]->serial_number, serial) != 0)
+            slot = (slot + 1) & snapshot.table_mask;
+        found = snapshot.by_serial[slot];
+    }
+    pthread_mutex_unlock(&hid_mutex);
+
+    return found;
+}
+
+struct hid_device_info* hid_snapshot_find_path(const char* path)
+{
+    struct hid_device_info* found = NULL;
+
+    pthread_mutex_lock(&hid_mutex);
+    if (!snapshot.valid)
+        snapshot_build();
+
+    if (snapshot.by_path) {
+        unsigned slot = hash_path(path) & snapshot.table_mask;
+        while (snapshot.by_path[slot] && strcmp(snapshot.by_path[slot]->path, path) != 0)
+            slot = (slot + 1) & snapshot.table_mask;
+        found = snapshot.by_path[slot];
+    }
+    pthread_mutex_unlock(&hid_mutex);
+
+    return found;
+}
+
+/**
+ * @brief Finds the range of snapshot entries matching vid and pid
+ *
+ * @param first index of the first matching entry
+ * @return amount of matching entries
+ */
+static int snapshot_find(uint16_t vid, uint16_t pid, int* first)
+{
+    if (!snapshot.valid)
+        snapshot_build();
+
+    // lower bound binary search
+    int low = 0, high = snapshot.count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (snapshot.index[mid].vid < vid || (snapshot.index[mid].vid == vid && snapshot.index[mid].pid < pid))
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    int last = low;
+    while (last < snapshot.count && snapshot.index[last].vid == vid && snapshot.index[last].pid == pid)
+        last++;
+
+    *first = low;
+    return last - low;
+}
 
 /**
  *  @brief Helper fetching a copied HID path for a given device description.
  *
- *  This is a convenience function iterating over connected USB devices and
- *  returning a copy of the HID path belonging to the device described in the
- *  parameters.
+ *  This is a convenience function looking up the connected USB devices in the
+ *  enumeration snapshot and returning a copy of the HID path belonging to the
+ *  device described in the parameters.
  *
  *  @param vid The device vendor ID.
  *  @param pid The device product ID.
@@ -23,15 +255,75 @@
  */
 char* get_hid_path(uint16_t vid, uint16_t pid, int iid, uint16_t usagepageid, uint16_t usageid)
 {
-    char* ret = NULL;
+    return get_hid_path_instance(vid, pid, NULL, 0, iid, usagepageid, usageid);
+}
+
+static bool same_serial(const struct hid_device_info* a, const struct hid_device_info* b)
+{
+    const wchar_t* serial_a = a->serial_number ? a->serial_number : L"";
+    const wchar_t* serial_b = b->serial_number ? b->serial_number : L"";
+    return wcscmp(serial_a, serial_b) == 0;
+}
 
-    struct hid_device_info* devs = hid_enumerate(vid, pid);
+/**
+ * Whether two entries are the same HID collection of headsets of one model.
+ * Windows, and hidapi 0.13 and later, list every top level collection of an
+ * interface as its own entry, each headset has one entry per collection.
+ */
+static bool same_collection(const struct hid_device_info* a, const struct hid_device_info* b)
+{
+    return a->interface_number == b->interface_number && a->usage_page == b->usage_page && a->usage == b->usage;
+}
+
+int hid_device_instance(const struct hid_device_info* devs, const struct hid_device_info* dev, bool serial)
+{
+    int instance = 0;
+
+    for (const struct hid_device_info* cur_dev = devs; cur_dev && cur_dev != dev; cur_dev = cur_dev->next) {
+        if (cur_dev->vendor_id == dev->vendor_id && cur_dev->product_id == dev->product_id
+            && same_collection(cur_dev, dev) && (!serial || same_serial(cur_dev, dev)))
+            instance++;
+    }
+
+    return instance;
+}
+
+/// Whether a snapshot entry belongs to the wanted device, see get_hid_path_instance()
+static bool entry_matches(struct snapshot_entry* entries, int i, const wchar_t* serial, int instance)
+{
+    const struct hid_device_info* dev = entries[i].info;
+
+    if (serial) {
+        if (wcscmp(dev->serial_number ? dev->serial_number : L"", serial) != 0)
+            return false;
+    }
+
+    // entries of the same ids are in enumeration order, the n-th entry of a collection belongs to the n-th headset
+    int n = 0;
+    for (int j = 0; j < i; j++) {
+        if (same_collection(entries[j].info, dev) && (!serial || same_serial(entries[j].info, dev)))
+            n++;
+    }
+
+    return n == instance;
+}
+
+/// Finds the path in the snapshot, which stays valid while hid_mutex is held
+static const char* snapshot_path(uint16_t vid, uint16_t pid, const wchar_t* serial, int instance, int iid, uint16_t usagepageid, uint16_t usageid)
+{
+    if (serial && serial[0] == L'\0')
+        serial = NULL;
 
-    if (!devs) {
+    int first;
+    int count = snapshot_find(vid, pid, &first);
+
+    if (!count) {
         fprintf(stderr, "HID enumeration failure.\n");
-        return ret;
+        return NULL;
     }
 
+    struct snapshot_entry* entries = &snapshot.index[first];
+
     // Because of a MacOS Bug beginning with Ventura 13.3, we ignore the interfaceid
     //   See https://github.com/Sapd/HeadsetControl/issues/281
 #ifdef __APPLE__
@@ -45,22 +337,10 @@ char* get_hid_path(uint16_t vid, uint16_t pid, int iid, uint16_t usagepageid, ui
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32)
     if (usageid && usagepageid) // ignore when one of them 0
     {
-        struct hid_device_info* cur_dev = devs;
-        while (cur_dev) {
-            if (cur_dev->usage_page == usagepageid && cur_dev->usage == usageid) {
-                ret = strdup(cur_dev->path);
-
-                if (!ret) {
-                    fprintf(stderr, "Unable to copy HID path for usageid.\n");
-                    hid_free_enumeration(devs);
-                    devs = NULL;
-                    return ret;
-                }
-
-                break;
-            }
-
-            cur_dev = cur_dev->next;
+        for (int i = 0; i < count; i++) {
+            struct hid_device_info* cur_dev = entries[i].info;
+            if (cur_dev->usage_page == usagepageid && cur_dev->usage == usageid && entry_matches(entries, i, serial, instance))
+                return cur_dev->path;
         }
     }
 #else
@@ -69,35 +349,293 @@ char* get_hid_path(uint16_t vid, uint16_t pid, int iid, uint16_t usagepageid, ui
     (void)(usagepageid);
 #endif
 
-    if (ret == NULL) // only when we didn't yet found something
-    {
-        struct hid_device_info* cur_dev = devs;
-        while (cur_dev) {
-            if (!iid || cur_dev->interface_number == iid) {
-                ret = strdup(cur_dev->path);
-
-                if (!ret) {
-                    fprintf(stderr, "Unable to copy HID path.\n");
-                    hid_free_enumeration(devs);
-                    devs = NULL;
-                    return ret;
-                }
-
-                break;
-            }
+    for (int i = 0; i < count; i++) {
+        struct hid_device_info* cur_dev = entries[i].info;
+        if ((!iid || cur_dev->interface_number == iid) && entry_matches(entries, i, serial, instance))
+            return cur_dev->path;
+    }
+
+    return NULL;
+}
+
+char* get_hid_path_instance(uint16_t vid, uint16_t pid, const wchar_t* serial, int instance, int iid, uint16_t usagepageid, uint16_t usageid)
+{
+    char* ret = NULL;
+
+    pthread_mutex_lock(&hid_mutex);
+
+    const char* path = snapshot_path(vid, pid, serial, instance, iid, usagepageid, usageid);
+    if (path) {
+        ret = strdup(path);
+        if (!ret)
+            fprintf(stderr, "Unable to copy HID path.\n");
+    }
+
+    pthread_mutex_unlock(&hid_mutex);
+    return ret;
+}
+
+// Pointer to an array of pointers to connections, so that handed out connections stay valid when the pool grows
+static struct hid_connection** connections = NULL;
+static int num_connections                 = 0;
+// Number of hid_open_path() calls of the pool
+static int num_opens = 0;
+
+/**
+ * Returns the connection of path, opening it on first use.
+ *
+ * The owner is the struct device that connected last: after a watch re-enumeration a
+ * different struct device may reuse the path, and hid_status_invalidate() and the
+ * transactions must match that one. A headset is used by one context at a time,
+ * so there is a single owner per path.
+ */
+static struct hid_connection* pool_open(const char* path, const void* owner)
+{
+    for (int i = 0; i < num_connections; i++) {
+        if (strcmp(connections[i]->path, path) == 0) {
+            connections[i]->owner = owner;
+            return connections[i];
+        }
+    }
+
+    struct hid_connection** temp = realloc(connections, (num_connections + 1) * sizeof(struct hid_connection*));
+    if (!temp) {
+        fprintf(stderr, "Failed to allocate memory for connection pool.\n");
+        return NULL;
+    }
+    connections = temp;
+
+    struct hid_connection* connection = calloc(1, sizeof(struct hid_connection));
+    if (!connection) {
+        fprintf(stderr, "Failed to allocate memory for connection pool.\n");
+        return NULL;
+    }
+
+    connection->path = strdup(path);
+    if (!connection->path) {
+        fprintf(stderr, "Unable to copy HID path.\n");
+        free(connection);
+        return NULL;
+    }
+
+    connection->handle = hid_open_path(path);
+    num_opens++;
+    if (!connection->handle) {
+        free(connection->path);
+        free(connection);
+        return NULL;
+    }
+
+    connection->lock  = exchange_lock_open(path);
+    connection->owner = owner;
+
+    hid_get_manufacturer_string(connection->handle, connection->vendorname, sizeof(connection->vendorname) / sizeof(connection->vendorname[0]));
+    hid_get_product_string(connection->handle, connection->productname, sizeof(connection->productname) / sizeof(connection->productname[0]));
+
+    connections[num_connections++] = connection;
+    return connection;
+}
+
+struct hid_connection* hid_pool_connect_instance(const void* owner, uint16_t vid, uint16_t pid, const wchar_t* serial, int instance, int iid, uint16_t usagepageid, uint16_t usageid)
+{
+    struct hid_connection* connection = NULL;
+
+    pthread_mutex_lock(&hid_mutex);
+    const char* path = snapshot_path(vid, pid, serial, instance, iid, usagepageid, usageid);
+    if (path)
+        connection = pool_open(path, owner);
+    pthread_mutex_unlock(&hid_mutex);
+
+    return connection;
+}
+
+int hid_pool_opens()
+{
+    pthread_mutex_lock(&hid_mutex);
+    int opens = num_opens;
+    pthread_mutex_unlock(&hid_mutex);
+
+    return opens;
+}
+
+static void connection_free(struct hid_connection* connection)
+{
+    exchange_lock_close(connection->lock);
+    hid_close(connection->handle);
+    free(connection->path);
+    free(connection);
+}
+
+void hid_pool_drop(hid_device* handle)
+{
+    pthread_mutex_lock(&hid_mutex);
+    for (int i = 0; i < num_connections; i++) {
+        if (connections[i]->handle == handle) {
+            connection_free(connections[i]);
+
+            // keep the array dense
+            connections[i] = connections[num_connections - 1];
+            num_connections--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&hid_mutex);
+}
+
+void hid_pool_close_all()
+{
+    pthread_mutex_lock(&hid_mutex);
+    for (int i = 0; i < num_connections; i++) {
+        connection_free(connections[i]);
+    }
+
+    free(connections);
+    connections     = NULL;
+    num_connections = 0;
+    pthread_mutex_unlock(&hid_mutex);
+}
+
+/// The connection stays valid outside the lock, only the thread of its headset drops it
+static struct hid_connection* pool_find(hid_device* handle)
+{
+    struct hid_connection* connection = NULL;
+
+    pthread_mutex_lock(&hid_mutex);
+    for (int i = 0; i < num_connections; i++) {
+        if (connections[i]->handle == handle) {
+            connection = connections[i];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&hid_mutex);
+
+    return connection;
+}
+
+void hid_exchange_begin(hid_device* handle)
+{
+    struct hid_connection* connection = pool_find(handle);
+    if (connection)
+        exchange_lock_acquire(connection->lock);
+}
+
+void hid_exchange_end(hid_device* handle)
+{
+    struct hid_connection* connection = pool_find(handle);
+    if (connection)
+        exchange_lock_release(connection->lock);
+}
+
+int hid_read_status_cached(hid_device* handle, int (*read_status)(hid_device*, unsigned char*), unsigned char* data_read, int size)
+{
+    assert(size <= HID_STATUS_CACHE_SIZE);
+
+    struct hid_connection* connection = pool_find(handle);
+    if (!connection)
+        return read_status(handle, data_read);
+
+    if (connection->status_size == 0) {
+        int res = read_status(handle, connection->status);
+        if (res <= 0)
+            return res;
+
+        connection->status_size = res;
+    }
+
+    int res = connection->status_size < size ? connection->status_size : size;
+    memcpy(data_read, connection->status, res);
+    return res;
+}
+
+void hid_status_invalidate(const void* owner)
+{
+    pthread_mutex_lock(&hid_mutex);
+    for (int i = 0; i < num_connections; i++) {
+        if (connections[i]->owner == owner)
+            connections[i]->status_size = 0;
+    }
+    pthread_mutex_unlock(&hid_mutex);
+}
+
+/// Most connections (interfaces) of one headset saved by a commit, more than headsets have
+#define HID_MAX_OWNER_CONNECTIONS 32
+
+/// Headsets with an active settings transaction
+static const void* transaction_owners[HID_MAX_TRANSACTIONS];
+static int num_transactions = 0;
+
+static int transaction_find(const void* owner)
+{
+    for (int i = 0; i < num_transactions; i++) {
+        if (transaction_owners[i] == owner)
+            return i;
+    }
+
+    return -1;
+}
+
+void hid_transaction_begin(const void* owner)
+{
+    pthread_mutex_lock(&hid_mutex);
+    if (transaction_find(owner) < 0 && num_transactions < HID_MAX_TRANSACTIONS)
+        transaction_owners[num_transactions++] = owner;
+    pthread_mutex_unlock(&hid_mutex);
+}
 
-            cur_dev = cur_dev->next;
+bool hid_transaction_defer_save(hid_device* handle)
+{
+    bool deferred = false;
+
+    pthread_mutex_lock(&hid_mutex);
+    for (int i = 0; i < num_connections; i++) {
+        if (connections[i]->handle == handle) {
+            if (transaction_find(connections[i]->owner) >= 0) {
+                connections[i]->save_pending = true;
+                deferred                     = true;
+            }
+            break;
         }
     }
+    pthread_mutex_unlock(&hid_mutex);
+
+    return deferred;
+}
+
+int hid_transaction_commit(const void* owner, int (*save)(hid_device*))
+{
+    int num_pending = 0;
 
-    hid_free_enumeration(devs);
-    devs = NULL;
+    // end the transaction first, so that save() really writes
+    pthread_mutex_lock(&hid_mutex);
+    int index = transaction_find(owner);
+    if (index >= 0)
+        transaction_owners[index] = transaction_owners[--num_transactions];
+
+    // save() is called without holding the lock; further connections stay pending for the next commit
+    hid_device* pending[HID_MAX_OWNER_CONNECTIONS];
+    for (int i = 0; i < num_connections && num_pending < HID_MAX_OWNER_CONNECTIONS; i++) {
+        if (connections[i]->owner != owner || !connections[i]->save_pending)
+            continue;
+
+        connections[i]->save_pending = false;
+        pending[num_pending++]       = connections[i]->handle;
+    }
+    pthread_mutex_unlock(&hid_mutex);
+
+    int ret = 0;
+    for (int i = 0; i < num_pending && save != NULL; i++) {
+        int res = save(pending[i]);
+        if (res < 0 && ret == 0)
+            ret = res;
+    }
 
     return ret;
 }
 
 /**
  *  Helper freeing HID data and terminating HID usage.
+ *
+ *  Also closes all pooled connections and releases the enumeration snapshot.
  */
 /* This function is explicitly called terminate_hid to avoid HIDAPI clashes. */
 void terminate_hid(hid_device** handle, char** path)
@@ -114,5 +652,7 @@ void terminate_hid(hid_device** handle, char** path)
         free(*path);
     }
 
+    hid_pool_close_all();
+    hid_snapshot_free();
     hid_exit();
 }
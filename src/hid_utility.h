@@ -3,14 +3,53 @@
 #include <hidapi.h>
 
 #include <inttypes.h>
+#include <stdbool.h>
 #include <stdlib.h>
 
+/**
+ *  The snapshot, the connection pool and the transactions below may be used
+ *  by one thread per headset at the same time.
+ */
+
+/**
+ *  @brief Returns the enumeration snapshot of all connected HID devices
+ *
+ *  The whole bus is enumerated once, on first use. All later lookups,
+ *  including get_hid_path(), are answered from this snapshot until
+ *  hid_snapshot_free() or terminate_hid() is called.
+ *  The list must not be used while other threads may free the snapshot.
+ *
+ *  @return head of the enumerated device list (owned by the snapshot) or NULL
+ */
+struct hid_device_info* hid_snapshot_devices();
+
+/**
+ *  @brief Releases the enumeration snapshot
+ *
+ *  The next lookup enumerates the bus again, e.g. after a device was re-plugged.
+ */
+void hid_snapshot_free();
+
+/**
+ *  @brief Finds an interface of the snapshot by its serial number, in constant time
+ *
+ *  @return the first enumerated interface with this serial number (owned by the snapshot) or NULL
+ */
+struct hid_device_info* hid_snapshot_find_serial(const wchar_t* serial);
+
+/**
+ *  @brief Finds an interface of the snapshot by its path, in constant time
+ *
+ *  @return the interface (owned by the snapshot) or NULL
+ */
+struct hid_device_info* hid_snapshot_find_path(const char* path);
+
 /**
  *  @brief Helper fetching a copied HID path for a given device description.
  *
- *  This is a convenience function iterating over connected USB devices and
- *  returning a copy of the HID path belonging to the device described in the
- *  parameters.
+ *  This is a convenience function looking up the connected USB devices in the
+ *  enumeration snapshot and returning a copy of the HID path belonging to the
+ *  device described in the parameters.
  *
  *  @param vid The device vendor ID.
  *  @param pid The device product ID.
@@ -25,8 +64,153 @@
  */
 char* get_hid_path(uint16_t vid, uint16_t pid, int iid, uint16_t usagepageid, uint16_t usageid);
 
+/**
+ *  @brief Like get_hid_path(), for one of several connected devices with the same ids
+ *
+ *  The n-th enumerated entry of a HID collection (interface number, usage page and
+ *  usage) is taken to belong to the n-th device. Interfaces with several collections
+ *  are listed once per collection by Windows and hidapi 0.13 and later.
+ *
+ *  @param serial   only consider interfaces with this serial number, NULL or empty for all
+ *  @param instance which of the matching devices, in enumeration order
+ */
+char* get_hid_path_instance(uint16_t vid, uint16_t pid, const wchar_t* serial, int instance, int iid, uint16_t usagepageid, uint16_t usageid);
+
+/**
+ *  @brief Returns which of the devices with the same ids (and serial number) an enumerated interface belongs to
+ *
+ *  See get_hid_path_instance()
+ *
+ *  @param devs     the enumerated list containing dev
+ *  @param dev      the interface
+ *  @param serial   whether only devices with the serial number of dev are counted
+ */
+int hid_device_instance(const struct hid_device_info* devs, const struct hid_device_info* dev, bool serial);
+
+/// Largest status report kept by hid_read_status_cached()
+#define HID_STATUS_CACHE_SIZE 128
+
+/**
+ *  @brief An open connection, kept by the connection pool
+ */
+struct hid_connection {
+    /// HID path the connection was opened with
+    char* path;
+    hid_device* handle;
+    /// Manufacturer and product strings, read once when the connection is opened
+    wchar_t vendorname[64];
+    wchar_t productname[64];
+    /// Last status report, see hid_read_status_cached(); status_size 0 when none is cached
+    unsigned char status[HID_STATUS_CACHE_SIZE];
+    int status_size;
+    /// A save command was deferred by the current settings transaction
+    bool save_pending;
+    /// Serializes exchanges with other processes, see exchange_lock.h; NULL when unavailable
+    struct exchange_lock* lock;
+    /// The headset (struct device) that connected last
+    const void* owner;
+};
+
+/**
+ *  @brief Returns the pooled connection for the path of get_hid_path_instance(), opening it on first use
+ *
+ *  Every distinct path is opened at most once and stays open until
+ *  hid_pool_close_all() or terminate_hid() is called. Doesn't copy the path,
+ *  so reusing an open connection allocates nothing.
+ *
+ *  @param owner the headset using the connection, it becomes the owner also of an open one,
+ *               see hid_transaction_begin()
+ *
+ *  @return connection owned by the pool or NULL when the device couldn't be opened
+ */
+struct hid_connection* hid_pool_connect_instance(const void* owner, uint16_t vid, uint16_t pid, const wchar_t* serial, int instance, int iid, uint16_t usagepageid, uint16_t usageid);
+
+/**
+ *  @brief Returns how many times the pool opened a device, for statistics
+ */
+int hid_pool_opens();
+
+/**
+ *  @brief Closes and forgets the pooled connection of the given handle
+ *
+ *  Used when a device disappeared, so that the next hid_pool_connect_instance() opens it again.
+ */
+void hid_pool_drop(hid_device* handle);
+
+/**
+ *  @brief Closes all pooled connections
+ */
+void hid_pool_close_all();
+
+/**
+ *  @brief Starts an exchange (writes and the reads of their replies) on a pooled connection
+ *
+ *  Waits until other HeadsetControl processes finished their exchanges with the same device.
+ *  Does nothing for handles not owned by the pool.
+ */
+void hid_exchange_begin(hid_device* handle);
+
+/**
+ *  @brief Ends the exchange started with hid_exchange_begin()
+ */
+void hid_exchange_end(hid_device* handle);
+
+/**
+ *  @brief Reads a status report at most once per pass over the requested features
+ *
+ *  Several INFO capabilities (battery, chatmix, ...) are often decoded from the
+ *  same status report. The first call reads it with read_status and keeps it
+ *  with the pooled connection; later calls for the same connection copy it,
+ *  until hid_status_invalidate() is called. Only successful reads are kept.
+ *  Handles not owned by the pool are always read.
+ *
+ *  @param handle       handle of a pooled connection
+ *  @param read_status  the driver function sending the status request and reading the reply
+ *  @param data_read    buffer for the report, of at most HID_STATUS_CACHE_SIZE bytes
+ *  @param size         size of data_read
+ *
+ *  @return the result of read_status (number of bytes read or error)
+ */
+int hid_read_status_cached(hid_device* handle, int (*read_status)(hid_device*, unsigned char*), unsigned char* data_read, int size);
+
+/**
+ *  @brief Forgets the cached status reports of a headset, so the next pass reads them again
+ */
+void hid_status_invalidate(const void* owner);
+
+/// Most settings transactions active at the same time
+#define HID_MAX_TRANSACTIONS 64
+
+/**
+ *  @brief Starts a settings transaction for the connections of a headset
+ *
+ *  Until hid_transaction_commit(), drivers skip the save command they
+ *  normally send after every setting, see hid_transaction_defer_save().
+ */
+void hid_transaction_begin(const void* owner);
+
+/**
+ *  @brief Called by drivers before sending a save command
+ *
+ *  @return true when a transaction is active and the save was queued for
+ *          the pooled connection of handle; the driver must not send it then
+ */
+bool hid_transaction_defer_save(hid_device* handle);
+
+/**
+ *  @brief Ends the settings transaction of a headset, sending one save per connection that queued one
+ *
+ *  @param owner the headset given to hid_transaction_begin()
+ *  @param save the save command of the device, may be NULL when it has none
+ *
+ *  @return 0 on success or the first error returned by save
+ */
+int hid_transaction_commit(const void* owner, int (*save)(hid_device*));
+
 /**
  *  Helper freeing HID data and terminating HID usage.
+ *
+ *  Also closes all pooled connections and releases the enumeration snapshot.
  */
 /* This function is explicitly called terminate_hid to avoid HIDAPI clashes. */
 void terminate_hid(hid_device** handle, char** path);
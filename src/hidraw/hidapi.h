@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stddef.h>
+#include <wchar.h>
+
+/**
+ * Native Linux backend (HSC_NATIVE_HIDRAW), implementing the subset of the hidapi
+ * interface used by HeadsetControl directly on top of hidraw.
+ *
+ * Enumeration reads /sys/class/hidraw instead of going through libudev, devices are
+ * the /dev/hidrawN nodes and feature reports use the HIDIOCSFEATURE/HIDIOCGFEATURE
+ * ioctls. Semantics (report ids, return values, timeouts) follow hidapi's hidraw backend.
+ */
+
+typedef struct hid_device_ hid_device;
+
+struct hid_device_info {
+    /// /dev/hidrawN
+    char* path;
+    unsigned short vendor_id;
+    unsigned short product_id;
+    wchar_t* serial_number;
+    unsigned short release_number;
+    wchar_t* manufacturer_string;
+    wchar_t* product_string;
+    /// First usage page and usage of the report descriptor
+    unsigned short usage_page;
+    unsigned short usage;
+    /// USB interface number, -1 for other buses
+    int interface_number;
+    struct hid_device_info* next;
+};
+
+int hid_init(void);
+int hid_exit(void);
+
+struct hid_device_info* hid_enumerate(unsigned short vendor_id, unsigned short product_id);
+void hid_free_enumeration(struct hid_device_info* devs);
+
+hid_device* hid_open_path(const char* path);
+void hid_close(hid_device* dev);
+
+int hid_write(hid_device* dev, const unsigned char* data, size_t length);
+int hid_read_timeout(hid_device* dev, unsigned char* data, size_t length, int milliseconds);
+int hid_read(hid_device* dev, unsigned char* data, size_t length);
+int hid_set_nonblocking(hid_device* dev, int nonblock);
+
+int hid_send_feature_report(hid_device* dev, const unsigned char* data, size_t length);
+int hid_get_feature_report(hid_device* dev, unsigned char* data, size_t length);
+
+int hid_get_manufacturer_string(hid_device* dev, wchar_t* string, size_t maxlen);
+int hid_get_product_string(hid_device* dev, wchar_t* string, size_t maxlen);
+int hid_get_serial_number_string(hid_device* dev, wchar_t* string, size_t maxlen);
+
+const wchar_t* hid_error(hid_device* dev);
+
+/*
+ * HeadsetControl extension: batched writes
+ */
+
+/**
+ * @brief Queues the following hid_write() calls of this thread instead of sending them
+ *
+ * The writes of all threads (one per headset) are queued together and submitted
+ * through one io_uring when a thread needs its own writes out: on
+ * hid_batch_flush(), a read or feature report call, hid_close() or
+ * hid_batch_end(). That thread submits the writes every thread queued so far,
+ * those of different devices in parallel, those of one device in order.
+ * hid_write() reports success immediately, a failed write is reported by the
+ * call which sent it. Without io_uring (Linux older than 5.6, or disabled)
+ * writes are sent right away.
+ *
+ * @param timeout_ms time limit of every write, 0 for none
+ */
+void hid_batch_begin(int timeout_ms);
+
+/**
+ * @brief Sends the queued writes of this thread and waits for them
+ *
+ * @return -1 when one of them failed, hid_error() of its device tells why
+ */
+int hid_batch_flush(void);
+
+/**
+ * @brief Sends the queued writes and stops queueing
+ *
+ * @return -1 when a write failed which no other call reported, hid_error() of its device tells why
+ */
+int hid_batch_end(void);
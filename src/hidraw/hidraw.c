@@ -0,0 +1,714 @@
+#include "hidapi.h"
+
+#include "uring.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/hidraw.h>
+#include <linux/input.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#define SYSFS_HIDRAW "/sys/class/hidraw"
+#define ERROR_SIZE   256
+/// Submission queue size, a round submits two entries (write and timeout) per device
+#define BATCH_RING_ENTRIES 64
+
+struct hid_device_ {
+    int fd;
+    bool blocking;
+    /// hidrawN, to find the sysfs attributes
+    char name[32];
+    wchar_t error[ERROR_SIZE];
+};
+
+/// Error of calls without a device (hid_open_path)
+static wchar_t global_error[ERROR_SIZE];
+
+/// A write queued by hid_write(), until the thread which queued it collects it
+struct queued_write {
+    struct queued_write* next;
+    /// the batch of the thread which queued it
+    const void* owner;
+    hid_device* dev;
+    /// of the linked timeout, tv_sec and tv_nsec 0 for none
+    struct __kernel_timespec timeout;
+    bool done;
+    /// bytes written or -errno
+    int result;
+    size_t length;
+    unsigned char data[];
+};
+
+/**
+ * The writes of every thread (one per headset) go through one ring: the thread
+ * which needs its writes out first submits those of all threads, while the
+ * others wait for that round to complete.
+ */
+static struct {
+    pthread_mutex_t lock;
+    /// signalled when a round completed
+    pthread_cond_t round_done;
+    /// a thread is submitting a round, the others wait for it
+    bool submitting;
+    /// 0: not tried yet, 1: ring usable, -1: io_uring unavailable
+    int ring_state;
+    struct uring ring;
+    /// queued writes of every thread, oldest first
+    struct queued_write* first;
+    struct queued_write* last;
+} shared = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, false, 0, { -1 }, NULL, NULL };
+
+/// State of the calling thread
+static __thread struct {
+    bool active;
+    /// a write failed since hid_batch_begin() and nobody reported it
+    bool failed;
+    int timeout_ms;
+    /// writes in the shared queue not collected yet
+    int queued;
+} batch = { false, false, 0, 0 };
+
+static int batch_flush(hid_device* dev);
+
+static void set_error(hid_device* dev, const char* what)
+{
+    wchar_t* error = dev ? dev->error : global_error;
+    swprintf(error, ERROR_SIZE, L"%s: %s", what, strerror(errno));
+}
+
+/// Decodes UTF-8 sysfs strings, independent of the locale
+static wchar_t* utf8_to_wcs(const char* str)
+{
+    size_t len   = strlen(str);
+    wchar_t* wcs = malloc((len + 1) * sizeof(wchar_t));
+    if (!wcs)
+        return NULL;
+
+    const unsigned char* p = (const unsigned char*)str;
+    size_t n               = 0;
+    while (*p) {
+        uint32_t c = *p++;
+        int extra  = 0;
+        if (c >= 0xf0)
+            extra = 3;
+        else if (c >= 0xe0)
+            extra = 2;
+        else if (c >= 0xc0)
+            extra = 1;
+
+        if (extra)
+            c &= 0x3f >> extra;
+        for (; extra > 0 && (*p & 0xc0) == 0x80; extra--)
+            c = c << 6 | (*p++ & 0x3f);
+        wcs[n++] = (wchar_t)c;
+    }
+    wcs[n] = L'\0';
+
+    return wcs;
+}
+
+/**
+ * @brief Reads a sysfs attribute relative to /sys/class/hidraw/NAME/device
+ *
+ * @return length of the value without the trailing newline, -1 if it can't be read
+ */
+static int read_attribute(const char* name, const char* attribute, char* buf, size_t size)
+{
+    char path[256];
+    snprintf(path, sizeof(path), SYSFS_HIDRAW "/%s/device/%s", name, attribute);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    ssize_t len = read(fd, buf, size - 1);
+    close(fd);
+    if (len < 0)
+        return -1;
+
+    while (len > 0 && (buf[len - 1] == '\n' || buf[len - 1] == '\0'))
+        len--;
+    buf[len] = '\0';
+
+    return (int)len;
+}
+
+/**
+ * @brief Finds the first usage page and usage of a report descriptor
+ *
+ * These identify the interface on Windows, the rest of HeadsetControl only prints them here.
+ */
+static void parse_usage(const unsigned char* desc, int size, unsigned short* usage_page, unsigned short* usage)
+{
+    bool have_page = false, have_usage = false;
+
+    for (int i = 0; i < size && !(have_page && have_usage);) {
+        unsigned char prefix = desc[i];
+
+        if (prefix == 0xfe) { // long item, data size in the next byte
+            i += 3 + (i + 1 < size ? desc[i + 1] : 0);
+            continue;
+        }
+
+        int data_size = prefix & 0x03;
+        if (data_size == 3)
+            data_size = 4;
+
+        uint32_t value = 0;
+        for (int k = 0; k < data_size && i + 1 + k < size; k++)
+            value |= (uint32_t)desc[i + 1 + k] << (8 * k);
+
+        switch (prefix & 0xfc) {
+        case 0x04: // Usage Page
+            *usage_page = (unsigned short)value;
+            have_page   = true;
+            break;
+        case 0x08: // Usage
+            *usage     = (unsigned short)value;
+            have_usage = true;
+            break;
+        }
+
+        i += 1 + data_size;
+    }
+}
+
+/**
+ * @brief Fills the strings of a device from the USB device above the HID node, or from the uevent
+ */
+static void read_strings(const char* name, const char* hid_name, wchar_t** manufacturer, wchar_t** product)
+{
+    char buf[256];
+
+    // device -> HID device, .. -> USB interface, ../.. -> USB device
+    *manufacturer = read_attribute(name, "../../manufacturer", buf, sizeof(buf)) >= 0 ? utf8_to_wcs(buf) : NULL;
+    *product      = read_attribute(name, "../../product", buf, sizeof(buf)) >= 0 ? utf8_to_wcs(buf) : NULL;
+
+    // other buses: HID_NAME is "Manufacturer Product" at best
+    if (!*manufacturer)
+        *manufacturer = utf8_to_wcs("");
+    if (!*product)
+        *product = utf8_to_wcs(hid_name ? hid_name : "");
+}
+
+static struct hid_device_info* read_device_info(const char* name)
+{
+    char uevent[1024];
+    if (read_attribute(name, "uevent", uevent, sizeof(uevent)) < 0)
+        return NULL;
+
+    unsigned int bus = 0, vid = 0, pid = 0;
+    const char *hid_name = NULL, *uniq = "";
+
+    for (char* line = strtok(uevent, "\n"); line; line = strtok(NULL, "\n")) {
+        if (strncmp(line, "HID_ID=", 7) == 0)
+            sscanf(line + 7, "%x:%x:%x", &bus, &vid, &pid);
+        else if (strncmp(line, "HID_NAME=", 9) == 0)
+            hid_name = line + 9;
+        else if (strncmp(line, "HID_UNIQ=", 9) == 0)
+            uniq = line + 9;
+    }
+
+    if (vid == 0 && pid == 0)
+        return NULL;
+
+    struct hid_device_info* info = calloc(1, sizeof(struct hid_device_info));
+    if (!info)
+        return NULL;
+
+    char path[64];
+    snprintf(path, sizeof(path), "/dev/%s", name);
+
+    info->path          = strdup(path);
+    info->vendor_id     = (unsigned short)vid;
+    info->product_id    = (unsigned short)pid;
+    info->serial_number = utf8_to_wcs(uniq);
+
+    char buf[16];
+    info->interface_number = bus == BUS_USB && read_attribute(name, "../bInterfaceNumber", buf, sizeof(buf)) > 0 ? (int)strtol(buf, NULL, 16) : -1;
+    if (bus == BUS_USB && read_attribute(name, "../../bcdDevice", buf, sizeof(buf)) > 0)
+        info->release_number = (unsigned short)strtol(buf, NULL, 16);
+
+    read_strings(name, hid_name, &info->manufacturer_string, &info->product_string);
+
+    char desc_path[256];
+    snprintf(desc_path, sizeof(desc_path), SYSFS_HIDRAW "/%s/device/report_descriptor", name);
+    int fd = open(desc_path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        unsigned char desc[HID_MAX_DESCRIPTOR_SIZE];
+        ssize_t size = read(fd, desc, sizeof(desc));
+        close(fd);
+        if (size > 0)
+            parse_usage(desc, (int)size, &info->usage_page, &info->usage);
+    }
+
+    return info;
+}
+
+int hid_init(void)
+{
+    return 0;
+}
+
+int hid_exit(void)
+{
+    batch_flush(NULL);
+
+    pthread_mutex_lock(&shared.lock);
+    if (shared.ring_state == 1)
+        uring_exit(&shared.ring);
+    shared.ring_state = 0;
+    pthread_mutex_unlock(&shared.lock);
+
+    batch.active = false;
+    return 0;
+}
+
+struct hid_device_info* hid_enumerate(unsigned short vendor_id, unsigned short product_id)
+{
+    DIR* dir = opendir(SYSFS_HIDRAW);
+    if (!dir)
+        return NULL;
+
+    struct hid_device_info *head = NULL, *tail = NULL;
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "hidraw", 6) != 0)
+            continue;
+
+        struct hid_device_info* info = read_device_info(entry->d_name);
+        if (!info)
+            continue;
+
+        if ((vendor_id && info->vendor_id != vendor_id) || (product_id && info->product_id != product_id)) {
+            info->next = NULL;
+            hid_free_enumeration(info);
+            continue;
+        }
+
+        if (tail)
+            tail->next = info;
+        else
+            head = info;
+        tail = info;
+    }
+
+    closedir(dir);
+    return head;
+}
+
+void hid_free_enumeration(struct hid_device_info* devs)
+{
+    while (devs) {
+        struct hid_device_info* next = devs->next;
+        free(devs->path);
+        free(devs->serial_number);
+        free(devs->manufacturer_string);
+        free(devs->product_string);
+        free(devs);
+        devs = next;
+    }
+}
+
+hid_device* hid_open_path(const char* path)
+{
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        set_error(NULL, "open");
+        return NULL;
+    }
+
+    hid_device* dev = calloc(1, sizeof(struct hid_device_));
+    if (!dev) {
+        close(fd);
+        return NULL;
+    }
+
+    const char* name = strrchr(path, '/');
+    snprintf(dev->name, sizeof(dev->name), "%s", name ? name + 1 : path);
+    dev->fd       = fd;
+    dev->blocking = true;
+
+    return dev;
+}
+
+void hid_close(hid_device* dev)
+{
+    if (!dev)
+        return;
+
+    // queued writes, e.g. a save command, still go out
+    if (batch_flush(dev) < 0)
+        batch.failed = true;
+
+    close(dev->fd);
+    free(dev);
+}
+
+static bool batch_queue(hid_device* dev, const unsigned char* data, size_t length)
+{
+    struct queued_write* w = malloc(sizeof(struct queued_write) + length);
+    if (!w)
+        return false;
+
+    w->next            = NULL;
+    w->owner           = &batch;
+    w->dev             = dev;
+    w->timeout.tv_sec  = batch.timeout_ms / 1000;
+    w->timeout.tv_nsec = (batch.timeout_ms % 1000) * 1000000LL;
+    w->done            = false;
+    w->result          = 0;
+    w->length          = length;
+    memcpy(w->data, data, length);
+
+    pthread_mutex_lock(&shared.lock);
+    if (shared.last)
+        shared.last->next = w;
+    else
+        shared.first = w;
+    shared.last = w;
+    pthread_mutex_unlock(&shared.lock);
+
+    batch.queued++;
+    return true;
+}
+
+/**
+ * @brief Whether an earlier write of the same device is not done yet
+ */
+static bool batch_waits_for_earlier(const struct queued_write* write)
+{
+    for (const struct queued_write* w = shared.first; w != write; w = w->next) {
+        if (!w->done && w->dev == write->dev)
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Submits one round: the oldest pending write of every device, of every thread
+ *
+ * Writes of one device stay in order, writes of different devices run in
+ * parallel, each with its own timeout. Called with the lock held and
+ * shared.submitting set, the lock is released during the system calls.
+ */
+static void batch_submit_round()
+{
+    struct queued_write* round[BATCH_RING_ENTRIES / 2];
+    int num_submitted = 0;
+
+    for (struct queued_write* w = shared.first; w && num_submitted < BATCH_RING_ENTRIES / 2; w = w->next) {
+        if (!w->done && !batch_waits_for_earlier(w))
+            round[num_submitted++] = w;
+    }
+
+    // the writes of the round are only freed once done
+    pthread_mutex_unlock(&shared.lock);
+
+    unsigned expected = 0;
+    int results[BATCH_RING_ENTRIES / 2];
+
+    for (int k = 0; k < num_submitted; k++) {
+        struct queued_write* w = round[k];
+
+        struct io_uring_sqe* sqe = uring_get_sqe(&shared.ring);
+        sqe->opcode              = IORING_OP_WRITE;
+        sqe->fd                  = w->dev->fd;
+        sqe->addr                = (uintptr_t)w->data;
+        sqe->len                 = w->length;
+        sqe->off                 = (uint64_t)-1;
+        sqe->user_data           = k;
+        expected++;
+
+        if (w->timeout.tv_sec > 0 || w->timeout.tv_nsec > 0) {
+            sqe->flags |= IOSQE_IO_LINK;
+
+            struct io_uring_sqe* timeout_sqe = uring_get_sqe(&shared.ring);
+            timeout_sqe->opcode              = IORING_OP_LINK_TIMEOUT;
+            timeout_sqe->addr                = (uintptr_t)&w->timeout;
+            timeout_sqe->len                 = 1;
+            timeout_sqe->user_data           = (uint64_t)-1;
+            expected++;
+        }
+    }
+
+    int ret = uring_submit_and_wait(&shared.ring, expected);
+    if (ret < 0) {
+        for (int k = 0; k < num_submitted; k++)
+            results[k] = ret;
+    } else {
+        struct io_uring_cqe cqe;
+        for (unsigned received = 0; received < expected;) {
+            if (!uring_pop_cqe(&shared.ring, &cqe)) {
+                uring_submit_and_wait(&shared.ring, 1);
+                continue;
+            }
+            received++;
+
+            if (cqe.user_data == (uint64_t)-1)
+                continue;
+
+            // canceled by its linked timeout
+            results[cqe.user_data] = cqe.res == -ECANCELED ? -ETIMEDOUT : cqe.res;
+        }
+    }
+
+    pthread_mutex_lock(&shared.lock);
+
+    for (int k = 0; k < num_submitted; k++) {
+        round[k]->done   = true;
+        round[k]->result = results[k];
+    }
+}
+
+/// Whether a write of the calling thread is not done yet. Called with the lock held
+static bool batch_pending()
+{
+    for (const struct queued_write* w = shared.first; w; w = w->next) {
+        if (w->owner == &batch && !w->done)
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Sends the queued writes of the calling thread, and those other threads queued meanwhile
+ *
+ * @param dev the device whose write errors are returned, NULL for all
+ * @return -1 when a write of dev failed, its error is then set
+ */
+static int batch_flush(hid_device* dev)
+{
+    if (batch.queued == 0)
+        return 0;
+
+    pthread_mutex_lock(&shared.lock);
+
+    while (batch_pending()) {
+        if (shared.submitting) {
+            pthread_cond_wait(&shared.round_done, &shared.lock);
+            continue;
+        }
+
+        shared.submitting = true;
+        batch_submit_round();
+        shared.submitting = false;
+        pthread_cond_broadcast(&shared.round_done);
+    }
+
+    // collect the writes of this thread
+    int ret                       = 0;
+    struct queued_write* previous = NULL;
+    for (struct queued_write* w = shared.first; w;) {
+        struct queued_write* next = w->next;
+
+        if (w->owner != &batch) {
+            previous = w;
+            w        = next;
+            continue;
+        }
+
+        if (previous)
+            previous->next = next;
+        else
+            shared.first = next;
+        if (shared.last == w)
+            shared.last = previous;
+
+        if (w->result < 0) {
+            errno = -w->result;
+            set_error(w->dev, "write");
+            if (dev == NULL || w->dev == dev)
+                ret = -1;
+            else
+                batch.failed = true;
+        }
+
+        free(w);
+        w = next;
+    }
+    batch.queued = 0;
+
+    pthread_mutex_unlock(&shared.lock);
+    return ret;
+}
+
+void hid_batch_begin(int timeout_ms)
+{
+    pthread_mutex_lock(&shared.lock);
+    if (shared.ring_state == 0) {
+        // IORING_OP_WRITE needs Linux 5.6, which also introduced IORING_FEAT_RW_CUR_POS
+        if (uring_init(&shared.ring, BATCH_RING_ENTRIES) && (shared.ring.features & IORING_FEAT_RW_CUR_POS)) {
+            shared.ring_state = 1;
+        } else {
+            uring_exit(&shared.ring);
+            shared.ring_state = -1;
+        }
+    }
+    batch.active = shared.ring_state == 1;
+    pthread_mutex_unlock(&shared.lock);
+
+    batch.failed     = false;
+    batch.timeout_ms = timeout_ms;
+}
+
+int hid_batch_flush()
+{
+    return batch_flush(NULL);
+}
+
+int hid_batch_end()
+{
+    if (batch_flush(NULL) < 0)
+        batch.failed = true;
+    batch.active = false;
+
+    return batch.failed ? -1 : 0;
+}
+
+int hid_write(hid_device* dev, const unsigned char* data, size_t length)
+{
+    if (batch.active && batch_queue(dev, data, length))
+        return (int)length;
+
+    // behind the writes queued before
+    if (batch_flush(dev) < 0)
+        return -1;
+
+    ssize_t ret = write(dev->fd, data, length);
+    if (ret < 0)
+        set_error(dev, "write");
+
+    return (int)ret;
+}
+
+int hid_read_timeout(hid_device* dev, unsigned char* data, size_t length, int milliseconds)
+{
+    // the reply belongs to a queued request
+    if (batch_flush(dev) < 0)
+        return -1;
+
+    if (milliseconds >= 0) {
+        struct pollfd fds = { dev->fd, POLLIN, 0 };
+
+        int ret = poll(&fds, 1, milliseconds);
+        if (ret == 0 || (ret < 0 && errno == EINTR))
+            return 0;
+        if (ret < 0) {
+            set_error(dev, "poll");
+            return -1;
+        }
+        if (fds.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+            errno = ENODEV;
+            set_error(dev, "poll");
+            return -1;
+        }
+    }
+
+    ssize_t ret = read(dev->fd, data, length);
+    if (ret < 0) {
+        if (errno == EAGAIN || errno == EINTR)
+            return 0;
+
+        set_error(dev, "read");
+        return -1;
+    }
+
+    return (int)ret;
+}
+
+int hid_read(hid_device* dev, unsigned char* data, size_t length)
+{
+    return hid_read_timeout(dev, data, length, dev->blocking ? -1 : 0);
+}
+
+int hid_set_nonblocking(hid_device* dev, int nonblock)
+{
+    dev->blocking = !nonblock;
+    return 0;
+}
+
+int hid_send_feature_report(hid_device* dev, const unsigned char* data, size_t length)
+{
+    if (batch_flush(dev) < 0)
+        return -1;
+
+    int ret = ioctl(dev->fd, HIDIOCSFEATURE(length), data);
+    if (ret < 0)
+        set_error(dev, "HIDIOCSFEATURE");
+
+    return ret;
+}
+
+int hid_get_feature_report(hid_device* dev, unsigned char* data, size_t length)
+{
+    if (batch_flush(dev) < 0)
+        return -1;
+
+    int ret = ioctl(dev->fd, HIDIOCGFEATURE(length), data);
+    if (ret < 0)
+        set_error(dev, "HIDIOCGFEATURE");
+
+    return ret;
+}
+
+static int copy_string(const wchar_t* src, wchar_t* string, size_t maxlen)
+{
+    if (!src || maxlen == 0)
+        return -1;
+
+    wcsncpy(string, src, maxlen);
+    string[maxlen - 1] = L'\0';
+    return 0;
+}
+
+int hid_get_manufacturer_string(hid_device* dev, wchar_t* string, size_t maxlen)
+{
+    wchar_t *manufacturer, *product;
+    read_strings(dev->name, NULL, &manufacturer, &product);
+
+    int ret = copy_string(manufacturer, string, maxlen);
+    free(manufacturer);
+    free(product);
+    return ret;
+}
+
+int hid_get_product_string(hid_device* dev, wchar_t* string, size_t maxlen)
+{
+    wchar_t *manufacturer, *product;
+    read_strings(dev->name, NULL, &manufacturer, &product);
+
+    int ret = copy_string(product, string, maxlen);
+    free(manufacturer);
+    free(product);
+    return ret;
+}
+
+int hid_get_serial_number_string(hid_device* dev, wchar_t* string, size_t maxlen)
+{
+    struct hid_device_info* info = read_device_info(dev->name);
+    if (!info)
+        return -1;
+
+    int ret = copy_string(info->serial_number, string, maxlen);
+    hid_free_enumeration(info);
+    return ret;
+}
+
+const wchar_t* hid_error(hid_device* dev)
+{
+    const wchar_t* error = dev ? dev->error : global_error;
+    return error[0] ? error : L"Success";
+}
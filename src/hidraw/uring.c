@@ -0,0 +1,142 @@
+#include "uring.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int io_uring_setup(unsigned entries, struct io_uring_params* params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+bool uring_init(struct uring* ring, unsigned entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+
+    ring->fd = io_uring_setup(entries, &params);
+    if (ring->fd < 0)
+        return false;
+
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    // one mapping holds both rings on kernels 5.4 and newer
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_map_size > ring->sq_map_size)
+            ring->sq_map_size = ring->cq_map_size;
+        ring->cq_map_size = 0;
+    }
+
+    ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_map == MAP_FAILED)
+        goto fail_sq;
+
+    if (ring->cq_map_size) {
+        ring->cq_map = mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_map == MAP_FAILED)
+            goto fail_cq;
+    } else {
+        ring->cq_map = ring->sq_map;
+    }
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes      = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+        goto fail_sqes;
+
+    char* sq = ring->sq_map;
+    char* cq = ring->cq_map;
+
+    ring->features   = params.features;
+    ring->sq_entries = params.sq_entries;
+    ring->sq_head    = (unsigned*)(sq + params.sq_off.head);
+    ring->sq_tail    = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_mask    = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_array   = (unsigned*)(sq + params.sq_off.array);
+    ring->cq_head    = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail    = (unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask    = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes       = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    return true;
+
+fail_sqes:
+    if (ring->cq_map_size)
+        munmap(ring->cq_map, ring->cq_map_size);
+fail_cq:
+    munmap(ring->sq_map, ring->sq_map_size);
+fail_sq:
+    close(ring->fd);
+    ring->fd = -1;
+    return false;
+}
+
+void uring_exit(struct uring* ring)
+{
+    if (ring->fd < 0)
+        return;
+
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_map_size)
+        munmap(ring->cq_map, ring->cq_map_size);
+    munmap(ring->sq_map, ring->sq_map_size);
+    close(ring->fd);
+    ring->fd = -1;
+}
+
+struct io_uring_sqe* uring_get_sqe(struct uring* ring)
+{
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *ring->sq_tail + ring->pending;
+
+    if (tail - head >= ring->sq_entries)
+        return NULL;
+
+    unsigned index         = tail & *ring->sq_mask;
+    struct io_uring_sqe* s = &ring->sqes[index];
+    memset(s, 0, sizeof(*s));
+
+    ring->sq_array[index] = index;
+    ring->pending++;
+
+    return s;
+}
+
+int uring_submit_and_wait(struct uring* ring, unsigned wait_nr)
+{
+    // publish the filled SQEs before the kernel reads the tail
+    unsigned tail = *ring->sq_tail + ring->pending;
+    __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+    ring->pending = 0;
+
+    int ret;
+    do {
+        // after an interruption only submit what the kernel didn't consume yet
+        unsigned to_submit = tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        ret                = io_uring_enter(ring->fd, to_submit, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0);
+    } while (ret < 0 && errno == EINTR);
+
+    return ret < 0 ? -errno : ret;
+}
+
+bool uring_pop_cqe(struct uring* ring, struct io_uring_cqe* cqe)
+{
+    unsigned head = *ring->cq_head;
+
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+        return false;
+
+    *cqe = ring->cqes[head & *ring->cq_mask];
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <linux/io_uring.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Minimal io_uring wrapper on the raw system calls, used by the native hidraw
+ * backend to submit the writes of a batch at once.
+ */
+
+struct uring {
+    int fd;
+    /// IORING_FEAT_* supported by the kernel
+    unsigned features;
+    unsigned sq_entries;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+    struct io_uring_sqe* sqes;
+    /// SQEs filled since the last submit
+    unsigned pending;
+
+    void* sq_map;
+    size_t sq_map_size;
+    void* cq_map;
+    size_t cq_map_size;
+    size_t sqes_size;
+};
+
+/**
+ * @brief Creates a ring with room for entries submissions
+ *
+ * @return false when io_uring is unavailable (old kernel, disabled, seccomp)
+ */
+bool uring_init(struct uring* ring, unsigned entries);
+
+void uring_exit(struct uring* ring);
+
+/**
+ * @brief Returns a cleared SQE to fill, or NULL when the submission queue is full
+ */
+struct io_uring_sqe* uring_get_sqe(struct uring* ring);
+
+/**
+ * @brief Submits the filled SQEs and waits for wait_nr completions
+ *
+ * @return number of submitted SQEs, or -errno
+ */
+int uring_submit_and_wait(struct uring* ring, unsigned wait_nr);
+
+/**
+ * @brief Takes the next completion
+ *
+ * @return false when none is available
+ */
+bool uring_pop_cqe(struct uring* ring, struct io_uring_cqe* cqe);
@@ -0,0 +1,243 @@
+#include "hotplug.h"
+
+#include "utility.h"
+
+#include <stdio.h>
+
+#ifdef __linux__
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/// Multicast groups of NETLINK_KOBJECT_UEVENT
+#define UEVENT_GROUP_KERNEL 1
+#define UEVENT_GROUP_UDEV 2
+
+/// Start of the messages udev forwards, see libudev's udev_monitor_netlink_header
+struct udev_netlink_header {
+    char prefix[8];
+    uint32_t magic;
+    uint32_t header_size;
+    uint32_t properties_off;
+    uint32_t properties_len;
+};
+
+#define UDEV_MONITOR_MAGIC 0xfeedcafe
+
+static struct {
+    int fd;
+    bool inotify;
+    char dir[HOTPLUG_PATH_SIZE];
+} watcher = { -1, false, "" };
+
+int hotplug_open(const char* dir)
+{
+    if (!dir) {
+        watcher.fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+        if (watcher.fd >= 0) {
+            struct sockaddr_nl addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.nl_family = AF_NETLINK;
+            addr.nl_groups = UEVENT_GROUP_KERNEL | UEVENT_GROUP_UDEV;
+
+            if (bind(watcher.fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+                watcher.inotify = false;
+                return 0;
+            }
+
+            close(watcher.fd);
+        }
+
+        dir = "/dev";
+    }
+
+    watcher.fd = inotify_init1(IN_CLOEXEC);
+    if (watcher.fd < 0 || inotify_add_watch(watcher.fd, dir, IN_CREATE | IN_MOVED_TO | IN_ATTRIB | IN_DELETE) < 0) {
+        fprintf(stderr, "Unable to watch %s for devices: %s\n", dir, strerror(errno));
+        hotplug_close();
+        return -1;
+    }
+
+    watcher.inotify = true;
+    snprintf(watcher.dir, sizeof(watcher.dir), "%s", dir);
+
+    return 0;
+}
+
+void hotplug_close()
+{
+    if (watcher.fd >= 0)
+        close(watcher.fd);
+
+    watcher.fd = -1;
+}
+
+/// Adds a connected node once, counting those which don't fit
+static void add_path(char (*paths)[HOTPLUG_PATH_SIZE], int max_paths, int* added, const char* dir, const char* name)
+{
+    char path[HOTPLUG_PATH_SIZE];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+    for (int i = 0; i < *added && i < max_paths; i++) {
+        if (strcmp(paths[i], path) == 0)
+            return;
+    }
+
+    if (*added < max_paths)
+        memcpy(paths[*added], path, sizeof(path));
+    (*added)++;
+}
+
+/**
+ * @brief Reads one uevent
+ *
+ * @return 1 for hidraw events, 0 for others, -1 on errors
+ */
+static int read_uevent(char (*paths)[HOTPLUG_PATH_SIZE], int max_paths, int* added)
+{
+    char buf[8192 + 1];
+    struct sockaddr_nl addr;
+    socklen_t addr_len = sizeof(addr);
+
+    ssize_t len = recvfrom(watcher.fd, buf, sizeof(buf) - 1, 0, (struct sockaddr*)&addr, &addr_len);
+    if (len < 0 && errno == ENOBUFS) {
+        // events were lost, any device may have been connected
+        *added = max_paths + 1;
+        return 1;
+    }
+    if (len < 0)
+        return -1;
+    buf[len] = '\0';
+
+    // only privileged processes (the kernel, udev) may send to the multicast groups
+    if (addr.nl_groups == 0)
+        return 0;
+
+    // properties are "KEY=value" strings, after the header of udev or the "action@devpath" summary of the kernel
+    size_t off = 0, end = (size_t)len;
+    const struct udev_netlink_header* header = (const struct udev_netlink_header*)buf;
+
+    if ((size_t)len >= sizeof(*header) && memcmp(header->prefix, "libudev", 8) == 0) {
+        if (ntohl(header->magic) != UDEV_MONITOR_MAGIC || header->properties_off >= (size_t)len)
+            return 0;
+
+        off = header->properties_off;
+        if (header->properties_len < end - off)
+            end = off + header->properties_len;
+    } else {
+        off = strlen(buf) + 1;
+    }
+
+    const char* action    = "";
+    const char* subsystem = "";
+    const char* devname   = "";
+
+    for (; off < end; off += strlen(buf + off) + 1) {
+        const char* property = buf + off;
+
+        if (strncmp(property, "ACTION=", 7) == 0)
+            action = property + 7;
+        else if (strncmp(property, "SUBSYSTEM=", 10) == 0)
+            subsystem = property + 10;
+        else if (strncmp(property, "DEVNAME=", 8) == 0)
+            devname = property + 8;
+    }
+
+    if (strcmp(subsystem, "hidraw") != 0)
+        return 0;
+
+    if (strcmp(action, "add") == 0 && devname[0] != '\0') {
+        // the kernel names the node relative to /dev, udev with its path
+        if (strncmp(devname, "/dev/", 5) == 0)
+            devname += 5;
+        add_path(paths, max_paths, added, "/dev", devname);
+    }
+
+    return strcmp(action, "add") == 0 || strcmp(action, "remove") == 0;
+}
+
+/**
+ * @brief Reads the pending inotify events
+ *
+ * @return 1 when hidraw nodes changed, 0 for others, -1 on errors
+ */
+static int read_inotify(char (*paths)[HOTPLUG_PATH_SIZE], int max_paths, int* added)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    ssize_t len = read(watcher.fd, buf, sizeof(buf));
+    if (len < 0)
+        return -1;
+
+    int changed = 0;
+
+    for (char* ptr = buf; ptr < buf + len;) {
+        const struct inotify_event* event = (const struct inotify_event*)ptr;
+        ptr += sizeof(struct inotify_event) + event->len;
+
+        if (event->len == 0 || strncmp(event->name, "hidraw", 6) != 0)
+            continue;
+
+        changed = 1;
+
+        // nodes become usable once udev changed their permissions
+        if (!(event->mask & IN_DELETE))
+            add_path(paths, max_paths, added, watcher.dir, event->name);
+    }
+
+    return changed;
+}
+
+int hotplug_wait(char (*paths)[HOTPLUG_PATH_SIZE], int max_paths)
+{
+    int added   = 0;
+    int timeout = -1; // block until something happens
+
+    struct pollfd pfd;
+    pfd.fd     = watcher.fd;
+    pfd.events = POLLIN;
+
+    for (;;) {
+        int ret = poll(&pfd, 1, timeout);
+        if (ret < 0)
+            return -1;
+        if (ret == 0)
+            return added;
+
+        ret = watcher.inotify ? read_inotify(paths, max_paths, &added) : read_uevent(paths, max_paths, &added);
+        if (ret < 0)
+            return -1;
+        if (ret > 0)
+            timeout = HOTPLUG_SETTLE_MS;
+    }
+}
+
+#else
+
+int hotplug_open(const char* dir)
+{
+    UNUSED(dir);
+    fprintf(stderr, "Watching for connected headsets is only supported on Linux\n");
+    return -1;
+}
+
+int hotplug_wait(char (*paths)[HOTPLUG_PATH_SIZE], int max_paths)
+{
+    UNUSED(paths);
+    UNUSED(max_paths);
+    return -1;
+}
+
+void hotplug_close()
+{
+}
+
+#endif
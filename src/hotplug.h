@@ -0,0 +1,38 @@
+#pragma once
+
+/**
+ * Watches for HID devices being connected and disconnected, without polling.
+ *
+ * On Linux the hidraw add and remove uevents of the kernel and of udev are
+ * received over netlink. Where netlink is unavailable (e.g. in containers), or
+ * when a directory is given, the creation and removal of hidraw nodes in that
+ * directory (/dev by default) is watched with inotify instead.
+ */
+
+/// Events arriving within this time are handled together, e.g. the kernel and the udev event of a node
+#define HOTPLUG_SETTLE_MS 1000
+
+/// Size of a device node path reported by hotplug_wait()
+#define HOTPLUG_PATH_SIZE 64
+
+/**
+ * @brief Starts watching
+ *
+ * @param dir directory to watch with inotify, NULL to use netlink (falling back to inotify on /dev)
+ * @return 0 on success, -1 when hotplug events are not available on this platform
+ */
+int hotplug_open(const char* dir);
+
+/**
+ * @brief Blocks until HID devices were connected or disconnected
+ *
+ * Returns once no further event arrived for HOTPLUG_SETTLE_MS.
+ *
+ * @param paths     filled with the device nodes which were connected
+ * @param max_paths size of paths
+ * @return number of connected nodes, more than max_paths when not all fit, 0 when devices were only disconnected,
+ *         -1 on errors or when interrupted
+ */
+int hotplug_wait(char (*paths)[HOTPLUG_PATH_SIZE], int max_paths);
+
+void hotplug_close();
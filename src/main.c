@@ -17,11 +17,18 @@
     along with HeadsetControl.  If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include "daemon.h"
 #include "dev.h"
 #include "device.h"
 #include "device_registry.h"
+#include "exchange_lock.h"
+#include "feature.h"
 #include "hid_utility.h"
+#include "hotplug.h"
 #include "output.h"
+#include "poll_scheduler.h"
+#include "status_cache.h"
+#include "status_shm.h"
 #include "utility.h"
 #include "version.h"
 
@@ -34,40 +41,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
-
-int test_profile = 0;
-
-int hsc_device_timeout = 5000;
-
-/**
- *  This function iterates through all HID devices.
- *
- *  @return 0 when a supported device is found
- */
-static int find_device(struct device* device_found, int test_device)
-{
-    if (test_device)
-        return get_device(device_found, VENDOR_TESTDEVICE, PRODUCT_TESTDEVICE);
-
-    struct hid_device_info* devs;
-    struct hid_device_info* cur_dev;
-    int found = -1;
-    devs      = hid_enumerate(0x0, 0x0);
-    cur_dev   = devs;
-    while (cur_dev) {
-        found = get_device(device_found, cur_dev->vendor_id, cur_dev->product_id);
-
-        if (found == 0) {
-            break;
-        }
-
-        cur_dev = cur_dev->next;
-    }
-    hid_free_enumeration(devs);
-
-    return found;
-}
+#include <wchar.h>
 
 /**
  * @brief Generates udev rules, and prints them to STDOUT
@@ -126,235 +102,6 @@ static void print_readmetable()
     }
 }
 
-/**
- * @brief Checks if an existing connection exists, and either uses it, or closes it and creates a new one
- *
- * A device - depending on the feature - needs differend Endpoints/Connections
- * Instead of opening and keeping track of multiple connections, we close and open connections no demand
- *
- *
- *
- * @param existing_hid_path an existing connection path or NULL if none yet
- * @param device_handle an existing device handle or NULL if none yet
- * @param device headsetcontrol struct, containing vendor and productid
- * @param cap which capability to use, to determine interfaceid and usageids
- * @return hid_device pointer if successfull, or NULL (error in hid_error)
- */
-static hid_device* dynamic_connect(char** existing_hid_path, hid_device* device_handle,
-    struct device* device, enum capabilities cap)
-{
-    // Generate the path which is needed
-    char* hid_path = get_hid_path(device->idVendor, device->idProduct,
-        device->capability_details[cap].interface, device->capability_details[cap].usagepage, device->capability_details[cap].usageid);
-
-    if (!hid_path) {
-        return NULL;
-    }
-
-    // A connection already exists
-    if (device_handle != NULL) {
-        // The connection which exists is the same we need, so simply return it
-        if (strcmp(*existing_hid_path, hid_path) == 0) {
-            return device_handle;
-        } else { // if its not the same, and already one connection is open, close it so we can make a new one
-            hid_close(device_handle);
-        }
-    }
-
-    free(*existing_hid_path);
-
-    device_handle = hid_open_path(hid_path);
-    if (device_handle == NULL) {
-        *existing_hid_path = NULL;
-        return NULL;
-    }
-
-    hid_get_manufacturer_string(device_handle, device->device_hid_vendorname, sizeof(device->device_hid_vendorname) / sizeof(device->device_hid_vendorname[0]));
-    hid_get_product_string(device_handle, device->device_hid_productname, sizeof(device->device_hid_productname) / sizeof(device->device_hid_productname[0]));
-
-    *existing_hid_path = hid_path;
-    return device_handle;
-}
-
-/**
- * @brief Handle a requested feature
- *
- * @param device_found the headset to use
- * @param device_handle points to an already open device_handle (if connection already exists) or points to null
- * @param hid_path points to an already used path used to connect, or points to null
- * @param cap requested feature
- * @param param first parameter of the feature
- * @return FeatureResult which saves the result or failure of the requested feature
- */
-static FeatureResult handle_feature(struct device* device_found, hid_device** device_handle, char** hid_path, enum capabilities cap, void* param)
-{
-    FeatureResult result;
-
-    // Check if the headset implements the requested feature
-    if ((device_found->capabilities & B(cap)) == 0) {
-        result.status = FEATURE_ERROR;
-        result.value  = -1;
-        _asprintf(&result.message, "This headset doesn't support %s", capabilities_str[cap]);
-        return result;
-    }
-
-    if (device_found->idProduct != PRODUCT_TESTDEVICE) {
-        *device_handle = dynamic_connect(hid_path, *device_handle,
-            device_found, cap);
-
-        if (!device_handle | !(*device_handle)) {
-            result.status = FEATURE_DEVICE_FAILED_OPEN;
-            result.value  = 0;
-            _asprintf(&result.message, "Could not open device. Error: %ls", hid_error(*device_handle));
-            return result;
-        }
-    } else {
-        *device_handle = NULL;
-    }
-
-    int ret;
-
-    switch (cap) {
-    case CAP_SIDETONE:
-        ret = device_found->send_sidetone(*device_handle, (uint8_t) * (int*)param);
-        break;
-
-    case CAP_BATTERY_STATUS: {
-        BatteryInfo battery = device_found->request_battery(*device_handle);
-
-        result.status2 = battery.status;
-        if (battery.status == BATTERY_AVAILABLE) {
-            result.status = FEATURE_SUCCESS;
-            result.value  = battery.level;
-            _asprintf(&result.message, "Battery: %d%%", battery.level);
-        } else if (battery.status == BATTERY_CHARGING) {
-            result.status  = FEATURE_INFO;
-            result.value   = battery.level;
-            result.message = strdup("Charging");
-        } else if (battery.status == BATTERY_UNAVAILABLE) {
-            result.status  = FEATURE_INFO;
-            result.value   = BATTERY_UNAVAILABLE;
-            result.message = strdup("Battery status unavailable");
-        } else if (battery.status == BATTERY_TIMEOUT) {
-            result.status  = FEATURE_ERROR;
-            result.value   = BATTERY_TIMEOUT;
-            result.message = strdup("Battery status request timed out");
-        } else { // Handle errors
-            result.status = FEATURE_ERROR;
-            result.value  = (int)battery.status;
-
-            if (device_found->idProduct != PRODUCT_TESTDEVICE)
-                _asprintf(&result.message, "Error retrieving battery status. Error: %ls", hid_error(*device_handle));
-            else // dont call hid_error on test device
-                _asprintf(&result.message, "Error retrieving battery status");
-        }
-        return result;
-    }
-
-    case CAP_NOTIFICATION_SOUND:
-        ret = device_found->notifcation_sound(*device_handle, (uint8_t) * (int*)param);
-        break;
-
-    case CAP_LIGHTS:
-        ret = device_found->switch_lights(*device_handle, (uint8_t) * (int*)param);
-        break;
-
-    case CAP_INACTIVE_TIME:
-        ret = device_found->send_inactive_time(*device_handle, (uint8_t) * (int*)param);
-        break;
-
-    case CAP_CHATMIX_STATUS:
-        ret = device_found->request_chatmix(*device_handle);
-
-        if (ret >= 0) {
-            result.status = FEATURE_SUCCESS;
-            result.value  = ret;
-            _asprintf(&result.message, "Chat-Mix: %d", ret);
-        } else {
-            result.status  = FEATURE_ERROR;
-            result.value   = ret;
-            result.message = strdup("Error retrieving chatmix status");
-        }
-
-        return result;
-
-    case CAP_VOICE_PROMPTS:
-        ret = device_found->switch_voice_prompts(*device_handle, (uint8_t) * (int*)param);
-        break;
-
-    case CAP_ROTATE_TO_MUTE:
-        ret = device_found->switch_rotate_to_mute(*device_handle, (uint8_t) * (int*)param);
-        break;
-
-    case CAP_EQUALIZER_PRESET:
-        ret = device_found->send_equalizer_preset(*device_handle, (uint8_t) * (int*)param);
-        break;
-
-    case CAP_EQUALIZER:
-        ret = device_found->send_equalizer(*device_handle, (struct equalizer_settings*)param);
-        break;
-
-    case CAP_MICROPHONE_MUTE_LED_BRIGHTNESS:
-        ret = device_found->send_microphone_mute_led_brightness(*device_handle, (uint8_t) * (int*)param);
-        break;
-
-    case CAP_MICROPHONE_VOLUME:
-        ret = device_found->send_microphone_volume(*device_handle, (uint8_t) * (int*)param);
-        break;
-
-    case CAP_VOLUME_LIMITER:
-        ret = device_found->send_volume_limiter(*device_handle, (uint8_t) * (int*)param);
-        break;
-
-    case CAP_BT_WHEN_POWERED_ON:
-        ret = device_found->send_bluetooth_when_powered_on(*device_handle, (uint8_t) * (int*)param);
-        break;
-
-    case CAP_BT_CALL_VOLUME:
-        ret = device_found->send_bluetooth_call_volume(*device_handle, (uint8_t) * (int*)param);
-        break;
-
-    case NUM_CAPABILITIES:
-    default:
-        ret = -99; // silence warning
-        UNUSED(ret);
-
-        assert(0);
-        break;
-    }
-
-    // Handle success
-    if (ret >= 0) {
-        result.status  = FEATURE_SUCCESS;
-        result.value   = ret;
-        result.message = NULL;
-        return result;
-    }
-
-    result.status = FEATURE_ERROR;
-    result.value  = ret;
-
-    switch (ret) {
-    case HSC_READ_TIMEOUT:
-        _asprintf(&result.message, "Failed to set/request %s, because of timeout", capabilities_str[cap]);
-        break;
-    case HSC_ERROR:
-        _asprintf(&result.message, "Failed to set/request %s. HeadsetControl Error", capabilities_str[cap]);
-        break;
-    case HSC_OUT_OF_BOUNDS:
-        _asprintf(&result.message, "Failed to set/request %s. Provided parameter out of boundaries", capabilities_str[cap]);
-        break;
-    default: // Must be a HID error
-        if (device_found->idProduct != PRODUCT_TESTDEVICE)
-            _asprintf(&result.message, "Failed to set/request %s. Error: %d: %ls", capabilities_str[cap], ret, hid_error(*device_handle));
-        else // dont call hid_error on test device, it will confuse users/devs because it will show success
-            _asprintf(&result.message, "Failed to set/request %s. Error: %d", capabilities_str[cap], ret);
-
-        break;
-    }
-
-    return result;
-}
 
 void print_help(char* programname, struct device* device_found, bool _show_all)
 {
@@ -472,7 +219,21 @@ void print_help(char* programname, struct device* device_found, bool _show_all)
     if (show_all) {
         printf("Advanced:\n");
         printf("  -f, --follow [SECS]\t\tRe-run commands after SECS seconds (default 2 seconds if not specified)\n");
+        printf("\t\t\t\tHeadsets reporting status changes on their own print only changes, as they happen\n");
+        printf("\t\t\t\tOther headsets are polled less often while their status stays the same, printed every interval\n");
+        printf("\t\t\t\tand on changes, -o ndjson prints only changes\n");
         printf("  --timeout MS\t\t\tSet timeout for reading data (0-100000 ms, default 5000)\n");
+        printf("  --daemon [SOCKET]\t\tRun as daemon keeping the headset open, serving requests over a Unix socket\n");
+        printf("  --no-daemon\t\t\tDon't forward requests to a running daemon\n");
+        printf("  --cache-ttl MS\t\tShare status results younger than MS milliseconds with other invocations\n");
+        printf("  --shm-read\t\t\tPrint the status --follow, --watch or the daemon published last, without using the headset\n");
+        printf("  --all-devices\t\t\tApply the commands to every connected headset at once\n");
+        printf("  --device VID:PID[@SERIAL]\tApply the commands to the headsets with these ids (hexadecimal, as shown by lsusb)\n");
+        printf("                         \t and serial number, or to the headset with this HID path, can be repeated\n");
+        printf("  --serial SERIAL\t\tApply the commands to the headset with this serial number, can be repeated\n");
+        printf("  --inventory\t\t\tList every connected headset with its serial number and capabilities\n");
+        printf("  --watch [DIR]\t\t\tApply the commands again whenever a headset is connected, without polling\n");
+        printf("                         \t DIR is watched for hidraw nodes instead of receiving udev events (for testing)\n");
         printf("  -?, --capabilities\t\tList supported features of the connected headset\n\n");
 
         printf("Miscellaneous:\n");
@@ -482,7 +243,10 @@ void print_help(char* programname, struct device* device_found, bool _show_all)
         printf("  --test-device [profile]\tUse a built-in test device instead of a real one\n");
         printf("                         \t profile is an optional number for different tests\n");
         printf("  --connected\t\t\tCheck if device connected (for scripting purposes)\n");
-        printf("  -o, --output FORMAT\t\tOutput format (JSON, YAML, ENV, STANDARD)\n");
+        printf("  --stats\t\t\tPrint statistics about the HID communication to stderr\n");
+        printf("  -o, --output FORMAT\t\tOutput format (JSON, YAML, ENV, NDJSON, CBOR, STANDARD)\n");
+        printf("\t\t\t\tNDJSON prints a line per change, e.g. with --follow\n");
+        printf("\t\t\t\tCBOR is the JSON document in binary (RFC 8949)\n");
         printf("\n");
     }
 
@@ -501,7 +265,7 @@ void print_help(char* programname, struct device* device_found, bool _show_all)
         printf("\nHint:\tOptions were filtered to your device (%s)\n\tUse --help-all to show all options (including advanced ones)\n", device_found->device_name);
 }
 
-// for --follow
+// for --follow and --watch
 volatile sig_atomic_t follow = false;
 
 void interruptHandler(int signal_number)
@@ -510,6 +274,259 @@ void interruptHandler(int signal_number)
     follow = false;
 }
 
+/// In event-driven follow mode, all requests are still re-run at least this often
+#define FOLLOW_RESYNC_SEC 60
+/// Upper bound for a single blocking read, so that CTRL + C is handled on all platforms
+#define FOLLOW_READ_SLICE_MS 1000
+
+/**
+ * @brief Waits for status reports the headset sends on its own
+ *
+ * When the headset can't be read, waits follow_sec like the polling follow mode.
+ *
+ * @return true when a report changed a result, false when all requests should be re-run
+ */
+static bool follow_input_reports(struct device* device_found, FeatureRequest* featureRequests, int size, unsigned follow_sec, unsigned resync_sec)
+{
+    time_t deadline = time(NULL) + resync_sec;
+
+    while (follow) {
+        time_t now = time(NULL);
+        if (now >= deadline)
+            return false;
+
+        // in seconds first, long follow intervals overflow an int of milliseconds
+        int timeout_ms = deadline - now > FOLLOW_READ_SLICE_MS / 1000 ? FOLLOW_READ_SLICE_MS : (int)(deadline - now) * 1000;
+
+        int res = read_input_report(device_found, featureRequests, size, timeout_ms);
+        if (res > 0)
+            return true;
+
+        if (res < 0) {
+            // the headset is gone or not readable, continue like the polling follow mode
+            sleep(follow_sec);
+            return false;
+        }
+    }
+
+    return false;
+}
+
+/// Whether every request to run reads a status, so that nothing has to be re-applied
+static bool only_status_requests(const FeatureRequest* featureRequests, int size)
+{
+    for (int i = 0; i < size; i++) {
+        if (featureRequests[i].should_process && featureRequests[i].type != CAPABILITYTYPE_INFO)
+            return false;
+    }
+
+    return true;
+}
+
+/// Compares the results with the last printed ones and remembers them, returns whether they differ
+static bool results_changed(FeatureRequest* featureRequests, int size, FeatureResult* last_results)
+{
+    bool changed = false;
+
+    for (int i = 0; i < size; i++) {
+        FeatureResult* result = &featureRequests[i].result;
+        FeatureResult* last   = &last_results[i];
+
+        if (result->status != last->status || result->value != last->value || result->status2 != last->status2) {
+            changed       = true;
+            last->status  = result->status;
+            last->value   = result->value;
+            last->status2 = result->status2;
+        }
+    }
+
+    return changed;
+}
+
+/// Which headsets to use, see --all-devices, --device, --serial and --inventory
+struct device_selection {
+    /// from --device VID:PID[@SERIAL]
+    struct device_selector selectors[MAX_HEADSETS];
+    int num_selectors;
+    /// from --serial and --device PATH, looked up once the devices are known
+    char* serial_args[MAX_HEADSETS];
+    int num_serial_args;
+    char* path_args[MAX_HEADSETS];
+    int num_path_args;
+    /// several headsets may be used at once
+    bool multi_device;
+};
+
+/**
+ * @brief Looks for the selected headsets in the enumeration snapshot
+ *
+ * @param verbose report addressed headsets which aren't connected
+ * @return number of headsets found
+ */
+static int find_selected_devices(struct device* devices, const struct device_selection* selection, int test_device, bool verbose)
+{
+    if (!selection->multi_device)
+        return find_device(&devices[0], test_device) == 0 ? 1 : 0;
+
+    struct device_selector selectors[MAX_HEADSETS];
+    int num_selectors = selection->num_selectors;
+    memcpy(selectors, selection->selectors, num_selectors * sizeof(selectors[0]));
+
+    for (int i = 0; i < selection->num_serial_args && !test_device; i++) {
+        wchar_t serial[64] = { 0 };
+
+        if (mbstowcs(serial, selection->serial_args[i], sizeof(serial) / sizeof(serial[0]) - 1) != (size_t)-1 && select_device_by_serial(&selectors[num_selectors], serial) == 0)
+            num_selectors++;
+        else if (verbose)
+            fprintf(stderr, "No supported headset with serial number %s found\n", selection->serial_args[i]);
+    }
+    for (int i = 0; i < selection->num_path_args && !test_device; i++) {
+        if (select_device_by_path(&selectors[num_selectors], selection->path_args[i]) == 0)
+            num_selectors++;
+        else if (verbose)
+            fprintf(stderr, "No supported headset found at %s\n", selection->path_args[i]);
+    }
+
+    // none of the addressed headsets is connected
+    int num_addressed = selection->num_selectors + selection->num_serial_args + selection->num_path_args;
+    if (num_addressed > 0 && num_selectors == 0 && !test_device)
+        return 0;
+
+    return find_devices(devices, MAX_HEADSETS, selectors, num_selectors, test_device);
+}
+
+/**
+ * @brief Gives every headset its own copy of the requests, as their capabilities differ
+ *
+ * @param requests  the requests of every headset, results of earlier passes are replaced
+ * @param templates the requests as given on the command line
+ * @param all_info  also request all information the headsets support
+ */
+static void prepare_requests(FeatureRequest** requests, const FeatureRequest* templates, int size, const struct device* devices, int num_devices, bool all_info)
+{
+    for (int d = 0; d < num_devices; d++) {
+        memcpy(requests[d], templates, size * sizeof(FeatureRequest));
+
+        for (int i = 0; i < size && all_info; i++) {
+            if (requests[d][i].type == CAPABILITYTYPE_INFO && has_capability(devices[d].capabilities, requests[d][i].cap))
+                requests[d][i].should_process = true;
+        }
+    }
+}
+
+/// Whether a headset has one of the connected device nodes, or those are unknown to the enumeration
+static bool device_connected(const struct device* device, char (*paths)[HOTPLUG_PATH_SIZE], int num_paths)
+{
+    for (int i = 0; i < num_paths; i++) {
+        const struct hid_device_info* dev = hid_snapshot_find_path(paths[i]);
+
+        // paths of other hidapi backends than hidraw don't name the device node
+        if (!dev)
+            return true;
+
+        if (dev->vendor_id == device->idVendor && dev->product_id == device->idProduct
+            && wcscmp(dev->serial_number ? dev->serial_number : L"", device->device_hid_serialnumber) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Sleeps until selected headsets are connected, see hotplug.h
+ *
+ * @param devices filled with the headsets which were connected
+ * @return number of headsets connected, 0 when interrupted or on errors
+ */
+static int wait_for_headsets(struct device* devices, const struct device_selection* selection, int test_device)
+{
+    static struct device found[MAX_HEADSETS];
+    char paths[MAX_HEADSETS][HOTPLUG_PATH_SIZE];
+
+    while (follow) {
+        int connected = hotplug_wait(paths, MAX_HEADSETS);
+        if (connected < 0) {
+            follow = false;
+            return 0;
+        }
+
+        // connections to and the snapshot of removed devices are stale
+        hid_pool_close_all();
+        hid_snapshot_free();
+
+        if (connected == 0)
+            continue;
+
+        int num_found   = find_selected_devices(found, selection, test_device, false);
+        int num_arrived = 0;
+
+        // only the headsets which were connected again get the settings
+        for (int d = 0; d < num_found; d++) {
+            if (connected > MAX_HEADSETS || device_connected(&found[d], paths, connected))
+                devices[num_arrived++] = found[d];
+        }
+
+        if (num_arrived > 0)
+            return num_arrived;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Prints the status published by --follow, --watch or the daemon, see status_shm.h
+ *
+ * Only the battery and chatmix are published, the headsets aren't accessed.
+ */
+static int print_shared_status(OutputType output_format)
+{
+    static struct status_shm_status status;
+
+    int res = status_shm_read(&status);
+    if (res == -1) {
+        fprintf(stderr, "No status was published in %s, run headsetcontrol --follow or --daemon\n", status_shm_name());
+        return 1;
+    } else if (res == -2) {
+        fprintf(stderr, "The status in %s was updated while reading it, try again\n", status_shm_name());
+        return 1;
+    }
+
+    static struct device devices[MAX_HEADSETS];
+    static FeatureRequest requests[MAX_HEADSETS][2];
+    DeviceList deviceLists[MAX_HEADSETS];
+    int num_devices = (int)status.device_count;
+    int request     = 1;
+
+    for (int d = 0; d < num_devices; d++) {
+        const struct status_shm_device* shared = &status.devices[d];
+        struct device* device                  = &devices[d];
+
+        // the capabilities and vendor of headsets this build knows
+        if (get_device(device, shared->idVendor, shared->idProduct) != 0)
+            memset(device, 0, sizeof(*device));
+
+        device->idVendor        = shared->idVendor;
+        device->idProduct       = shared->idProduct;
+        device->device_instance = shared->instance;
+        snprintf(device->device_name, sizeof(device->device_name), "%s", shared->device_name);
+        if (mbstowcs(device->device_hid_serialnumber, shared->serial_number, sizeof(device->device_hid_serialnumber) / sizeof(wchar_t) - 1) == (size_t)-1)
+            device->device_hid_serialnumber[0] = L'\0';
+
+        requests[d][0] = (FeatureRequest) { CAP_BATTERY_STATUS, CAPABILITYTYPE_INFO, &request, shared->has_battery != 0,
+            { FEATURE_INFO, shared->battery_level, shared->battery_status, "" } };
+        requests[d][1] = (FeatureRequest) { CAP_CHATMIX_STATUS, CAPABILITYTYPE_INFO, &request, shared->has_chatmix != 0,
+            { FEATURE_INFO, shared->chatmix, 0, "" } };
+
+        deviceLists[d].device          = device;
+        deviceLists[d].num_devices     = num_devices;
+        deviceLists[d].featureRequests = requests[d];
+        deviceLists[d].size            = 2;
+    }
+
+    output(num_devices > 0 ? deviceLists : NULL, false, output_format);
+    return 0;
+}
+
 // Makes parsing of optional arguments easier
 // Credits to https://cfengine.com/blog/2021/optional-arguments-with-getopt-long/
 #define OPTIONAL_ARGUMENT_IS_PRESENT                             \
@@ -541,12 +558,25 @@ int main(int argc, char* argv[])
     int bt_when_powered_on               = -1;
     int bt_call_volume                   = -1;
     int dev_mode                         = 0;
+    int daemon_mode                      = 0;
+    int no_daemon                        = 0;
+    char* daemon_socket                  = NULL;
+    int print_stats                      = 0;
+    int cache_ttl                        = 0;
+    int all_devices                      = 0;
+    int inventory                        = 0;
+    int watch                            = 0;
+    char* watch_dir                      = NULL;
+    int shm_read                         = 0;
     unsigned follow_sec                  = 2;
     struct equalizer_settings* equalizer = NULL;
 
     OutputType output_format = OUTPUT_STANDARD;
     int test_device          = 0;
 
+    // headsets chosen with --device and --serial
+    static struct device_selection selection;
+
 #define BUFFERLENGTH 1024
     float* read_buffer = calloc(BUFFERLENGTH, sizeof(float));
 
@@ -577,6 +607,16 @@ int main(int argc, char* argv[])
         { "volume-limiter", required_argument, NULL, 0 },
         { "test-device", optional_argument, NULL, 0 },
         { "readme-helper", no_argument, NULL, 0 },
+        { "daemon", optional_argument, NULL, 0 },
+        { "no-daemon", no_argument, NULL, 0 },
+        { "stats", no_argument, NULL, 0 },
+        { "cache-ttl", required_argument, NULL, 0 },
+        { "all-devices", no_argument, NULL, 0 },
+        { "device", required_argument, NULL, 0 },
+        { "serial", required_argument, NULL, 0 },
+        { "inventory", no_argument, NULL, 0 },
+        { "watch", optional_argument, NULL, 0 },
+        { "shm-read", no_argument, NULL, 0 },
         { 0, 0, 0, 0 }
     };
 
@@ -659,6 +699,10 @@ int main(int argc, char* argv[])
                     output_format = OUTPUT_YAML;
                 else if (strcasecmp(optarg, "ENV") == 0)
                     output_format = OUTPUT_ENV;
+                else if (strcasecmp(optarg, "NDJSON") == 0)
+                    output_format = OUTPUT_NDJSON;
+                else if (strcasecmp(optarg, "CBOR") == 0)
+                    output_format = OUTPUT_CBOR;
                 else if (strcasecmp(optarg, "STANDARD") == 0)
                     output_format = OUTPUT_STANDARD;
                 else if (strcasecmp(optarg, "SHORT") == 0)
@@ -671,7 +715,7 @@ int main(int argc, char* argv[])
 
             if (output_specified == false) {
                 // short not listed because deprecated
-                fprintf(stderr, "Usage: %s -o JSON|YAML|ENV|STANDARD\n", argv[0]);
+                fprintf(stderr, "Usage: %s -o JSON|YAML|ENV|NDJSON|CBOR|STANDARD\n", argv[0]);
                 return 1;
             }
 
@@ -795,6 +839,67 @@ int main(int argc, char* argv[])
                 return 0;
             } else if (strcmp(opts[option_index].name, "help-all") == 0) {
                 should_print_help_all = 1;
+            } else if (strcmp(opts[option_index].name, "daemon") == 0) {
+                daemon_mode = 1;
+
+                if (OPTIONAL_ARGUMENT_IS_PRESENT) {
+                    daemon_socket = optarg;
+                }
+            } else if (strcmp(opts[option_index].name, "no-daemon") == 0) {
+                no_daemon = 1;
+            } else if (strcmp(opts[option_index].name, "stats") == 0) {
+                print_stats = 1;
+            } else if (strcmp(opts[option_index].name, "cache-ttl") == 0) {
+                cache_ttl = strtol(optarg, &endptr, 10);
+
+                if (*endptr != '\0' || endptr == optarg || cache_ttl < 0 || cache_ttl > 3600000) {
+                    fprintf(stderr, "Usage: %s --cache-ttl 0-3600000\n", argv[0]);
+                    return 1;
+                }
+            } else if (strcmp(opts[option_index].name, "all-devices") == 0) {
+                all_devices = 1;
+            } else if (strcmp(opts[option_index].name, "device") == 0 && (optarg[0] == '/' || optarg[0] == '\\')) {
+                if (selection.num_selectors + selection.num_serial_args + selection.num_path_args == MAX_HEADSETS) {
+                    fprintf(stderr, "Usage: %s --device PATH (at most %d times)\n", argv[0], MAX_HEADSETS);
+                    return 1;
+                }
+                selection.path_args[selection.num_path_args++] = optarg;
+            } else if (strcmp(opts[option_index].name, "device") == 0) {
+                struct device_selector* selector = &selection.selectors[selection.num_selectors];
+                memset(selector, 0, sizeof(*selector));
+                selector->instance = -1;
+
+                long vendor  = strtol(optarg, &endptr, 16);
+                long product = -1;
+                if (*endptr == ':')
+                    product = strtol(endptr + 1, &endptr, 16);
+                if (*endptr == '@' && mbstowcs(selector->serial, endptr + 1, sizeof(selector->serial) / sizeof(selector->serial[0]) - 1) != (size_t)-1)
+                    endptr += strlen(endptr);
+
+                if (*endptr != '\0' || vendor < 0 || vendor > 0xffff || product < 0 || product > 0xffff || selection.num_selectors + selection.num_serial_args + selection.num_path_args == MAX_HEADSETS) {
+                    fprintf(stderr, "Usage: %s --device VID:PID[@SERIAL] (at most %d times)\n", argv[0], MAX_HEADSETS);
+                    return 1;
+                }
+
+                selector->idVendor  = (uint16_t)vendor;
+                selector->idProduct = (uint16_t)product;
+                selection.num_selectors++;
+            } else if (strcmp(opts[option_index].name, "serial") == 0) {
+                if (optarg[0] == '\0' || selection.num_selectors + selection.num_serial_args + selection.num_path_args == MAX_HEADSETS) {
+                    fprintf(stderr, "Usage: %s --serial SERIAL (at most %d times)\n", argv[0], MAX_HEADSETS);
+                    return 1;
+                }
+                selection.serial_args[selection.num_serial_args++] = optarg;
+            } else if (strcmp(opts[option_index].name, "inventory") == 0) {
+                inventory = 1;
+            } else if (strcmp(opts[option_index].name, "watch") == 0) {
+                watch = 1;
+
+                if (OPTIONAL_ARGUMENT_IS_PRESENT) {
+                    watch_dir = optarg;
+                }
+            } else if (strcmp(opts[option_index].name, "shm-read") == 0) {
+                shm_read = 1;
             }
             break;
         default:
@@ -819,41 +924,19 @@ int main(int argc, char* argv[])
     if (dev_mode) {
         // use +1 to make sure the first parameter is some previous argument (which normally would be the name of the program)
         return dev_main(argc - optind + 1, &argv[optind - 1]);
+    } else if (daemon_mode) {
+        return daemon_main(daemon_socket, test_device);
+    } else if (shm_read) {
+        return print_shared_status(output_format);
     } else {
         for (int index = optind; index < argc; index++)
             fprintf(stderr, "Non-option argument %s\n", argv[index]);
     }
 
-    // describes the headsetcontrol device, when a headset was found
-    static struct device device_found;
-
-    // Look for a supported device
-    int headset_available = find_device(&device_found, test_device);
-
-    if (should_print_help || should_print_help_all) {
-        if (headset_available == 0)
-            print_help(argv[0], &device_found, should_print_help_all);
-        else
-            print_help(argv[0], NULL, should_print_help_all);
-
-        return 0;
-    } else if (headset_available != 0) {
-        output(NULL, false, output_format);
-        return 1;
-    }
-
-    // We open connection to HID devices on demand
-    hid_device* device_handle = NULL;
-    char* hid_path            = NULL;
-
-    // Initialize signal handler for CTRL + C
-#ifdef _WIN32
-    signal(SIGINT, interruptHandler);
-#else
-    struct sigaction act;
-    act.sa_handler = interruptHandler;
-    sigaction(SIGINT, &act, NULL);
-#endif
+    // describe the headsetcontrol devices, when headsets were found
+    static struct device devices_found[MAX_HEADSETS];
+    struct device* device_found = &devices_found[0];
+    int num_found               = 0;
 
     FeatureRequest featureRequests[] = {
         { CAP_SIDETONE, CAPABILITYTYPE_ACTION, &sidetone_loudness, sidetone_loudness != -1, {} },
@@ -876,16 +959,89 @@ int main(int argc, char* argv[])
     assert(numFeatures == NUM_CAPABILITIES);
 
     // For specific output types, like YAML, we will do all actions - even when not specified - to aggreate all information
-    if (output_format == OUTPUT_YAML || output_format == OUTPUT_JSON || output_format == OUTPUT_ENV) {
-        for (int i = 0; i < numFeatures; i++) {
-            if (featureRequests[i].type == CAPABILITYTYPE_INFO && !featureRequests[i].should_process) {
-                if ((device_found.capabilities & B(featureRequests[i].cap)) == B(featureRequests[i].cap)) {
-                    featureRequests[i].should_process = true;
-                }
-            }
+    bool all_info = output_format == OUTPUT_YAML || output_format == OUTPUT_JSON || output_format == OUTPUT_ENV || output_format == OUTPUT_NDJSON
+        || output_format == OUTPUT_CBOR;
+
+    // the requests as given, every headset gets its own copy
+    FeatureRequest request_templates[NUM_CAPABILITIES];
+    memcpy(request_templates, featureRequests, sizeof(featureRequests));
+
+    // Several headsets are used at once with --all-devices, --device, --serial or --inventory
+    selection.multi_device = all_devices || inventory || selection.num_selectors + selection.num_serial_args + selection.num_path_args > 0;
+
+    // --watch keeps running, waiting for headsets to be connected
+    if (watch && (request_connected || inventory || follow)) {
+        fprintf(stderr, "--watch can't be combined with --connected, --inventory or --follow\n");
+        return 1;
+    }
+    if (watch && hotplug_open(watch_dir) != 0)
+        return 1;
+    follow = follow || watch;
+
+    // When a daemon is running, it owns the headset and processes the requests for us
+    bool use_daemon       = !no_daemon && !test_device && !selection.multi_device && !watch && !request_connected && !should_print_help && !should_print_help_all;
+    int headset_available = -1;
+
+    if (use_daemon) {
+        headset_available = daemon_client_request(featureRequests, numFeatures, all_info, device_found);
+        use_daemon        = headset_available >= 0;
+    }
+
+    // Look for supported devices
+    if (!use_daemon) {
+        num_found         = find_selected_devices(devices_found, &selection, test_device, true);
+        headset_available = num_found > 0 ? 0 : -1;
+    } else if (headset_available == 0) {
+        num_found = 1;
+    }
+
+    if (should_print_help || should_print_help_all) {
+        if (headset_available == 0)
+            print_help(argv[0], device_found, should_print_help_all);
+        else
+            print_help(argv[0], NULL, should_print_help_all);
+
+        return 0;
+    } else if (headset_available != 0 && !watch) {
+        output(NULL, false, output_format);
+        return 1;
+    }
+
+    // The inventory only lists what the enumeration told about the headsets
+    if (inventory) {
+        DeviceList deviceLists[MAX_HEADSETS];
+        for (int d = 0; d < num_found; d++) {
+            deviceLists[d].device          = &devices_found[d];
+            deviceLists[d].num_devices     = num_found;
+            deviceLists[d].featureRequests = NULL;
+            deviceLists[d].size            = 0;
         }
+        output(deviceLists, true, output_format);
+
+        terminate_hid(NULL, NULL);
+        return 0;
+    }
+
+    // We open connection to HID devices on demand, they are kept open by the connection pool
+    hid_device* device_handle = NULL;
+
+    // the requests of every headset, see prepare_requests()
+    static FeatureRequest device_requests[MAX_HEADSETS][NUM_CAPABILITIES];
+    FeatureRequest* requests[MAX_HEADSETS];
+    requests[0] = featureRequests;
+    for (int d = 1; d < MAX_HEADSETS; d++) {
+        requests[d] = device_requests[d];
     }
 
+    // Initialize signal handler for CTRL + C
+#ifdef _WIN32
+    signal(SIGINT, interruptHandler);
+#else
+    struct sigaction act;
+    act.sa_handler = interruptHandler;
+    sigaction(SIGINT, &act, NULL);
+#endif
+
     if (request_connected) {
         if (test_device) {
             printf("true\n");
@@ -897,19 +1053,20 @@ int main(int argc, char* argv[])
         // probably wired meaning it is connected
         int battery_error = 0;
 
-        if ((device_found.capabilities & B(CAP_BATTERY_STATUS)) == B(CAP_BATTERY_STATUS)) {
-            device_handle = dynamic_connect(&hid_path, device_handle, &device_found, CAP_BATTERY_STATUS);
+        if ((device_found->capabilities & B(CAP_BATTERY_STATUS)) == B(CAP_BATTERY_STATUS)) {
+            device_handle = dynamic_connect(device_found, CAP_BATTERY_STATUS);
             if (!device_handle)
                 return 1;
 
-            BatteryInfo info = device_found.request_battery(device_handle);
+            device_set_current(device_found);
+            BatteryInfo info = device_found->request_battery(device_handle);
 
             if (info.status != BATTERY_AVAILABLE) {
                 battery_error = 1;
             }
         }
 
-        terminate_hid(&device_handle, &hid_path);
+        terminate_hid(NULL, NULL);
 
         if (battery_error != 0) {
             printf("false\n");
@@ -920,42 +1077,136 @@ int main(int argc, char* argv[])
         }
     }
 
-    do {
+    // Headsets sending status reports on their own are followed without polling,
+    // printing only when something changed. Settings are re-applied every follow_sec
+    // by polling instead, the reports would only re-run them every resync_sec
+    bool follow_events = follow && !watch && !use_daemon && !test_device && num_found == 1 && device_found->parse_input_report != NULL
+        && only_status_requests(featureRequests, numFeatures);
+    unsigned resync_sec = follow_sec > FOLLOW_RESYNC_SEC ? follow_sec : FOLLOW_RESYNC_SEC;
+
+    // Otherwise every request is polled at its own pace, see poll_scheduler.h
+    bool follow_adaptive = follow && !watch && !use_daemon && !follow_events;
+    // fd -1: closed at the end also when the adaptive follow never started
+    static struct poll_scheduler scheduler = { .fd = -1 };
+    int due[MAX_HEADSETS];
+
+    static FeatureResult last_results[MAX_HEADSETS][NUM_CAPABILITIES];
+    for (int d = 0; d < MAX_HEADSETS; d++) {
         for (int i = 0; i < numFeatures; i++) {
-            if (featureRequests[i].should_process) {
-                // Assuming handle_feature now returns FeatureResult
-                featureRequests[i].result = handle_feature(&device_found, &device_handle, &hid_path, featureRequests[i].cap, featureRequests[i].param);
-            } else {
-                // Populate with a default "not processed" result
-                featureRequests[i].result.status  = FEATURE_NOT_PROCESSED;
-                featureRequests[i].result.message = strdup("Not processed");
-                featureRequests[i].result.value   = 0;
+            last_results[d][i].status = -1;
+        }
+    }
+
+    bool first_pass       = true;
+    bool poll_pass        = true;
+    bool interval_elapsed = false;
+
+    do {
+        if (use_daemon && !first_pass) {
+            int res = daemon_client_request(featureRequests, numFeatures, all_info, device_found);
+            if (res < 0) {
+                fprintf(stderr, "Lost connection to the daemon, continuing without it\n");
+                use_daemon = false;
+            } else if (res > 0) {
+                // the daemon lost the headset, report it and ask again later
+                output(NULL, false, output_format);
+                sleep(follow_sec);
+                continue;
+            }
+        }
+        bool adaptive_pass = follow_adaptive && !first_pass;
+        first_pass         = false;
+
+        if (use_daemon) {
+            // results were filled by the daemon
+            for (int i = 0; i < numFeatures; i++) {
+                if (!featureRequests[i].should_process) {
+                    featureRequests[i].result.status = FEATURE_NOT_PROCESSED;
+                    featureRequests[i].result.value  = 0;
+                    snprintf(featureRequests[i].result.message, sizeof(featureRequests[i].result.message), "Not processed");
+                }
+            }
+        } else if (poll_pass) {
+            // adaptive passes only run the requests due, the others keep their results
+            if (!adaptive_pass)
+                prepare_requests(requests, request_templates, numFeatures, devices_found, num_found, all_info);
+
+            // every headset is handled by its own thread
+            int pass_results[MAX_HEADSETS];
+            run_feature_passes(devices_found, requests, num_found, numFeatures, cache_ttl, adaptive_pass ? due : NULL, pass_results);
+
+            for (int d = 0; d < num_found; d++) {
+                if (pass_results[d] < 0)
+                    fprintf(stderr, "Failed to write the settings to the headset (%s)\n", devices_found[d].device_name);
+            }
+
+            if (follow_adaptive && !adaptive_pass)
+                poll_scheduler_init(&scheduler, requests, num_found, (int64_t)follow_sec * 1000);
+
+            for (int d = 0; d < num_found && follow_adaptive; d++) {
+                for (int i = 0; i < numFeatures; i++) {
+                    if (requests[d][i].should_process && (!adaptive_pass || (due[d] & B(requests[d][i].cap))))
+                        poll_scheduler_update(&scheduler, d, requests[d][i].cap, &requests[d][i].result);
+                }
             }
         }
 
-        DeviceList deviceList;
-        deviceList.device          = &device_found;
-        deviceList.num_devices     = 1;
-        deviceList.featureRequests = featureRequests;
-        deviceList.size            = numFeatures;
+        DeviceList deviceLists[MAX_HEADSETS];
+        for (int d = 0; d < num_found; d++) {
+            deviceLists[d].device          = &devices_found[d];
+            deviceLists[d].num_devices     = num_found;
+            deviceLists[d].featureRequests = requests[d];
+            deviceLists[d].size            = numFeatures;
+        }
 
-        output(&deviceList, print_capabilities != -1, output_format);
+        // polling prints every follow interval, -o ndjson only what changed
+        bool changed = (!follow_events && !follow_adaptive) || (interval_elapsed && output_format != OUTPUT_NDJSON);
+        // every headset remembers its results, so none is skipped
+        for (int d = 0; d < num_found; d++) {
+            changed = results_changed(requests[d], numFeatures, last_results[d]) || changed;
+        }
 
-        if (follow)
-            sleep(follow_sec);
+        // the daemon publishes what it runs itself
+        if (follow && !use_daemon)
+            status_shm_publish(devices_found, requests, num_found, numFeatures);
+
+        if (num_found == 0)
+            output(NULL, false, output_format);
+        else if (changed)
+            output(deviceLists, print_capabilities != -1, output_format);
+
+        if (follow) {
+            if (watch)
+                num_found = wait_for_headsets(devices_found, &selection, test_device);
+            else if (follow_events)
+                poll_pass = !follow_input_reports(device_found, featureRequests, numFeatures, follow_sec, resync_sec);
+            else if (follow_adaptive)
+                interval_elapsed = poll_scheduler_wait(&scheduler, due) == 1;
+            else
+                sleep(follow_sec);
+        }
 
     } while (follow);
 
-    // Free memory from features
-    for (int i = 0; i < numFeatures; i++) {
-        free(featureRequests[i].result.message);
-    }
-
     if (equalizer != NULL) {
         free(equalizer->bands_values);
     }
     free(equalizer);
 
-    terminate_hid(&device_handle, &hid_path);
+    if (print_stats) {
+        int lock_waits;
+        double lock_wait_ms = exchange_lock_wait_ms(&lock_waits);
+
+        fprintf(stderr, "Statistics: %d HID device opens\n", hid_pool_opens());
+        fprintf(stderr, "Statistics: waited %d times for other processes using the device, %.1f ms in total\n", lock_waits, lock_wait_ms);
+    }
+
+    status_cache_close();
+    status_shm_close();
+    hotplug_close();
+    poll_scheduler_close(&scheduler);
+
+    // Closes all pooled connections
+    terminate_hid(NULL, NULL);
     return 0;
 }
@@ -1,13 +1,23 @@
 #include "output.h"
+#include "feature.h"
 #include "utility.h"
 #include "version.h"
 
 #include <assert.h>
 #include <ctype.h>
 #include <hidapi.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <wchar.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <unistd.h>
+#endif
 
 const char* APIVERSION          = "1.2";
 const char* HEADSETCONTROL_NAME = "HeadsetControl";
@@ -55,8 +65,8 @@ const char* battery_status_to_string(enum battery_status status)
 static void addError(HeadsetInfo* info, const char* source, const char* message)
 {
     if (info->error_count < MAX_ERRORS) {
-        info->errors[info->error_count].source  = strdup(source);
-        info->errors[info->error_count].message = strdup(message);
+        info->errors[info->error_count].source  = source;
+        info->errors[info->error_count].message = message;
         info->error_count++;
     } else {
         fprintf(stderr, "Error: addError MAX_ERRORS exceeded\n");
@@ -72,7 +82,7 @@ static void addError(HeadsetInfo* info, const char* source, const char* message)
  * @param device Device name as string
  * @param status Status of the action
  * @param value Value of the action (not used currently)
- * @param error_message Error message if existing or NULL
+ * @param error_message Error message, empty if there is none
  */
 static void addAction(HeadsetInfo* info, enum capabilities capability, const char* device, Status status, int value, const char* error_message)
 {
@@ -81,14 +91,10 @@ static void addAction(HeadsetInfo* info, enum capabilities capability, const cha
     if (info->action_count < MAX_ACTIONS) {
         info->actions[info->action_count].capability     = capabilities_str_enum[capability];
         info->actions[info->action_count].capability_str = capabilities_str[capability];
-        info->actions[info->action_count].device         = strdup(device);
+        info->actions[info->action_count].device         = device;
         info->actions[info->action_count].status         = status;
         info->actions[info->action_count].value          = 0; // currently not used
-
-        if (error_message != NULL)
-            info->actions[info->action_count].error_message = strdup(error_message);
-        else
-            info->actions[info->action_count].error_message = NULL;
+        info->actions[info->action_count].error_message  = error_message[0] != '\0' ? error_message : NULL;
 
         info->action_count++;
     } else {
@@ -107,38 +113,20 @@ void output(DeviceList* deviceList, bool print_capabilities, OutputType output)
     int num_devices = deviceList ? deviceList->num_devices : 0;
 
     HeadsetControlStatus status = initializeStatus(num_devices);
-    HeadsetInfo* infos          = NULL;
-    if (num_devices > 0) {
-        infos = calloc(num_devices, sizeof(HeadsetInfo));
-    }
 
-    // Supress static analysis warning
-    assert((infos != NULL && status.device_count > 0) || (infos == NULL && status.device_count == 0));
+    // reused by every call, output runs again on every pass of --follow
+    static HeadsetInfo infos[MAX_HEADSETS];
+    assert(num_devices <= MAX_HEADSETS);
 
     // Iterate through all devices
     for (int deviceIndex = 0; deviceIndex < num_devices; deviceIndex++) {
+        memset(&infos[deviceIndex], 0, sizeof(HeadsetInfo));
         initializeHeadsetInfo(&infos[deviceIndex], deviceList[deviceIndex].device);
         processFeatureRequests(&infos[deviceIndex], deviceList[deviceIndex].featureRequests, deviceList[deviceIndex].size, deviceList[deviceIndex].device);
     }
 
     // Send all gathered information to respective output function
     outputByType(output, &status, infos, print_capabilities);
-
-    for (int i = 0; i < num_devices; i++) {
-        free(infos[i].idVendor);
-        free(infos[i].idProduct);
-
-        for (int j = 0; j < infos[i].error_count; j++) {
-            free(infos[i].errors[j].source);
-            free(infos[i].errors[j].message);
-        }
-
-        for (int j = 0; j < infos[i].action_count; j++) {
-            free(infos[i].actions[j].device);
-            free(infos[i].actions[j].error_message);
-        }
-    }
-    free(infos);
 }
 
 HeadsetControlStatus initializeStatus(int num_devices)
@@ -161,11 +149,12 @@ HeadsetControlStatus initializeStatus(int num_devices)
 void initializeHeadsetInfo(HeadsetInfo* info, struct device* device)
 {
     info->status = STATUS_SUCCESS;
-    _asprintf(&info->idVendor, "0x%04x", device->idVendor);
-    _asprintf(&info->idProduct, "0x%04x", device->idProduct);
-    info->device_name  = device->device_name;
-    info->vendor_name  = device->device_hid_vendorname;
-    info->product_name = device->device_hid_productname;
+    snprintf(info->idVendor, sizeof(info->idVendor), "0x%04x", device->idVendor);
+    snprintf(info->idProduct, sizeof(info->idProduct), "0x%04x", device->idProduct);
+    info->device_name   = device->device_name;
+    info->vendor_name   = device->device_hid_vendorname;
+    info->product_name  = device->device_hid_productname;
+    info->serial_number = device->device_hid_serialnumber;
 
     info->equalizer                  = device->equalizer;
     info->equalizer_presets          = device->eqaulizer_presets,
@@ -197,7 +186,7 @@ void processFeatureRequests(HeadsetInfo* info, FeatureRequest* featureRequests,
     for (int i = 0; i < size; i++) {
         FeatureRequest* request = &featureRequests[i];
         if (request->should_process) {
-            if (request->result.status == FEATURE_DEVICE_FAILED_OPEN) {
+            if (request->result.status == FEATURE_DEVICE_FAILED_OPEN || request->result.status == FEATURE_DEVICE_OFFLINE) {
                 addError(info, capabilities_str[request->cap], request->result.message);
             } else if (request->cap == CAP_BATTERY_STATUS) {
                 if (request->result.status == FEATURE_SUCCESS || request->result.status == FEATURE_INFO) {
@@ -236,6 +225,8 @@ void processFeatureRequests(HeadsetInfo* info, FeatureRequest* featureRequests,
 static void output_json(HeadsetControlStatus* status, HeadsetInfo* infos);
 static void output_yaml(HeadsetControlStatus* status, HeadsetInfo* infos);
 static void output_env(HeadsetControlStatus* status, HeadsetInfo* infos);
+static void output_ndjson(HeadsetControlStatus* status, HeadsetInfo* infos);
+static void output_cbor(HeadsetControlStatus* status, HeadsetInfo* infos);
 static void output_short(HeadsetControlStatus* status, HeadsetInfo* info, bool print_capabilities);
 static void output_standard(HeadsetControlStatus* status, HeadsetInfo* info, bool print_capabilities);
 
@@ -251,6 +242,12 @@ void outputByType(OutputType output, HeadsetControlStatus* status, HeadsetInfo*
     case OUTPUT_ENV:
         output_env(status, infos);
         break;
+    case OUTPUT_NDJSON:
+        output_ndjson(status, infos);
+        break;
+    case OUTPUT_CBOR:
+        output_cbor(status, infos);
+        break;
     case OUTPUT_STANDARD:
         output_standard(status, infos, print_capabilities);
         break;
@@ -260,284 +257,555 @@ void outputByType(OutputType output, HeadsetControlStatus* status, HeadsetInfo*
     }
 }
 
-void json_print_string(const char* str, int indent)
+/// Space reserved when rendering the first document, enough for several headsets
+#define OUTPUT_BUFFER_RESERVE (64 * 1024)
+
+/**
+ * JSON, YAML and ENV documents, and the lines of ndjson, are rendered into this
+ * buffer and written with a single write(). It grows as needed and is kept for
+ * the next document, so that the passes of --follow don't allocate.
+ */
+static struct {
+    char* data;
+    size_t len;
+    size_t size;
+} out = { NULL, 0, 0 };
+
+/// Writes what was rendered at once, after whatever stdio still buffers
+static void out_flush()
+{
+    fflush(stdout);
+
+#ifdef _WIN32
+    fwrite(out.data, 1, out.len, stdout);
+    fflush(stdout);
+#else
+    size_t written = 0;
+    while (written < out.len) {
+        ssize_t ret = write(STDOUT_FILENO, out.data + written, out.len - written);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            break;
+        written += (size_t)ret;
+    }
+#endif
+
+    out.len = 0;
+}
+
+/**
+ * @brief Makes room for another n bytes
+ *
+ * Writes out what was rendered so far when the buffer can't grow.
+ *
+ * @return false when there is still no room, the caller prints directly then
+ */
+static bool out_reserve(size_t n)
+{
+    if (out.size - out.len >= n)
+        return true;
+
+    size_t size = out.size ? out.size : OUTPUT_BUFFER_RESERVE;
+    while (size - out.len < n)
+        size *= 2;
+
+    char* data = realloc(out.data, size);
+    if (data) {
+        out.data = data;
+        out.size = size;
+        return true;
+    }
+
+    out_flush();
+    return out.size >= n;
+}
+
+static void out_write(const char* str, size_t n)
+{
+    if (!out_reserve(n)) {
+        fwrite(str, 1, n, stdout);
+        return;
+    }
+
+    memcpy(out.data + out.len, str, n);
+    out.len += n;
+}
+
+static void out_print(const char* str)
+{
+    out_write(str, strlen(str));
+}
+
+static void out_char(char c)
+{
+    if (out.len < out.size)
+        out.data[out.len++] = c;
+    else
+        out_write(&c, 1);
+}
+
+static void out_indent(int indent)
 {
-    for (int i = 0; i < indent; i++) {
-        putchar(' ');
+    if (indent <= 0)
+        return;
+
+    if (!out_reserve((size_t)indent)) {
+        printf("%*s", indent, "");
+        return;
     }
-    printf("\"%s\"", str);
+
+    memset(out.data + out.len, ' ', (size_t)indent);
+    out.len += (size_t)indent;
 }
 
-void json_printint_key_value(const char* key, int value, int indent)
+static void out_printf(const char* fmt, ...)
 {
-    for (int i = 0; i < indent; i++) {
-        putchar(' ');
+    size_t space = out.size - out.len;
+
+    va_list ap;
+    va_start(ap, fmt);
+    int ret = vsnprintf(space ? out.data + out.len : NULL, space, fmt, ap);
+    va_end(ap);
+
+    if (ret < 0)
+        return;
+
+    if ((size_t)ret < space) {
+        out.len += (size_t)ret;
+        return;
     }
-    printf("\"%s\": \"%d\"", key, value);
+
+    // rendered again once there is room
+    va_start(ap, fmt);
+    if (out_reserve((size_t)ret + 1)) {
+        vsnprintf(out.data + out.len, out.size - out.len, fmt, ap);
+        out.len += (size_t)ret;
+    } else {
+        vprintf(fmt, ap);
+    }
+    va_end(ap);
 }
 
-void json_print_key_value(const char* key, const char* value, int indent)
+/// Appends the characters of a JSON string, and of a YAML double-quoted scalar, which share these escapes
+static void out_json_escaped(const char* str, size_t len)
 {
-    for (int i = 0; i < indent; i++) {
-        putchar(' ');
+    const char* run = str;
+    const char* end = str + len;
+
+    for (const char* c = str; c < end; c++) {
+        unsigned char ch = (unsigned char)*c;
+        if (ch >= 0x20 && ch != 0x7f && ch != '"' && ch != '\\')
+            continue;
+
+        // the characters up to here need no escaping
+        out_write(run, (size_t)(c - run));
+        run = c + 1;
+
+        switch (ch) {
+        case '"':
+            out_write("\\\"", 2);
+            break;
+        case '\\':
+            out_write("\\\\", 2);
+            break;
+        case '\n':
+            out_write("\\n", 2);
+            break;
+        case '\r':
+            out_write("\\r", 2);
+            break;
+        case '\t':
+            out_write("\\t", 2);
+            break;
+        default:
+            out_printf("\\u%04x", ch);
+            break;
+        }
     }
-    printf("\"%s\": \"%s\"", key, value);
+
+    out_write(run, (size_t)(end - run));
 }
 
-void json_printw_key_value(const char* key, const wchar_t* value, int indent)
+/// Appends the characters of a double-quoted shell string
+static void out_env_escaped(const char* str, size_t len)
 {
-    for (int i = 0; i < indent; i++) {
-        putchar(' ');
+    const char* run = str;
+    const char* end = str + len;
+
+    for (const char* c = str; c < end; c++) {
+        if (*c != '"' && *c != '\\' && *c != '$' && *c != '`')
+            continue;
+
+        out_write(run, (size_t)(c - run));
+        out_char('\\');
+        run = c;
     }
-    printf("\"%s\": \"%ls\"", key, value);
+
+    out_write(run, (size_t)(end - run));
+}
+
+/**
+ * @brief Encodes the character at *str as UTF-8
+ *
+ * @param str advanced past the character (two of UTF-16)
+ * @param utf8 filled with up to 4 bytes
+ * @return number of bytes
+ */
+static size_t utf8_encode(const wchar_t** str, char* utf8)
+{
+    uint32_t c = (uint32_t)**str;
+
+#if WCHAR_MAX <= 0xFFFF
+    // UTF-16, where wchar_t has 16 bits (Windows)
+    if (c >= 0xD800 && c <= 0xDBFF && (*str)[1] >= 0xDC00 && (*str)[1] <= 0xDFFF) {
+        c = 0x10000 + ((c - 0xD800) << 10) + ((uint32_t)(*str)[1] - 0xDC00);
+        (*str)++;
+    }
+#endif
+    (*str)++;
+
+    if ((c >= 0xD800 && c <= 0xDFFF) || c > 0x10FFFF)
+        c = 0xFFFD;
+
+    if (c < 0x80) {
+        utf8[0] = (char)c;
+        return 1;
+    } else if (c < 0x800) {
+        utf8[0] = (char)(0xC0 | (c >> 6));
+        utf8[1] = (char)(0x80 | (c & 0x3F));
+        return 2;
+    } else if (c < 0x10000) {
+        utf8[0] = (char)(0xE0 | (c >> 12));
+        utf8[1] = (char)(0x80 | ((c >> 6) & 0x3F));
+        utf8[2] = (char)(0x80 | (c & 0x3F));
+        return 3;
+    }
+
+    utf8[0] = (char)(0xF0 | (c >> 18));
+    utf8[1] = (char)(0x80 | ((c >> 12) & 0x3F));
+    utf8[2] = (char)(0x80 | ((c >> 6) & 0x3F));
+    utf8[3] = (char)(0x80 | (c & 0x3F));
+    return 4;
+}
+
+/// Appends a wide string as UTF-8, independently of the locale, escaped by escape
+static void out_wide(const wchar_t* str, void (*escape)(const char*, size_t))
+{
+    char utf8[4];
+
+    while (str && *str) {
+        size_t len = utf8_encode(&str, utf8);
+        escape(utf8, len);
+    }
+}
+
+/// Length of a wide string in UTF-8
+static size_t utf8_length(const wchar_t* str)
+{
+    char utf8[4];
+    size_t len = 0;
+
+    while (str && *str)
+        len += utf8_encode(&str, utf8);
+
+    return len;
+}
+
+/// Appends a quoted JSON string, empty for NULL
+static void out_json_string(const char* str)
+{
+    out_char('"');
+    if (str)
+        out_json_escaped(str, strlen(str));
+    out_char('"');
+}
+
+static void out_json_wstring(const wchar_t* str)
+{
+    out_char('"');
+    out_wide(str, out_json_escaped);
+    out_char('"');
+}
+
+static void json_print_string(const char* str, int indent)
+{
+    out_indent(indent);
+    out_json_string(str);
+}
+
+static void json_printint_key_value(const char* key, int value, int indent)
+{
+    out_indent(indent);
+    out_json_string(key);
+    out_printf(": \"%d\"", value);
+}
+
+static void json_print_key_value(const char* key, const char* value, int indent)
+{
+    out_indent(indent);
+    out_json_string(key);
+    out_print(": ");
+    out_json_string(value);
+}
+
+static void json_printw_key_value(const char* key, const wchar_t* value, int indent)
+{
+    out_indent(indent);
+    out_json_string(key);
+    out_print(": ");
+    out_json_wstring(value);
+}
+
+/// Actions of all devices, reported together
+static int total_action_count(HeadsetControlStatus* status, HeadsetInfo* infos)
+{
+    int count = 0;
+    for (int i = 0; i < status->device_count; i++)
+        count += infos[i].action_count;
+    return count;
 }
 
 void output_json(HeadsetControlStatus* status, HeadsetInfo* infos)
 {
-    printf("{\n");
+    out_print("{\n");
 
     json_print_key_value("name", status->name, 2);
-    printf(",\n");
+    out_print(",\n");
     json_print_key_value("version", status->version, 2);
-    printf(",\n");
+    out_print(",\n");
     json_print_key_value("api_version", status->api_version, 2);
-    printf(",\n");
+    out_print(",\n");
     json_print_key_value("hidapi_version", status->hid_version, 2);
-    printf(",\n");
-
-    if (infos && infos->action_count > 0) {
-        printf("  \"actions\": [\n");
-        for (int i = 0; i < infos->action_count; i++) {
-            printf("    {\n");
-
-            json_print_key_value("capability", infos->actions[i].capability, 6);
-            printf(",\n");
-            json_print_key_value("device", infos->actions[i].device, 6);
-            printf(",\n");
-            json_print_key_value("status", status_to_string(infos->actions[i].status), 6);
-
-            if (infos->actions[i].value > 0) {
-                printf(",\n");
-                json_printint_key_value("value", infos->actions[i].value, 6);
-            }
+    out_print(",\n");
+
+    int action_count = total_action_count(status, infos);
+    if (action_count > 0) {
+        out_print("  \"actions\": [\n");
+        int printed = 0;
+        for (int d = 0; d < status->device_count; d++) {
+            Action* actions = infos[d].actions;
+
+            for (int i = 0; i < infos[d].action_count; i++) {
+                out_print("    {\n");
+
+                json_print_key_value("capability", actions[i].capability, 6);
+                out_print(",\n");
+                json_print_key_value("device", actions[i].device, 6);
+                out_print(",\n");
+                json_print_key_value("status", status_to_string(actions[i].status), 6);
+
+                if (actions[i].value > 0) {
+                    out_print(",\n");
+                    json_printint_key_value("value", actions[i].value, 6);
+                }
 
-            if (infos->actions[i].error_message != NULL && strlen(infos->actions[i].error_message) > 0) {
-                printf(",\n");
-                json_print_key_value("error_message", infos->actions[i].error_message, 6);
-            }
+                if (actions[i].error_message != NULL && strlen(actions[i].error_message) > 0) {
+                    out_print(",\n");
+                    json_print_key_value("error_message", actions[i].error_message, 6);
+                }
 
-            printf("\n    }");
-            if (i < infos->action_count - 1) {
-                printf(",\n");
+                out_print("\n    }");
+                if (++printed < action_count) {
+                    out_print(",\n");
+                }
             }
         }
-        printf("\n  ],\n");
+        out_print("\n  ],\n");
     }
 
     // For integers, direct printing is still simplest
-    printf("  \"device_count\": %d,\n", status->device_count);
+    out_printf("  \"device_count\": %d,\n", status->device_count);
 
-    printf("  \"devices\": [\n");
+    out_print("  \"devices\": [\n");
     for (int i = 0; i < status->device_count; i++) {
         HeadsetInfo* info = &infos[i];
-        printf("    {\n");
+        out_print("    {\n");
 
         json_print_key_value("status", status_to_string(info->status), 6);
-        printf(",\n");
+        out_print(",\n");
         json_print_key_value("device", info->device_name, 6);
-        printf(",\n");
+        out_print(",\n");
         json_printw_key_value("vendor", info->vendor_name, 6);
-        printf(",\n");
+        out_print(",\n");
         json_printw_key_value("product", info->product_name, 6);
-        printf(",\n");
+        out_print(",\n");
+        json_printw_key_value("serial_number", info->serial_number, 6);
+        out_print(",\n");
         json_print_key_value("id_vendor", info->idVendor, 6);
-        printf(",\n");
+        out_print(",\n");
         json_print_key_value("id_product", info->idProduct, 6);
-        printf(",\n");
+        out_print(",\n");
 
-        printf("      \"capabilities\": [\n");
+        out_print("      \"capabilities\": [\n");
         for (int j = 0; j < info->capabilities_amount; j++) {
             json_print_string(info->capabilities[j], 8);
             if (j < info->capabilities_amount - 1) {
-                printf(", ");
+                out_print(", ");
             }
-            printf("\n");
+            out_char('\n');
         }
-        printf("      ],\n");
+        out_print("      ],\n");
 
-        printf("      \"capabilities_str\": [\n");
+        out_print("      \"capabilities_str\": [\n");
         for (int j = 0; j < info->capabilities_amount; j++) {
             json_print_string(info->capabilities_str[j], 8);
             if (j < info->capabilities_amount - 1) {
-                printf(", ");
+                out_print(", ");
             }
-            printf("\n");
+            out_char('\n');
         }
-        printf("      ]");
+        out_print("      ]");
 
         if (info->has_battery_info) {
-            printf(",\n      \"battery\": {\n");
+            out_print(",\n      \"battery\": {\n");
             json_print_key_value("status", battery_status_to_string(info->battery_status), 8);
-            printf(",\n");
-            printf("        \"level\": %d\n", info->battery_level);
-            printf("      }");
+            out_print(",\n");
+            out_printf("        \"level\": %d\n", info->battery_level);
+            out_print("      }");
         }
 
         if (info->has_equalizer_info) {
-            printf(",\n      \"equalizer\": {\n");
-            printf("        \"bands\": %d,\n", info->equalizer->bands_count);
-            printf("        \"baseline\": %d,\n", info->equalizer->bands_baseline);
-            printf("        \"step\": %.1f,\n", info->equalizer->bands_step);
-            printf("        \"min\": %d,\n", info->equalizer->bands_min);
-            printf("        \"max\": %d\n", info->equalizer->bands_max);
-            printf("      }");
+            out_print(",\n      \"equalizer\": {\n");
+            out_printf("        \"bands\": %d,\n", info->equalizer->bands_count);
+            out_printf("        \"baseline\": %d,\n", info->equalizer->bands_baseline);
+            out_printf("        \"step\": %.1f,\n", info->equalizer->bands_step);
+            out_printf("        \"min\": %d,\n", info->equalizer->bands_min);
+            out_printf("        \"max\": %d\n", info->equalizer->bands_max);
+            out_print("      }");
 
             if (info->has_equalizer_presets_info) {
-                printf(",\n      \"equalizer_presets_count\": %d", info->equalizer_presets->count);
-                printf(",\n      \"equalizer_presets\": {\n");
+                out_printf(",\n      \"equalizer_presets_count\": %d", info->equalizer_presets->count);
+                out_print(",\n      \"equalizer_presets\": {\n");
                 for (int i = 0; i < info->equalizer_presets->count; i++) {
                     EqualizerPreset* presets = info->equalizer_presets->presets;
-                    printf("        \"%s\": [ ", presets[i].name);
+                    json_print_string(presets[i].name, 8);
+                    out_print(": [ ");
                     for (int j = 0; j < info->equalizer->bands_count; j++) {
-                        printf("%.1f", presets[i].values[j]);
+                        out_printf("%.1f", presets[i].values[j]);
                         if (j < info->equalizer->bands_count - 1)
-                            printf(", ");
+                            out_print(", ");
                     }
-                    printf(" ]");
+                    out_print(" ]");
                     if (i < info->equalizer_presets->count - 1)
-                        printf(",\n");
+                        out_print(",\n");
                 }
-                printf("\n      }");
+                out_print("\n      }");
             }
         }
 
         if (info->has_chatmix_info) {
-            printf(",\n      \"chatmix\": %d", info->chatmix);
+            out_printf(",\n      \"chatmix\": %d", info->chatmix);
         }
 
         // Start of errors object
         if (info->error_count > 0) {
-            printf(",\n      \"errors\": {\n");
+            out_print(",\n      \"errors\": {\n");
             for (int j = 0; j < info->error_count; ++j) {
                 json_print_key_value(info->errors[j].source, info->errors[j].message, 8);
                 if (j < info->error_count - 1) {
-                    printf(",\n");
+                    out_print(",\n");
                 }
             }
-            printf("\n      }"); // End of errors object
+            out_print("\n      }"); // End of errors object
         }
 
-        printf("\n    }"); // Close the device object
+        out_print("\n    }"); // Close the device object
         if (i < status->device_count - 1) {
-            printf(",\n");
+            out_print(",\n");
         }
     }
-    printf("\n  ]\n"); // Close the devices array
-    printf("}\n"); // Close the JSON object
-}
-
-static const char* yaml_replace_spaces_with_dash(const char* str);
+    out_print("\n  ]\n"); // Close the devices array
+    out_print("}\n"); // Close the JSON object
 
-void yaml_print(const char* key, const char* value, int indent)
-{
-    for (int i = 0; i < indent; i++) {
-        putchar(' ');
-    }
-    if (strlen(value) == 0)
-        printf("%s:\n", yaml_replace_spaces_with_dash(key));
-    else
-        printf("%s: \"%s\"\n", yaml_replace_spaces_with_dash(key), value);
+    out_flush();
 }
 
-void yaml_printw(const char* key, const wchar_t* value, int indent)
+/// Appends a key, with dashes instead of spaces (but the one after the dash starting a list item)
+static void out_yaml_key(const char* key)
 {
-    for (int i = 0; i < indent; i++) {
-        putchar(' ');
+    size_t len = strlen(key);
+    if (!out_reserve(len)) {
+        printf("%s", key);
+        return;
     }
 
-    printf("%s: \"%ls\"\n", yaml_replace_spaces_with_dash(key), value);
+    for (size_t i = 0; i < len; i++)
+        out.data[out.len++] = key[i] == ' ' && !(i == 1 && key[0] == '-') ? '-' : key[i];
 }
 
-void yaml_printint(const char* key, const int value, int indent)
+static void yaml_print(const char* key, const char* value, int indent)
 {
-    for (int i = 0; i < indent; i++) {
-        putchar(' ');
+    out_indent(indent);
+    out_yaml_key(key);
+
+    if (value == NULL || strlen(value) == 0) {
+        out_print(":\n");
+    } else {
+        out_print(": \"");
+        out_json_escaped(value, strlen(value));
+        out_print("\"\n");
     }
-    printf("%s: %d\n", yaml_replace_spaces_with_dash(key), value);
 }
 
-const char* yaml_replace_spaces_with_dash(const char* str)
+static void yaml_printw(const char* key, const wchar_t* value, int indent)
 {
-    assert(strlen(str) < 64 && "replace_spaces_with_dash: too long");
-
-    static char result[64];
-    int i = 0;
-    while (str[i] != '\0') {
-        // replace if space, and dont replace the space when a list started with dash
-        if (str[i] == ' ' && !(i == 1 && str[0] == '-')) {
-            result[i] = '-';
-        } else {
-            result[i] = str[i];
-        }
-        i++;
-    }
-    result[i] = '\0';
-    return result;
+    out_indent(indent);
+    out_yaml_key(key);
+    out_print(": \"");
+    out_wide(value, out_json_escaped);
+    out_print("\"\n");
 }
 
-void yaml_print_listitem(const char* value, int indent, bool newline)
+static void yaml_printint(const char* key, const int value, int indent)
 {
-    if (newline) {
-        for (int i = 0; i < indent; i++) {
-            putchar(' ');
-        }
-    }
+    out_indent(indent);
+    out_yaml_key(key);
+    out_printf(": %d\n", value);
+}
 
-    printf("- %s", value);
+static void yaml_print_listitem(const char* value, int indent, bool newline)
+{
+    if (newline)
+        out_indent(indent);
 
-    if (newline) {
-        putchar('\n');
-    } else {
-        putchar(' ');
-    }
+    out_print("- ");
+    out_print(value);
+    out_char(newline ? '\n' : ' ');
 }
 
-void yaml_print_listitemfloat(const float value, int indent, bool newline)
+static void yaml_print_listitemfloat(const float value, int indent, bool newline)
 {
-    if (newline) {
-        for (int i = 0; i < indent; i++) {
-            putchar(' ');
-        }
-    }
+    if (newline)
+        out_indent(indent);
 
-    printf("- %.1f", value);
-
-    if (newline) {
-        putchar('\n');
-    } else {
-        putchar(' ');
-    }
+    out_printf("- %.1f", value);
+    out_char(newline ? '\n' : ' ');
 }
 
 void output_yaml(HeadsetControlStatus* status, HeadsetInfo* infos)
 {
-    printf("---\n");
+    out_print("---\n");
     yaml_print("name", status->name, 0);
     yaml_print("version", status->version, 0);
     yaml_print("api_version", status->api_version, 0);
     yaml_print("hidapi_version", status->hid_version, 0);
 
-    if (infos && infos->action_count > 0) {
+    if (total_action_count(status, infos) > 0) {
         yaml_print("actions", "", 0);
 
-        for (int i = 0; i < infos->action_count; i++) {
-            yaml_print("- capability", infos->actions[i].capability, 2);
-            yaml_print("device", infos->actions[i].device, 4);
-            yaml_print("status", status_to_string(infos->actions[i].status), 4);
-            if (infos->actions[i].value > 0)
-                yaml_printint("value", infos->actions[i].value, 4);
-            if (infos->actions[i].error_message != NULL && strlen(infos->actions[i].error_message) > 0) {
-                yaml_print("error_message", infos->actions[i].error_message, 4);
+        for (int d = 0; d < status->device_count; d++) {
+            Action* actions = infos[d].actions;
+
+            for (int i = 0; i < infos[d].action_count; i++) {
+                yaml_print("- capability", actions[i].capability, 2);
+                yaml_print("device", actions[i].device, 4);
+                yaml_print("status", status_to_string(actions[i].status), 4);
+                if (actions[i].value > 0)
+                    yaml_printint("value", actions[i].value, 4);
+                if (actions[i].error_message != NULL && strlen(actions[i].error_message) > 0) {
+                    yaml_print("error_message", actions[i].error_message, 4);
+                }
             }
         }
     }
@@ -553,6 +821,7 @@ void output_yaml(HeadsetControlStatus* status, HeadsetInfo* infos)
         yaml_print("device", info->device_name, 4);
         yaml_printw("vendor", info->vendor_name, 4);
         yaml_printw("product", info->product_name, 4);
+        yaml_printw("serial_number", info->serial_number, 4);
         yaml_print("id_vendor", info->idVendor, 4);
         yaml_print("id_product", info->idProduct, 4);
 
@@ -589,13 +858,11 @@ void output_yaml(HeadsetControlStatus* status, HeadsetInfo* infos)
                     yaml_print_listitem(presets[i].name, 6, true);
 
                     // Spaces for the list
-                    for (int i = 0; i < 8; i++) {
-                        putchar(' ');
-                    }
+                    out_indent(8);
                     for (int j = 0; j < info->equalizer->bands_count; j++) {
                         yaml_print_listitemfloat(presets[i].values[j], 8, false);
                     }
-                    putchar('\n');
+                    out_char('\n');
                 }
             }
         }
@@ -611,39 +878,44 @@ void output_yaml(HeadsetControlStatus* status, HeadsetInfo* infos)
             }
         }
     }
-}
 
-static const char* env_format_key(const char* str);
+    out_flush();
+}
 
-void env_print(const char* key, const char* value)
+/// Appends a variable name, upper case and with underscores instead of spaces and dashes
+static void out_env_key(const char* key)
 {
-    printf("%s=\"%s\"\n", env_format_key(key), value);
+    size_t len = strlen(key);
+    if (!out_reserve(len)) {
+        printf("%s", key);
+        return;
+    }
+
+    for (size_t i = 0; i < len; i++)
+        out.data[out.len++] = key[i] == ' ' || key[i] == '-' ? '_' : (char)toupper((unsigned char)key[i]);
 }
 
-void env_printw(const char* key, const wchar_t* value)
+static void env_print(const char* key, const char* value)
 {
-    printf("%s=\"%ls\"\n", env_format_key(key), value);
+    out_env_key(key);
+    out_print("=\"");
+    if (value)
+        out_env_escaped(value, strlen(value));
+    out_print("\"\n");
 }
 
-void env_printint(const char* key, const int value)
+static void env_printw(const char* key, const wchar_t* value)
 {
-    printf("%s=%d\n", env_format_key(key), value);
+    out_env_key(key);
+    out_print("=\"");
+    out_wide(value, out_env_escaped);
+    out_print("\"\n");
 }
 
-const char* env_format_key(const char* str)
+static void env_printint(const char* key, const int value)
 {
-    static char result[128];
-    int i = 0, j = 0;
-    while (str[i] != '\0' && j < (int)(sizeof(result) - 1)) {
-        if (str[i] == ' ' || str[i] == '-') {
-            result[j++] = '_';
-        } else {
-            result[j++] = (unsigned char)toupper((unsigned char)str[i]);
-        }
-        i++;
-    }
-    result[j] = '\0';
-    return result;
+    out_env_key(key);
+    out_printf("=%d\n", value);
 }
 
 void output_env(HeadsetControlStatus* status, HeadsetInfo* infos)
@@ -653,33 +925,34 @@ void output_env(HeadsetControlStatus* status, HeadsetInfo* infos)
     env_print("HEADSETCONTROL_API_VERSION", status->api_version);
     env_print("HEADSETCONTROL_HIDAPI_VERSION", status->hid_version);
 
-    if (infos) {
-        env_printint("ACTION_COUNT", infos->action_count);
-        for (int i = 0; i < infos->action_count; i++) {
+    env_printint("ACTION_COUNT", total_action_count(status, infos));
+    int action_index = 0;
+    for (int d = 0; d < status->device_count; d++) {
+        Action* actions = infos[d].actions;
+
+        for (int i = 0; i < infos[d].action_count; i++) {
             char prefix[64];
-            sprintf(prefix, "ACTION_%d", i);
+            sprintf(prefix, "ACTION_%d", action_index++);
 
             char key[128];
 
             sprintf(key, "%s_CAPABILITY", prefix);
-            env_print(key, infos->actions[i].capability);
+            env_print(key, actions[i].capability);
             sprintf(key, "%s_DEVICE", prefix);
-            env_print(key, infos->actions[i].device);
+            env_print(key, actions[i].device);
             sprintf(key, "%s_STATUS", prefix);
-            env_print(key, status_to_string(infos->actions[i].status));
+            env_print(key, status_to_string(actions[i].status));
 
-            if (infos->actions[i].value > 0) {
+            if (actions[i].value > 0) {
                 sprintf(key, "%s_VALUE", prefix);
-                env_printint(key, infos->actions[i].value);
+                env_printint(key, actions[i].value);
             }
 
-            if (infos->actions[i].error_message != NULL && strlen(infos->actions[i].error_message) > 0) {
+            if (actions[i].error_message != NULL && strlen(actions[i].error_message) > 0) {
                 sprintf(key, "%s_ERROR_MESSAGE", prefix);
-                env_print(key, infos->actions[i].error_message);
+                env_print(key, actions[i].error_message);
             }
         }
-    } else {
-        env_printint("ACTION_COUNT", 0);
     }
 
     env_printint("DEVICE_COUNT", status->device_count);
@@ -691,6 +964,8 @@ void output_env(HeadsetControlStatus* status, HeadsetInfo* infos)
         env_print(prefix, info->device_name);
 
         char key[128];
+        sprintf(key, "%s_SERIAL_NUMBER", prefix);
+        env_printw(key, info->serial_number);
         sprintf(key, "%s_CAPABILITIES_AMOUNT", prefix);
         env_printint(key, info->capabilities_amount);
         for (int j = 0; j < info->capabilities_amount; j++) {
@@ -722,6 +997,432 @@ void output_env(HeadsetControlStatus* status, HeadsetInfo* infos)
             env_print(key, info->errors[j].message);
         }
     }
+
+    out_flush();
+}
+
+/// Major types of CBOR (RFC 8949)
+#define CBOR_UNSIGNED 0
+#define CBOR_NEGATIVE 1
+#define CBOR_TEXT 3
+#define CBOR_ARRAY 4
+#define CBOR_MAP 5
+#define CBOR_SIMPLE 7
+
+#define CBOR_FLOAT32 26
+
+/// Appends the head of a data item, with its argument in the shortest form
+static void cbor_head(uint8_t major, uint64_t argument)
+{
+    char head[9];
+    size_t len;
+
+    if (argument < 24) {
+        head[0] = (char)(major << 5 | argument);
+        len     = 1;
+    } else if (argument <= UINT8_MAX) {
+        head[0] = (char)(major << 5 | 24);
+        len     = 2;
+    } else if (argument <= UINT16_MAX) {
+        head[0] = (char)(major << 5 | 25);
+        len     = 3;
+    } else if (argument <= UINT32_MAX) {
+        head[0] = (char)(major << 5 | 26);
+        len     = 5;
+    } else {
+        head[0] = (char)(major << 5 | 27);
+        len     = 9;
+    }
+
+    // big endian
+    for (size_t i = len - 1; i > 0; i--) {
+        head[i] = (char)(argument & 0xFF);
+        argument >>= 8;
+    }
+
+    out_write(head, len);
+}
+
+static void cbor_int(int64_t value)
+{
+    if (value >= 0)
+        cbor_head(CBOR_UNSIGNED, (uint64_t)value);
+    else
+        cbor_head(CBOR_NEGATIVE, (uint64_t)(-1 - value));
+}
+
+/// Appends a text string, empty for NULL
+static void cbor_text(const char* str)
+{
+    size_t len = str ? strlen(str) : 0;
+    cbor_head(CBOR_TEXT, len);
+    out_write(str, len);
+}
+
+static void cbor_wtext(const wchar_t* str)
+{
+    cbor_head(CBOR_TEXT, utf8_length(str));
+    out_wide(str, out_write);
+}
+
+static void cbor_float(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    char item[5] = { (char)(CBOR_SIMPLE << 5 | CBOR_FLOAT32), (char)(bits >> 24), (char)(bits >> 16), (char)(bits >> 8), (char)bits };
+    out_write(item, sizeof(item));
+}
+
+static void cbor_key_text(const char* key, const char* value)
+{
+    cbor_text(key);
+    cbor_text(value);
+}
+
+static void cbor_key_int(const char* key, int64_t value)
+{
+    cbor_text(key);
+    cbor_int(value);
+}
+
+/**
+ * @brief Prints the same document as output_json(), as CBOR
+ *
+ * Numbers are integers and floats instead of strings, e.g. the value of an
+ * action, and the vendor and product ids. Maps and arrays have definite
+ * lengths. With --follow, the documents form a CBOR sequence (RFC 8742).
+ */
+void output_cbor(HeadsetControlStatus* status, HeadsetInfo* infos)
+{
+    int action_count = total_action_count(status, infos);
+
+    cbor_head(CBOR_MAP, action_count > 0 ? 7 : 6);
+
+    cbor_key_text("name", status->name);
+    cbor_key_text("version", status->version);
+    cbor_key_text("api_version", status->api_version);
+    cbor_key_text("hidapi_version", status->hid_version);
+
+    if (action_count > 0) {
+        cbor_text("actions");
+        cbor_head(CBOR_ARRAY, (uint64_t)action_count);
+
+        for (int d = 0; d < status->device_count; d++) {
+            Action* actions = infos[d].actions;
+
+            for (int i = 0; i < infos[d].action_count; i++) {
+                bool has_value         = actions[i].value > 0;
+                bool has_error_message = actions[i].error_message != NULL && strlen(actions[i].error_message) > 0;
+
+                cbor_head(CBOR_MAP, 3 + has_value + has_error_message);
+                cbor_key_text("capability", actions[i].capability);
+                cbor_key_text("device", actions[i].device);
+                cbor_key_text("status", status_to_string(actions[i].status));
+
+                if (has_value)
+                    cbor_key_int("value", actions[i].value);
+
+                if (has_error_message)
+                    cbor_key_text("error_message", actions[i].error_message);
+            }
+        }
+    }
+
+    cbor_key_int("device_count", status->device_count);
+
+    cbor_text("devices");
+    cbor_head(CBOR_ARRAY, (uint64_t)status->device_count);
+    for (int i = 0; i < status->device_count; i++) {
+        HeadsetInfo* info = &infos[i];
+
+        bool has_presets = info->has_equalizer_info && info->has_equalizer_presets_info;
+        cbor_head(CBOR_MAP, 9 + info->has_battery_info + info->has_equalizer_info + 2 * has_presets + info->has_chatmix_info + (info->error_count > 0));
+
+        cbor_key_text("status", status_to_string(info->status));
+        cbor_key_text("device", info->device_name);
+        cbor_text("vendor");
+        cbor_wtext(info->vendor_name);
+        cbor_text("product");
+        cbor_wtext(info->product_name);
+        cbor_text("serial_number");
+        cbor_wtext(info->serial_number);
+        cbor_key_int("id_vendor", strtol(info->idVendor, NULL, 16));
+        cbor_key_int("id_product", strtol(info->idProduct, NULL, 16));
+
+        cbor_text("capabilities");
+        cbor_head(CBOR_ARRAY, (uint64_t)info->capabilities_amount);
+        for (int j = 0; j < info->capabilities_amount; j++)
+            cbor_text(info->capabilities[j]);
+
+        cbor_text("capabilities_str");
+        cbor_head(CBOR_ARRAY, (uint64_t)info->capabilities_amount);
+        for (int j = 0; j < info->capabilities_amount; j++)
+            cbor_text(info->capabilities_str[j]);
+
+        if (info->has_battery_info) {
+            cbor_text("battery");
+            cbor_head(CBOR_MAP, 2);
+            cbor_key_text("status", battery_status_to_string(info->battery_status));
+            cbor_key_int("level", info->battery_level);
+        }
+
+        if (info->has_equalizer_info) {
+            cbor_text("equalizer");
+            cbor_head(CBOR_MAP, 5);
+            cbor_key_int("bands", info->equalizer->bands_count);
+            cbor_key_int("baseline", info->equalizer->bands_baseline);
+            cbor_text("step");
+            cbor_float(info->equalizer->bands_step);
+            cbor_key_int("min", info->equalizer->bands_min);
+            cbor_key_int("max", info->equalizer->bands_max);
+
+            if (has_presets) {
+                cbor_key_int("equalizer_presets_count", info->equalizer_presets->count);
+                cbor_text("equalizer_presets");
+                cbor_head(CBOR_MAP, (uint64_t)info->equalizer_presets->count);
+                for (int j = 0; j < info->equalizer_presets->count; j++) {
+                    EqualizerPreset* presets = info->equalizer_presets->presets;
+
+                    cbor_text(presets[j].name);
+                    cbor_head(CBOR_ARRAY, (uint64_t)info->equalizer->bands_count);
+                    for (int k = 0; k < info->equalizer->bands_count; k++)
+                        cbor_float(presets[j].values[k]);
+                }
+            }
+        }
+
+        if (info->has_chatmix_info)
+            cbor_key_int("chatmix", info->chatmix);
+
+        if (info->error_count > 0) {
+            cbor_text("errors");
+            cbor_head(CBOR_MAP, (uint64_t)info->error_count);
+            for (int j = 0; j < info->error_count; j++)
+                cbor_key_text(info->errors[j].source, info->errors[j].message);
+        }
+    }
+
+    out_flush();
+}
+
+/// State of a capability as printed last
+struct ndjson_value {
+    enum {
+        NDJSON_UNKNOWN,
+        NDJSON_BATTERY,
+        NDJSON_CHATMIX,
+        NDJSON_SUCCESS,
+        NDJSON_ERROR
+    } kind;
+    int status;
+    int value;
+    char message[FEATURE_MESSAGE_SIZE];
+};
+
+/// A headset as printed last, to print only what changed
+struct ndjson_device {
+    bool present;
+    char device_name[64];
+    char idVendor[8];
+    char idProduct[8];
+    wchar_t serial_number[64];
+    /// Which of the headsets with the same ids and serial number
+    int instance;
+    struct ndjson_value values[NUM_CAPABILITIES];
+};
+
+static struct ndjson_device ndjson_devices[MAX_HEADSETS];
+
+static void ndjson_print_value(const struct ndjson_value* value)
+{
+    switch (value->kind) {
+    case NDJSON_BATTERY:
+        out_printf("{\"status\":\"%s\",\"level\":%d}", battery_status_to_string((enum battery_status)value->status), value->value);
+        break;
+    case NDJSON_CHATMIX:
+        out_printf("%d", value->value);
+        break;
+    case NDJSON_SUCCESS:
+        out_printf("\"%s\"", status_to_string(STATUS_SUCCESS));
+        break;
+    case NDJSON_ERROR:
+        out_print("{\"error\":");
+        out_json_string(value->message);
+        out_char('}');
+        break;
+    case NDJSON_UNKNOWN:
+    default:
+        out_print("null");
+        break;
+    }
+}
+
+static bool ndjson_value_equal(const struct ndjson_value* a, const struct ndjson_value* b)
+{
+    return a->kind == b->kind && a->status == b->status && a->value == b->value
+        && (a->kind != NDJSON_ERROR || strcmp(a->message, b->message) == 0);
+}
+
+static enum capabilities capability_of_str(const char* const* names, const char* name)
+{
+    for (int i = 0; i < NUM_CAPABILITIES; i++) {
+        if (strcmp(names[i], name) == 0)
+            return (enum capabilities)i;
+    }
+
+    return NUM_CAPABILITIES;
+}
+
+static void ndjson_set_error(struct ndjson_value* value, const char* message)
+{
+    value->kind = NDJSON_ERROR;
+    snprintf(value->message, sizeof(value->message), "%s", message ? message : "");
+}
+
+/// Takes the state of every capability from the information of a headset
+static void ndjson_values(const HeadsetInfo* info, struct ndjson_value* values)
+{
+    memset(values, 0, NUM_CAPABILITIES * sizeof(struct ndjson_value));
+
+    if (info->has_battery_info) {
+        values[CAP_BATTERY_STATUS].kind   = NDJSON_BATTERY;
+        values[CAP_BATTERY_STATUS].status = info->battery_status;
+        values[CAP_BATTERY_STATUS].value  = info->battery_level;
+    }
+
+    if (info->has_chatmix_info) {
+        values[CAP_CHATMIX_STATUS].kind  = NDJSON_CHATMIX;
+        values[CAP_CHATMIX_STATUS].value = info->chatmix;
+    }
+
+    for (int j = 0; j < info->action_count; j++) {
+        enum capabilities cap = capability_of_str(capabilities_str_enum, info->actions[j].capability);
+        if (cap == NUM_CAPABILITIES)
+            continue;
+
+        if (info->actions[j].status == STATUS_SUCCESS)
+            values[cap].kind = NDJSON_SUCCESS;
+        else
+            ndjson_set_error(&values[cap], info->actions[j].error_message);
+    }
+
+    for (int j = 0; j < info->error_count; j++) {
+        enum capabilities cap = capability_of_str(capabilities_str, info->errors[j].source);
+        if (cap != NUM_CAPABILITIES)
+            ndjson_set_error(&values[cap], info->errors[j].message);
+    }
+}
+
+/// Starts the line of an event, up to the old value
+static void ndjson_begin(const char* timestamp, const struct ndjson_device* device, const char* capability)
+{
+    out_printf("{\"timestamp\":\"%s\",\"device\":", timestamp);
+    out_json_string(device->device_name);
+    out_printf(",\"id_vendor\":\"%s\",\"id_product\":\"%s\",\"serial_number\":", device->idVendor, device->idProduct);
+    out_json_wstring(device->serial_number);
+    out_printf(",\"capability\":\"%s\",\"old\":", capability);
+}
+
+/// Ends the line and writes it at once, so that lines of concurrent writers don't mix
+static void ndjson_end()
+{
+    out_print("}\n");
+    out_flush();
+}
+
+static void ndjson_event(const char* timestamp, const struct ndjson_device* device, const char* capability, const struct ndjson_value* old_value, const struct ndjson_value* new_value)
+{
+    ndjson_begin(timestamp, device, capability);
+    ndjson_print_value(old_value);
+    out_print(",\"new\":");
+    ndjson_print_value(new_value);
+    ndjson_end();
+}
+
+/// Prints the connection of a headset, as a change of a boolean
+static void ndjson_connected_event(const char* timestamp, const struct ndjson_device* device, bool connected)
+{
+    ndjson_begin(timestamp, device, "connected");
+    out_printf("%s,\"new\":%s", connected ? "false" : "true", connected ? "true" : "false");
+    ndjson_end();
+}
+
+static bool ndjson_same_device(const struct ndjson_device* device, const HeadsetInfo* info, int instance)
+{
+    return device->present && device->instance == instance && strcmp(device->idVendor, info->idVendor) == 0
+        && strcmp(device->idProduct, info->idProduct) == 0 && wcscmp(device->serial_number, info->serial_number) == 0;
+}
+
+void output_ndjson(HeadsetControlStatus* status, HeadsetInfo* infos)
+{
+    // ISO 8601 in UTC, with milliseconds
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    time_t seconds = now.tv_sec;
+
+    char timestamp[32];
+    size_t len = strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", gmtime(&seconds));
+    snprintf(timestamp + len, sizeof(timestamp) - len, ".%03ldZ", now.tv_nsec / 1000000);
+
+    bool seen[MAX_HEADSETS] = { false };
+    static struct ndjson_value values[NUM_CAPABILITIES];
+
+    for (int i = 0; i < status->device_count; i++) {
+        HeadsetInfo* info = &infos[i];
+
+        // headsets without a serial number are told apart by their position
+        int instance = 0;
+        for (int j = 0; j < i; j++) {
+            if (strcmp(infos[j].idVendor, info->idVendor) == 0 && strcmp(infos[j].idProduct, info->idProduct) == 0
+                && wcscmp(infos[j].serial_number, info->serial_number) == 0)
+                instance++;
+        }
+
+        int slot = -1, free_slot = -1;
+        for (int d = 0; d < MAX_HEADSETS && slot < 0; d++) {
+            if (ndjson_same_device(&ndjson_devices[d], info, instance))
+                slot = d;
+            else if (!ndjson_devices[d].present && free_slot < 0)
+                free_slot = d;
+        }
+
+        if (slot < 0) {
+            if (free_slot < 0)
+                continue;
+
+            slot                         = free_slot;
+            struct ndjson_device* device = &ndjson_devices[slot];
+            memset(device, 0, sizeof(*device));
+            device->present  = true;
+            device->instance = instance;
+            snprintf(device->device_name, sizeof(device->device_name), "%s", info->device_name);
+            snprintf(device->idVendor, sizeof(device->idVendor), "%s", info->idVendor);
+            snprintf(device->idProduct, sizeof(device->idProduct), "%s", info->idProduct);
+            wcsncpy(device->serial_number, info->serial_number, sizeof(device->serial_number) / sizeof(device->serial_number[0]) - 1);
+
+            ndjson_connected_event(timestamp, device, true);
+        }
+
+        struct ndjson_device* device = &ndjson_devices[slot];
+        seen[slot]                   = true;
+
+        ndjson_values(info, values);
+        for (int c = 0; c < NUM_CAPABILITIES; c++) {
+            if (ndjson_value_equal(&device->values[c], &values[c]))
+                continue;
+
+            ndjson_event(timestamp, device, capabilities_str_enum[c], &device->values[c], &values[c]);
+            device->values[c] = values[c];
+        }
+    }
+
+    for (int d = 0; d < MAX_HEADSETS; d++) {
+        if (ndjson_devices[d].present && !seen[d]) {
+            ndjson_devices[d].present = false;
+            ndjson_connected_event(timestamp, &ndjson_devices[d], false);
+        }
+    }
 }
 
 void output_standard(HeadsetControlStatus* status, HeadsetInfo* infos, bool print_capabilities)
@@ -735,11 +1436,18 @@ void output_standard(HeadsetControlStatus* status, HeadsetInfo* infos, bool prin
 
     for (int i = 0; i < status->device_count; i++) {
         HeadsetInfo* info = &infos[i];
+        if (i > 0)
+            printf("\n");
+
         if (info->product_name != NULL && wcslen(info->product_name) > 0)
             printf("Found %s (%ls)!\n\n", info->device_name, info->product_name);
         else
             printf("Found %s!\n\n", info->device_name);
 
+        // tells several connected headsets apart
+        if ((status->device_count > 1 || print_capabilities) && info->serial_number != NULL && wcslen(info->serial_number) > 0)
+            printf("Serial number: %ls\n\n", info->serial_number);
+
         if (print_capabilities) {
             printf("Capabilities:\n");
             for (int j = 0; j < info->capabilities_amount; j++) {
@@ -762,7 +1470,7 @@ void output_standard(HeadsetControlStatus* status, HeadsetInfo* infos, bool prin
         }
 
         if (info->has_chatmix_info) {
-            printf("Chatmix: %d\n", infos->chatmix);
+            printf("Chatmix: %d\n", info->chatmix);
 
             outputted = true;
         }
@@ -773,16 +1481,14 @@ void output_standard(HeadsetControlStatus* status, HeadsetInfo* infos, bool prin
             outputted = true;
         }
 
-        break; // list info only one device supported for now
-    }
-
-    for (int i = 0; i < infos->action_count; i++) {
-        outputted = true;
+        for (int j = 0; j < info->action_count; j++) {
+            outputted = true;
 
-        if (infos->actions[i].status == STATUS_SUCCESS) {
-            printf("Successfully set %s!\n", infos->actions[i].capability_str);
-        } else {
-            printf("%s\n", infos->actions[i].error_message);
+            if (info->actions[j].status == STATUS_SUCCESS) {
+                printf("Successfully set %s!\n", info->actions[j].capability_str);
+            } else {
+                printf("%s\n", info->actions[j].error_message);
+            }
         }
     }
 
@@ -6,6 +6,10 @@ typedef enum OutputType {
     OUTPUT_JSON,
     OUTPUT_YAML,
     OUTPUT_ENV,
+    /// One line per change, for --follow
+    OUTPUT_NDJSON,
+    /// The document of OUTPUT_JSON in binary, with numbers as integers and floats
+    OUTPUT_CBOR,
     OUTPUT_STANDARD,
     OUTPUT_SHORT
 } OutputType;
@@ -35,32 +39,34 @@ typedef enum {
 typedef struct {
     const char* capability;
     const char* capability_str;
-    char* device;
+    const char* device;
     Status status;
     int value;
-    char* error_message;
+    const char* error_message;
 } Action;
 
 #define MAX_ERRORS  10
 #define MAX_ACTIONS 16
 
 typedef struct {
-    char* source; // For example, "battery"
-    char* message; // Error message related to the source
+    const char* source; // For example, "battery"
+    const char* message; // Error message related to the source
 } ErrorInfo;
 
 /**
  * @brief Struct to hold information of a device for the output implementations
  *
- * For converting it to JSON/YAML etc.
+ * For converting it to JSON/YAML etc. Strings point into the device and its
+ * feature requests, so nothing is allocated while following.
  */
 typedef struct {
     Status status;
-    char* idVendor;
-    char* idProduct;
+    char idVendor[8]; // "0x" and four hex digits
+    char idProduct[8];
     char* device_name;
     wchar_t* vendor_name;
     wchar_t* product_name;
+    wchar_t* serial_number;
     enum capabilities capabilities_enum[NUM_CAPABILITIES];
     const char* capabilities[NUM_CAPABILITIES];
     const char* capabilities_str[NUM_CAPABILITIES];
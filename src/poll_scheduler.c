@@ -0,0 +1,163 @@
+#include "poll_scheduler.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
+static int64_t monotonic_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/// Clamps an interval to the int the timers hold, long follow intervals would overflow it
+static int interval_ms(int64_t ms)
+{
+    return ms < INT_MAX ? (int)ms : INT_MAX;
+}
+
+void poll_scheduler_init(struct poll_scheduler* scheduler, FeatureRequest** requests, int num_devices, int64_t follow_ms)
+{
+    memset(scheduler, 0, sizeof(*scheduler));
+    scheduler->num_devices = num_devices;
+    scheduler->follow_ms   = interval_ms(follow_ms);
+
+#ifdef __linux__
+    scheduler->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+#else
+    scheduler->fd = -1;
+#endif
+
+    int64_t now                = monotonic_ms();
+    scheduler->interval_due_ms = now + follow_ms;
+
+    for (int d = 0; d < num_devices; d++) {
+        for (int i = 0; i < NUM_CAPABILITIES; i++) {
+            enum capabilities cap    = requests[d][i].cap;
+            struct poll_timer* timer = &scheduler->timers[d][cap];
+
+            timer->active = requests[d][i].should_process;
+            timer->due_ms = now;
+            timer->min_ms = scheduler->follow_ms;
+            timer->max_ms = scheduler->follow_ms;
+
+            if (cap == CAP_CHATMIX_STATUS) {
+                timer->min_ms = scheduler->follow_ms < POLL_CHATMIX_MIN_MS ? scheduler->follow_ms : POLL_CHATMIX_MIN_MS;
+            } else if (cap == CAP_BATTERY_STATUS) {
+                timer->max_ms = interval_ms((int64_t)scheduler->follow_ms * POLL_BATTERY_MAX_FACTOR);
+            }
+
+            timer->interval_ms = timer->min_ms;
+        }
+    }
+}
+
+/// Sleeps until the monotonic clock reaches until_ms, returns -1 when interrupted
+static int sleep_until(struct poll_scheduler* scheduler, int64_t until_ms)
+{
+#ifdef __linux__
+    if (scheduler->fd >= 0) {
+        struct itimerspec spec;
+        memset(&spec, 0, sizeof(spec));
+        spec.it_value.tv_sec  = until_ms / 1000;
+        spec.it_value.tv_nsec = (until_ms % 1000) * 1000000;
+
+        // a deadline in the past expires right away
+        if (timerfd_settime(scheduler->fd, TFD_TIMER_ABSTIME, &spec, NULL) == 0) {
+            uint64_t expirations;
+            if (read(scheduler->fd, &expirations, sizeof(expirations)) < 0)
+                return errno == EINTR ? -1 : 0;
+            return 0;
+        }
+    }
+#endif
+
+    int64_t wait_ms = until_ms - monotonic_ms();
+    if (wait_ms <= 0)
+        return 0;
+
+    struct timespec ts = { (time_t)(wait_ms / 1000), (long)(wait_ms % 1000) * 1000000 };
+    return nanosleep(&ts, NULL) == 0 ? 0 : -1;
+}
+
+int poll_scheduler_wait(struct poll_scheduler* scheduler, int* due)
+{
+    int64_t next = scheduler->interval_due_ms;
+
+    for (int d = 0; d < scheduler->num_devices; d++) {
+        for (int cap = 0; cap < NUM_CAPABILITIES; cap++) {
+            const struct poll_timer* timer = &scheduler->timers[d][cap];
+            if (timer->active && timer->due_ms < next)
+                next = timer->due_ms;
+        }
+    }
+
+    if (sleep_until(scheduler, next) < 0)
+        return -1;
+
+    int64_t now = monotonic_ms();
+
+    for (int d = 0; d < scheduler->num_devices; d++) {
+        due[d] = 0;
+
+        for (int cap = 0; cap < NUM_CAPABILITIES; cap++) {
+            const struct poll_timer* timer = &scheduler->timers[d][cap];
+
+            // timers due a little later are run now too, sharing the wakeup (and often the status report)
+            int slack = timer->interval_ms / POLL_SLACK_DIVISOR;
+            if (slack < POLL_SLACK_MS)
+                slack = POLL_SLACK_MS;
+
+            if (timer->active && timer->due_ms <= now + slack)
+                due[d] |= B(cap);
+        }
+    }
+
+    if (scheduler->interval_due_ms > now + POLL_SLACK_MS)
+        return 0;
+
+    // the next interval starts on time, unless the passes fell behind
+    scheduler->interval_due_ms += scheduler->follow_ms;
+    if (scheduler->interval_due_ms <= now)
+        scheduler->interval_due_ms = now + scheduler->follow_ms;
+
+    return 1;
+}
+
+void poll_scheduler_update(struct poll_scheduler* scheduler, int device, enum capabilities cap, const FeatureResult* result)
+{
+    struct poll_timer* timer = &scheduler->timers[device][cap];
+
+    bool changed = !timer->has_result || result->status != timer->status || result->value != timer->value || result->status2 != timer->status2;
+    bool fast    = cap == CAP_BATTERY_STATUS && result->status2 == BATTERY_CHARGING;
+
+    if (changed || fast) {
+        timer->interval_ms = timer->min_ms;
+    } else {
+        timer->interval_ms = interval_ms((int64_t)timer->interval_ms * 2);
+        if (timer->interval_ms > timer->max_ms)
+            timer->interval_ms = timer->max_ms;
+    }
+
+    timer->has_result = true;
+    timer->status     = result->status;
+    timer->value      = result->value;
+    timer->status2    = result->status2;
+    timer->due_ms     = monotonic_ms() + timer->interval_ms;
+}
+
+void poll_scheduler_close(struct poll_scheduler* scheduler)
+{
+#ifdef __linux__
+    if (scheduler->fd >= 0)
+        close(scheduler->fd);
+#endif
+    scheduler->fd = -1;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "device.h"
+#include "feature.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Adaptive polling of the follow mode.
+ *
+ * Every request of every headset has its own timer. The interval of a status
+ * request doubles while its value stays the same, up to a limit, and drops back
+ * to its shortest after a change (and while the battery charges). Settings are
+ * applied again at the follow interval, which also tells when to print the
+ * results. All timers share one timerfd, and the timers due shortly after the
+ * earliest one are run at the same wakeup.
+ */
+
+/// Timers due within this time, or a POLL_SLACK_DIVISOR-th of their interval, after a wakeup are run at it
+#define POLL_SLACK_MS 50
+#define POLL_SLACK_DIVISOR 4
+/// Shortest interval of the chatmix status
+#define POLL_CHATMIX_MIN_MS 250
+/// Widest interval of the battery status, as a multiple of the follow interval
+#define POLL_BATTERY_MAX_FACTOR 16
+
+struct poll_timer {
+    bool active;
+    int64_t due_ms;
+    int interval_ms;
+    int min_ms;
+    int max_ms;
+    /// Result of the last run, to detect changes
+    bool has_result;
+    int status;
+    int value;
+    int status2;
+};
+
+struct poll_scheduler {
+    struct poll_timer timers[MAX_HEADSETS][NUM_CAPABILITIES];
+    int num_devices;
+    int follow_ms;
+    /// End of the current follow interval
+    int64_t interval_due_ms;
+    /// timerfd, -1 where unavailable or not initialized
+    int fd;
+};
+
+/**
+ * @brief Starts a timer for every request to process, due right away
+ *
+ * @param requests  the requests of every headset, NUM_CAPABILITIES each
+ * @param follow_ms the follow interval, longer ones are cut to INT_MAX
+ */
+void poll_scheduler_init(struct poll_scheduler* scheduler, FeatureRequest** requests, int num_devices, int64_t follow_ms);
+
+/**
+ * @brief Sleeps until timers are due
+ *
+ * @param due filled with the capabilities (see B()) due for every headset
+ * @return 1 when a follow interval ended, 0 otherwise, or -1 when interrupted by a signal
+ */
+int poll_scheduler_wait(struct poll_scheduler* scheduler, int* due);
+
+/**
+ * @brief Schedules the next run of a request which ran
+ */
+void poll_scheduler_update(struct poll_scheduler* scheduler, int device, enum capabilities cap, const FeatureResult* result);
+
+void poll_scheduler_close(struct poll_scheduler* scheduler);
@@ -0,0 +1,396 @@
+#include "status_cache.h"
+
+#include "utility.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define STATUS_CACHE_MAGIC   0x43435348 // "HSCC"
+#define STATUS_CACHE_VERSION 3
+
+struct status_cache_entry {
+    uint16_t idVendor;
+    uint16_t idProduct;
+    /// Hash of the serial number and the instance, telling headsets of the same model apart
+    uint32_t identity;
+    int32_t cap;
+    /// CLOCK_MONOTONIC time of the read in milliseconds, 0 before the first successful read
+    int64_t updated_ms;
+    int32_t status;
+    int32_t value;
+    int32_t status2;
+    char message[STATUS_CACHE_MESSAGE_SIZE];
+};
+
+struct status_cache_file {
+    uint32_t magic;
+    uint32_t version;
+    struct status_cache_entry entries[STATUS_CACHE_ENTRIES];
+};
+
+static int cache_fd                    = -1;
+static struct status_cache_file* cache = NULL;
+static bool cache_failed               = false;
+
+/**
+ * The keys of the entries are changed under the index lock (the header of the
+ * file), their results under the lock of the entry, so that refreshes of
+ * different headsets and capabilities run at once. fcntl() locks don't exclude
+ * the threads of this process, they take the mutex of the same lock first.
+ */
+static pthread_mutex_t index_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t entry_mutex[STATUS_CACHE_ENTRIES];
+static pthread_once_t entry_mutex_once = PTHREAD_ONCE_INIT;
+
+/// Entry this thread keeps locked between status_cache_lookup() and status_cache_store(), -1 for none
+static __thread int locked_entry = -1;
+
+const char* status_cache_path()
+{
+    static char path[512];
+
+    const char* env = getenv("HEADSETCONTROL_CACHE");
+    if (env && strlen(env) > 0) {
+        snprintf(path, sizeof(path), "%s", env);
+        return path;
+    }
+
+    const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (runtime_dir && strlen(runtime_dir) > 0)
+        snprintf(path, sizeof(path), "%s/headsetcontrol.cache", runtime_dir);
+    else
+        snprintf(path, sizeof(path), "/tmp/headsetcontrol-%u.cache", (unsigned)getuid());
+
+    return path;
+}
+
+static int64_t now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void init_entry_mutexes()
+{
+    for (int i = 0; i < STATUS_CACHE_ENTRIES; i++)
+        pthread_mutex_init(&entry_mutex[i], NULL);
+}
+
+/// Locks or unlocks (F_UNLCK) bytes of the file, waiting for other invocations when wait is set
+static int lock_range(short type, off_t start, off_t length, bool wait)
+{
+    struct flock range = { 0 };
+    range.l_type       = type;
+    range.l_whence     = SEEK_SET;
+    range.l_start      = start;
+    range.l_len        = length;
+
+    for (;;) {
+        if (fcntl(cache_fd, wait ? F_SETLKW : F_SETLK, &range) == 0)
+            return 0;
+        if (errno == EINTR)
+            continue;
+        if (errno != EDEADLK)
+            return -1;
+
+        // the deadlock detection sees processes, not threads: two invocations
+        // waiting for entries the other one refreshes, retry once they are done
+        struct timespec delay = { 0, 1000000L };
+        nanosleep(&delay, NULL);
+    }
+}
+
+/// Called with the index mutex held
+static bool cache_open()
+{
+    if (cache)
+        return true;
+    if (cache_failed)
+        return false;
+
+    pthread_once(&entry_mutex_once, init_entry_mutexes);
+
+    const char* path = status_cache_path();
+    cache_fd         = open_private_file(path);
+    if (cache_fd < 0) {
+        fprintf(stderr, "Failed to open the status cache %s, not using it\n", path);
+        cache_failed = true;
+        return false;
+    }
+
+    // size and initialize the file under the lock, another invocation may do the same
+    lock_range(F_WRLCK, 0, 0, true);
+
+    struct stat st;
+    if (fstat(cache_fd, &st) != 0 || (st.st_size != sizeof(struct status_cache_file) && ftruncate(cache_fd, sizeof(struct status_cache_file)) != 0)) {
+        fprintf(stderr, "Failed to size the status cache %s, not using it\n", path);
+        close(cache_fd);
+        cache_fd     = -1;
+        cache_failed = true;
+        return false;
+    }
+
+    void* map = mmap(NULL, sizeof(struct status_cache_file), PROT_READ | PROT_WRITE, MAP_SHARED, cache_fd, 0);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Failed to map the status cache %s, not using it\n", path);
+        close(cache_fd);
+        cache_fd     = -1;
+        cache_failed = true;
+        return false;
+    }
+    cache = map;
+
+    if (cache->magic != STATUS_CACHE_MAGIC || cache->version != STATUS_CACHE_VERSION) {
+        memset(cache, 0, sizeof(*cache));
+        cache->magic   = STATUS_CACHE_MAGIC;
+        cache->version = STATUS_CACHE_VERSION;
+    }
+
+    lock_range(F_UNLCK, 0, 0, false);
+    return true;
+}
+
+/// Locks the keys of the entries, opening the cache on first use
+static bool lock_index()
+{
+    pthread_mutex_lock(&index_mutex);
+
+    if (!cache_open()) {
+        pthread_mutex_unlock(&index_mutex);
+        return false;
+    }
+
+    lock_range(F_WRLCK, 0, offsetof(struct status_cache_file, entries), true);
+    return true;
+}
+
+static void unlock_index()
+{
+    lock_range(F_UNLCK, 0, offsetof(struct status_cache_file, entries), false);
+    pthread_mutex_unlock(&index_mutex);
+}
+
+static off_t entry_offset(int index)
+{
+    return offsetof(struct status_cache_file, entries) + (off_t)index * sizeof(struct status_cache_entry);
+}
+
+static void lock_entry(int index)
+{
+    pthread_mutex_lock(&entry_mutex[index]);
+    lock_range(F_WRLCK, entry_offset(index), sizeof(struct status_cache_entry), true);
+}
+
+/// Locks an entry unless another thread or invocation holds it
+static bool try_lock_entry(int index)
+{
+    if (pthread_mutex_trylock(&entry_mutex[index]) != 0)
+        return false;
+
+    if (lock_range(F_WRLCK, entry_offset(index), sizeof(struct status_cache_entry), false) != 0) {
+        pthread_mutex_unlock(&entry_mutex[index]);
+        return false;
+    }
+    return true;
+}
+
+static void unlock_entry(int index)
+{
+    lock_range(F_UNLCK, entry_offset(index), sizeof(struct status_cache_entry), false);
+    pthread_mutex_unlock(&entry_mutex[index]);
+}
+
+/// FNV-1a over the serial number and the instance
+static uint32_t device_identity(const struct device* device)
+{
+    uint32_t hash = 2166136261u;
+    for (const wchar_t* p = device->device_hid_serialnumber; *p; p++) {
+        hash ^= (uint32_t)*p;
+        hash *= 16777619u;
+    }
+    hash ^= (uint32_t)device->device_instance;
+    hash *= 16777619u;
+    return hash;
+}
+
+static bool entry_matches(const struct status_cache_entry* entry, const struct device* device, uint32_t identity, enum capabilities cap)
+{
+    return entry->idVendor == device->idVendor && entry->idProduct == device->idProduct
+        && entry->identity == identity && entry->cap == (int32_t)cap;
+}
+
+/// Returns the index of the entry, -1 when there is none. Called with the index lock held
+static int cache_find(const struct device* device, uint32_t identity, enum capabilities cap)
+{
+    for (int i = 0; i < STATUS_CACHE_ENTRIES; i++) {
+        if (entry_matches(&cache->entries[i], device, identity, cap))
+            return i;
+    }
+
+    return -1;
+}
+
+/**
+ * Takes an entry for the headset and capability, locked. An unused entry or
+ * the oldest one, never one which is being refreshed. Called with the index
+ * lock held
+ *
+ * @return index of the entry, -1 when all are being refreshed
+ */
+static int cache_claim(const struct device* device, uint32_t identity, enum capabilities cap)
+{
+    int claimed = -1;
+
+    for (int i = 0; i < STATUS_CACHE_ENTRIES; i++) {
+        if (claimed >= 0 && cache->entries[i].updated_ms >= cache->entries[claimed].updated_ms)
+            continue;
+        if (!try_lock_entry(i))
+            continue;
+
+        if (claimed >= 0)
+            unlock_entry(claimed);
+        claimed = i;
+    }
+
+    if (claimed < 0)
+        return -1;
+
+    struct status_cache_entry* entry = &cache->entries[claimed];
+    memset(entry, 0, sizeof(*entry));
+    entry->idVendor  = device->idVendor;
+    entry->idProduct = device->idProduct;
+    entry->identity  = identity;
+    entry->cap       = cap;
+
+    return claimed;
+}
+
+bool status_cache_lookup(const struct device* device, enum capabilities cap, int ttl_ms, FeatureResult* result)
+{
+    uint32_t identity = device_identity(device);
+    int index;
+
+    for (;;) {
+        if (!lock_index())
+            return false;
+
+        index = cache_find(device, identity, cap);
+        if (index < 0) {
+            // locked before the index is unlocked, others finding it wait for this refresh
+            index = cache_claim(device, identity, cap);
+            unlock_index();
+            if (index < 0)
+                return false;
+            break;
+        }
+        unlock_index();
+
+        // wait for a refresh of the entry by another thread or invocation
+        lock_entry(index);
+        if (entry_matches(&cache->entries[index], device, identity, cap))
+            break;
+
+        // the entry was given to another headset while waiting
+        unlock_entry(index);
+    }
+
+    struct status_cache_entry* entry = &cache->entries[index];
+    int64_t age                      = now_ms() - entry->updated_ms;
+
+    // a time ahead of now is from before a reboot, the file in /tmp survived it
+    if (entry->updated_ms != 0 && age >= 0 && age < ttl_ms) {
+        result->status  = entry->status;
+        result->value   = entry->value;
+        result->status2 = entry->status2;
+        snprintf(result->message, sizeof(result->message), "%s", entry->message);
+
+        unlock_entry(index);
+        return true;
+    }
+
+    // keep the entry locked, others wait until this thread stored the fresh result
+    locked_entry = index;
+    return false;
+}
+
+void status_cache_store(const struct device* device, enum capabilities cap, const FeatureResult* result)
+{
+    UNUSED(device);
+    UNUSED(cap);
+
+    if (locked_entry < 0)
+        return;
+
+    if (result->status == FEATURE_SUCCESS || result->status == FEATURE_INFO) {
+        struct status_cache_entry* entry = &cache->entries[locked_entry];
+
+        entry->status     = result->status;
+        entry->value      = result->value;
+        entry->status2    = result->status2;
+        entry->updated_ms = now_ms();
+        // status messages are short, longer ones are cut
+        snprintf(entry->message, sizeof(entry->message), "%.*s", (int)sizeof(entry->message) - 1, result->message);
+    }
+
+    unlock_entry(locked_entry);
+    locked_entry = -1;
+}
+
+void status_cache_close()
+{
+    // closing the file releases the fcntl() locks of every thread
+    if (locked_entry >= 0) {
+        pthread_mutex_unlock(&entry_mutex[locked_entry]);
+        locked_entry = -1;
+    }
+    if (cache)
+        munmap(cache, sizeof(struct status_cache_file));
+    if (cache_fd >= 0)
+        close(cache_fd);
+
+    cache    = NULL;
+    cache_fd = -1;
+}
+
+#else // _WIN32: the cache is not supported by this implementation
+
+const char* status_cache_path()
+{
+    return NULL;
+}
+
+bool status_cache_lookup(const struct device* device, enum capabilities cap, int ttl_ms, FeatureResult* result)
+{
+    UNUSED(device);
+    UNUSED(cap);
+    UNUSED(ttl_ms);
+    UNUSED(result);
+    return false;
+}
+
+void status_cache_store(const struct device* device, enum capabilities cap, const FeatureResult* result)
+{
+    UNUSED(device);
+    UNUSED(cap);
+    UNUSED(result);
+}
+
+void status_cache_close()
+{
+}
+
+#endif
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "device.h"
+
+#include <stdbool.h>
+
+/**
+ * Opt-in cache of status results (--cache-ttl), shared by all invocations of a user.
+ *
+ * The cache is a file in the runtime directory, mapped into every invocation.
+ * Entries are keyed by vendor id, product id, the serial number and instance of
+ * the headset, and capability, and every entry has its own fcntl() lock. An
+ * invocation finding no fresh entry keeps that entry locked while it reads the
+ * device, so concurrent callers (other invocations and other threads) wait for
+ * that single refresh and then use its result. Refreshes of other headsets and
+ * capabilities don't wait for it.
+ */
+
+/// Number of results the cache holds, the oldest is replaced when it is full
+#define STATUS_CACHE_ENTRIES 64
+/// Longest message stored with a result
+#define STATUS_CACHE_MESSAGE_SIZE 128
+
+/**
+ * @brief Returns the path of the cache file
+ *
+ * HEADSETCONTROL_CACHE when set, otherwise headsetcontrol.cache in XDG_RUNTIME_DIR,
+ * falling back to /tmp/headsetcontrol-UID.cache. The cache isn't used when the
+ * file is a symbolic link or belongs to another user, see open_private_file()
+ */
+const char* status_cache_path();
+
+/**
+ * @brief Looks up a cached status result younger than ttl_ms
+ *
+ * On a miss the entry stays locked, and the same thread must call
+ * status_cache_store() after reading the device, also when the read failed.
+ *
+ * @param device the headset
+ * @param cap the status capability
+ * @param ttl_ms maximum age of the result in milliseconds
+ * @param result filled on a hit
+ * @return true on a hit
+ */
+bool status_cache_lookup(const struct device* device, enum capabilities cap, int ttl_ms, FeatureResult* result);
+
+/**
+ * @brief Stores a freshly read status result and unlocks its entry
+ *
+ * Only successful results (FEATURE_SUCCESS, FEATURE_INFO) are stored.
+ */
+void status_cache_store(const struct device* device, enum capabilities cap, const FeatureResult* result);
+
+/**
+ * @brief Unmaps and closes the cache file
+ *
+ * Called once the other threads stopped using the cache.
+ */
+void status_cache_close();
@@ -0,0 +1,301 @@
+#include "status_shm.h"
+
+#include "utility.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// the status is copied in 32 bit words
+typedef char status_shm_status_size_check[sizeof(struct status_shm_status) % sizeof(uint32_t) == 0 ? 1 : -1];
+
+static struct {
+    int fd;
+    struct status_shm_segment* segment;
+    bool failed;
+    /// the status of the pass, built before the segment is updated
+    struct status_shm_status next;
+} writer = { -1, NULL, false, { 0 } };
+
+static struct status_shm_segment* reader_segment = NULL;
+/// Only mapping the segment is serialized, reading it isn't
+static pthread_mutex_t reader_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+const char* status_shm_name()
+{
+    static char name[256];
+
+    const char* env = getenv("HEADSETCONTROL_SHM");
+    if (env && strlen(env) > 0)
+        snprintf(name, sizeof(name), "%s", env);
+    else
+        snprintf(name, sizeof(name), "/headsetcontrol-%u", (unsigned)getuid());
+
+    return name;
+}
+
+static bool segment_valid(const struct status_shm_segment* segment)
+{
+    return __atomic_load_n(&segment->magic, __ATOMIC_ACQUIRE) == STATUS_SHM_MAGIC && segment->version == STATUS_SHM_VERSION
+        && segment->size == sizeof(struct status_shm_segment);
+}
+
+/// Whether the segment belongs to this user and nobody else can open it, /dev/shm is writable by all
+static bool segment_private(int fd, struct stat* st)
+{
+    return fstat(fd, st) == 0 && st->st_uid == geteuid() && (st->st_mode & (S_IRWXG | S_IRWXO)) == 0;
+}
+
+static bool writer_open()
+{
+    if (writer.segment)
+        return true;
+    if (writer.failed)
+        return false;
+
+    const char* name = status_shm_name();
+    writer.fd        = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (writer.fd < 0) {
+        fprintf(stderr, "Failed to open the shared memory %s, not publishing the status\n", name);
+        writer.failed = true;
+        return false;
+    }
+
+    struct stat st;
+    if (!segment_private(writer.fd, &st)) {
+        fprintf(stderr, "The shared memory %s belongs to another user or is open to others, not publishing the status\n", name);
+        close(writer.fd);
+        writer.fd     = -1;
+        writer.failed = true;
+        return false;
+    }
+
+    // a single writer, the lock is released when it exits
+    if (flock(writer.fd, LOCK_EX | LOCK_NB) != 0 && errno == EWOULDBLOCK) {
+        fprintf(stderr, "Another process publishes the status in %s, not publishing it\n", name);
+        close(writer.fd);
+        writer.fd     = -1;
+        writer.failed = true;
+        return false;
+    }
+
+    void* map = MAP_FAILED;
+    if (ftruncate(writer.fd, sizeof(struct status_shm_segment)) == 0)
+        map = mmap(NULL, sizeof(struct status_shm_segment), PROT_READ | PROT_WRITE, MAP_SHARED, writer.fd, 0);
+
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Failed to map the shared memory %s, not publishing the status\n", name);
+        close(writer.fd);
+        writer.fd     = -1;
+        writer.failed = true;
+        return false;
+    }
+    writer.segment = map;
+
+    // a writer which died while updating left the sequence odd
+    uint32_t sequence = __atomic_load_n(&writer.segment->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&writer.segment->sequence, (sequence + 1) & ~1u, __ATOMIC_RELAXED);
+
+    writer.segment->version = STATUS_SHM_VERSION;
+    writer.segment->size    = sizeof(struct status_shm_segment);
+    __atomic_store_n(&writer.segment->magic, STATUS_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+/// Copies the status from the segment, racing with the writer by design
+static void load_words(uint32_t* dst, const uint32_t* src, size_t size)
+{
+    for (size_t i = 0; i < size / sizeof(uint32_t); i++)
+        dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+}
+
+static void store_words(uint32_t* dst, const uint32_t* src, size_t size)
+{
+    for (size_t i = 0; i < size / sizeof(uint32_t); i++)
+        __atomic_store_n(&dst[i], src[i], __ATOMIC_RELAXED);
+}
+
+static void shared_device(struct status_shm_device* shared, const struct device* device, FeatureRequest* requests, int size, int64_t now)
+{
+    shared->idVendor   = device->idVendor;
+    shared->idProduct  = device->idProduct;
+    shared->instance   = device->device_instance;
+    shared->updated_ms = now;
+    snprintf(shared->device_name, sizeof(shared->device_name), "%s", device->device_name);
+    if (snprintf(shared->serial_number, sizeof(shared->serial_number), "%ls", device->device_hid_serialnumber) < 0)
+        shared->serial_number[0] = '\0';
+
+    for (int i = 0; i < size; i++) {
+        const FeatureResult* result = &requests[i].result;
+
+        if (!requests[i].should_process || (result->status != FEATURE_SUCCESS && result->status != FEATURE_INFO))
+            continue;
+
+        // like the battery of the output, see processFeatureRequests()
+        if (requests[i].cap == CAP_BATTERY_STATUS) {
+            shared->has_battery = 1;
+
+            if (result->status2 == BATTERY_CHARGING || result->status2 == BATTERY_UNAVAILABLE)
+                shared->battery_status = result->status2;
+            else
+                shared->battery_status = BATTERY_AVAILABLE;
+            shared->battery_level = result->status2 == BATTERY_UNAVAILABLE ? -1 : result->value;
+        } else if (requests[i].cap == CAP_CHATMIX_STATUS) {
+            shared->has_chatmix = 1;
+            shared->chatmix     = result->value;
+        }
+    }
+}
+
+void status_shm_publish(const struct device* devices, FeatureRequest* const* requests, int num_devices, int size)
+{
+    if (!writer_open())
+        return;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    int64_t now = (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+
+    struct status_shm_status* next = &writer.next;
+    memset(next, 0, sizeof(*next));
+    next->device_count = (uint32_t)(num_devices < MAX_HEADSETS ? num_devices : MAX_HEADSETS);
+
+    for (uint32_t d = 0; d < next->device_count; d++)
+        shared_device(&next->devices[d], &devices[d], requests[d], size, now);
+
+    struct status_shm_segment* segment = writer.segment;
+    uint32_t sequence                  = __atomic_load_n(&segment->sequence, __ATOMIC_RELAXED);
+
+    // odd, and visible before any word of the status changes
+    __atomic_store_n(&segment->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    store_words((uint32_t*)&segment->status, (const uint32_t*)next, sizeof(*next));
+
+    __atomic_store_n(&segment->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+/// Maps the segment, again when its writer removed it
+static struct status_shm_segment* reader_open()
+{
+    struct status_shm_segment* segment = __atomic_load_n(&reader_segment, __ATOMIC_ACQUIRE);
+    if (segment && segment_valid(segment))
+        return segment;
+
+    pthread_mutex_lock(&reader_mutex);
+
+    segment = reader_segment;
+    if (segment && !segment_valid(segment)) {
+        __atomic_store_n(&reader_segment, NULL, __ATOMIC_RELEASE);
+        munmap(segment, sizeof(struct status_shm_segment));
+        segment = NULL;
+    }
+
+    if (!segment) {
+        int fd = shm_open(status_shm_name(), O_RDONLY | O_CLOEXEC, 0);
+        struct stat st;
+
+        if (fd >= 0 && segment_private(fd, &st) && st.st_size >= (off_t)sizeof(struct status_shm_segment)) {
+            void* map = mmap(NULL, sizeof(struct status_shm_segment), PROT_READ, MAP_SHARED, fd, 0);
+            if (map != MAP_FAILED) {
+                segment = map;
+                __atomic_store_n(&reader_segment, segment, __ATOMIC_RELEASE);
+            }
+        }
+        if (fd >= 0)
+            close(fd);
+    }
+
+    pthread_mutex_unlock(&reader_mutex);
+
+    return segment && segment_valid(segment) ? segment : NULL;
+}
+
+int status_shm_read(struct status_shm_status* status)
+{
+    const struct status_shm_segment* segment = reader_open();
+    if (!segment)
+        return -1;
+
+    for (int i = 0; i < STATUS_SHM_READ_RETRIES; i++) {
+        uint32_t sequence = __atomic_load_n(&segment->sequence, __ATOMIC_ACQUIRE);
+        if (sequence & 1)
+            continue;
+
+        load_words((uint32_t*)status, (const uint32_t*)&segment->status, sizeof(*status));
+
+        // the copy is complete before the sequence is checked again
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&segment->sequence, __ATOMIC_RELAXED) != sequence)
+            continue;
+
+        // the callers index and print it, whatever the writer stored
+        if (status->device_count > MAX_HEADSETS)
+            status->device_count = MAX_HEADSETS;
+        for (int d = 0; d < MAX_HEADSETS; d++) {
+            status->devices[d].device_name[sizeof(status->devices[d].device_name) - 1]     = '\0';
+            status->devices[d].serial_number[sizeof(status->devices[d].serial_number) - 1] = '\0';
+        }
+        return 0;
+    }
+
+    return -2;
+}
+
+void status_shm_close()
+{
+    if (writer.segment) {
+        // readers map the segment of the next writer
+        __atomic_store_n(&writer.segment->magic, 0, __ATOMIC_RELEASE);
+        munmap(writer.segment, sizeof(struct status_shm_segment));
+        shm_unlink(status_shm_name());
+    }
+    if (writer.fd >= 0)
+        close(writer.fd);
+
+    writer.segment = NULL;
+    writer.fd      = -1;
+
+    if (reader_segment)
+        munmap(reader_segment, sizeof(struct status_shm_segment));
+    reader_segment = NULL;
+}
+
+#else // _WIN32: the shared status is not supported by this implementation
+
+const char* status_shm_name()
+{
+    return NULL;
+}
+
+void status_shm_publish(const struct device* devices, FeatureRequest* const* requests, int num_devices, int size)
+{
+    UNUSED(devices);
+    UNUSED(requests);
+    UNUSED(num_devices);
+    UNUSED(size);
+}
+
+int status_shm_read(struct status_shm_status* status)
+{
+    UNUSED(status);
+    return -1;
+}
+
+void status_shm_close()
+{
+}
+
+#endif
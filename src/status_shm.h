@@ -0,0 +1,99 @@
+#pragma once
+
+#include "device.h"
+#include "feature.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Latest status of the followed headsets in POSIX shared memory (--shm-read).
+ *
+ * --follow, --watch and the daemon publish the battery and chatmix of every
+ * headset after each pass. Readers, e.g. status bar widgets, map the segment
+ * and copy the status without touching the device, and once mapped without
+ * any syscall.
+ *
+ * The segment is guarded by a seqlock: the writer makes the sequence odd while
+ * it updates the status, readers retry when the sequence was odd or changed
+ * while they copied it. Only one process writes, the others don't publish.
+ */
+
+#define STATUS_SHM_MAGIC   0x4d485348 // "HSHM"
+#define STATUS_SHM_VERSION 1
+
+/// Attempts of status_shm_read() while the writer updates the status
+#define STATUS_SHM_READ_RETRIES 1000
+
+struct status_shm_device {
+    uint16_t idVendor;
+    uint16_t idProduct;
+    /// Which of the headsets with the same ids and serial number
+    int32_t instance;
+    char device_name[64];
+    /// UTF-8
+    char serial_number[64];
+    int32_t has_battery;
+    /// enum battery_status
+    int32_t battery_status;
+    /// -1 when unavailable
+    int32_t battery_level;
+    int32_t has_chatmix;
+    int32_t chatmix;
+    int32_t reserved;
+    /// CLOCK_REALTIME time of the pass in milliseconds
+    int64_t updated_ms;
+};
+
+/// What the writer publishes at once
+struct status_shm_status {
+    uint32_t device_count;
+    uint32_t reserved;
+    struct status_shm_device devices[MAX_HEADSETS];
+};
+
+struct status_shm_segment {
+    uint32_t magic;
+    uint32_t version;
+    /// sizeof(struct status_shm_segment), for segments of builds with another MAX_HEADSETS
+    uint32_t size;
+    /// Odd while the writer updates status
+    uint32_t sequence;
+    struct status_shm_status status;
+};
+
+/**
+ * @brief Returns the name of the segment
+ *
+ * HEADSETCONTROL_SHM when set, otherwise /headsetcontrol-UID. A segment of
+ * another user, or one others may open, is neither published to nor read.
+ */
+const char* status_shm_name();
+
+/**
+ * @brief Publishes the results of a pass
+ *
+ * Creates the segment on the first call. Does nothing when another process publishes.
+ *
+ * @param devices the headsets
+ * @param requests the requests of every headset, only the battery and chatmix results are published
+ * @param num_devices number of headsets
+ * @param size number of requests of every headset
+ */
+void status_shm_publish(const struct device* devices, FeatureRequest* const* requests, int num_devices, int size);
+
+/**
+ * @brief Copies the latest status
+ *
+ * Maps the segment on the first call, later calls make no syscall.
+ *
+ * @param status filled with a consistent copy, device_count at most MAX_HEADSETS
+ *               and the strings terminated
+ * @return 0 on success, -1 when nothing was published, -2 when the writer kept updating
+ */
+int status_shm_read(struct status_shm_status* status);
+
+/**
+ * @brief Unmaps the segment, and removes it when this process published
+ */
+void status_shm_close();
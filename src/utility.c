@@ -9,6 +9,11 @@
 
 #include "utility.h"
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
 int map(int x, int in_min, int in_max, int out_min, int out_max)
 {
     return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
@@ -137,6 +142,24 @@ int get_float_data_from_parameter(char* input, float* dest, size_t len)
     return i;
 }
 
+#ifndef _WIN32
+int open_private_file(const char* path)
+{
+    int fd = open(path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != geteuid() || st.st_nlink != 1) {
+        close(fd);
+        errno = EPERM;
+        return -1;
+    }
+
+    return fd;
+}
+#endif
+
 // ----------------- asprintf / vasprintf -----------------
 /*
  * Copyright (c) 2004 Darren Tucker.
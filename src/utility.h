@@ -1,6 +1,8 @@
 #pragma once
 
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 
 // For unused variables
 #define UNUSED(x) (void)x;
@@ -92,6 +94,21 @@ int get_byte_data_from_parameter(char* input, unsigned char* dest, size_t len);
  */
 int get_float_data_from_parameter(char* input, float* dest, size_t len);
 
+#ifndef _WIN32
+/**
+ * @brief Opens a file only this user may use, creating it when missing
+ *
+ * For files in shared directories like /tmp: symbolic links are not followed,
+ * and the file must be a regular file of the user without other hard links, so
+ * that another user can't make the caller truncate or write a file of their
+ * choice.
+ *
+ * @param path the file
+ * @return file descriptor opened for reading and writing, -1 when it can't be opened or isn't private
+ */
+int open_private_file(const char* path);
+#endif
+
 int vasprintf(char** str, const char* fmt, va_list ap);
 
 int _asprintf(char** str, const char* fmt, ...);
@@ -0,0 +1,362 @@
+#include "../src/device_registry.h"
+#include "../src/feature.h"
+#include "../src/output.h"
+
+#define CHECK_CONTEXT() fprintf(stderr, "profile %d: ", test_profile)
+#include "check.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Checks that -o cbor encodes what the other formats print.
+ *
+ * Renders the document of the test device, decodes it again and compares the
+ * values with the device and the results of the requests. Profile 1 of the
+ * test device makes the requests fail, with error messages.
+ */
+
+#define CBOR_UNSIGNED 0
+#define CBOR_NEGATIVE 1
+#define CBOR_TEXT 3
+#define CBOR_ARRAY 4
+#define CBOR_MAP 5
+#define CBOR_SIMPLE 7
+
+/// Position in an encoded document
+struct reader {
+    const uint8_t* p;
+    const uint8_t* end;
+};
+
+/// Reads nothing, for values which weren't found
+#define NO_READER { NULL, NULL }
+
+/**
+ * @brief Reads the head of a data item
+ *
+ * @param argument its argument, the bits of a float for floats
+ * @return the major type, -1 when malformed or indefinite
+ */
+static int read_head(struct reader* r, uint64_t* argument)
+{
+    if (r->p >= r->end)
+        return -1;
+
+    int major = *r->p >> 5;
+    int info  = *r->p & 0x1F;
+    r->p++;
+
+    if (info < 24) {
+        *argument = (uint64_t)info;
+        return major;
+    }
+    if (info > 27)
+        return -1;
+
+    size_t len = (size_t)1 << (info - 24);
+    if ((size_t)(r->end - r->p) < len)
+        return -1;
+
+    *argument = 0;
+    for (size_t i = 0; i < len; i++)
+        *argument = *argument << 8 | *r->p++;
+
+    return major;
+}
+
+/// Skips a data item, returns false when malformed
+static bool skip(struct reader* r)
+{
+    uint64_t argument;
+    int major = read_head(r, &argument);
+
+    switch (major) {
+    case CBOR_UNSIGNED:
+    case CBOR_NEGATIVE:
+    case CBOR_SIMPLE:
+        return true;
+    case CBOR_TEXT:
+        if ((uint64_t)(r->end - r->p) < argument)
+            return false;
+        r->p += argument;
+        return true;
+    case CBOR_ARRAY:
+        for (uint64_t i = 0; i < argument; i++) {
+            if (!skip(r))
+                return false;
+        }
+        return true;
+    case CBOR_MAP:
+        for (uint64_t i = 0; i < 2 * argument; i++) {
+            if (!skip(r))
+                return false;
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+/// Finds the value of key in the map at r
+static bool find(struct reader r, const char* key, struct reader* value)
+{
+    uint64_t count;
+    if (read_head(&r, &count) != CBOR_MAP)
+        return false;
+
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t len;
+        if (read_head(&r, &len) != CBOR_TEXT || (uint64_t)(r.end - r.p) < len)
+            return false;
+
+        bool match = len == strlen(key) && memcmp(r.p, key, len) == 0;
+        r.p += len;
+
+        if (match) {
+            *value = r;
+            return true;
+        }
+        if (!skip(&r))
+            return false;
+    }
+
+    return false;
+}
+
+/// Finds the element at index of the array at r
+static bool element(struct reader r, uint64_t index, struct reader* value)
+{
+    uint64_t count;
+    if (read_head(&r, &count) != CBOR_ARRAY || index >= count)
+        return false;
+
+    for (uint64_t i = 0; i < index; i++) {
+        if (!skip(&r))
+            return false;
+    }
+
+    *value = r;
+    return true;
+}
+
+static int64_t array_length(struct reader r)
+{
+    uint64_t count;
+    return read_head(&r, &count) == CBOR_ARRAY ? (int64_t)count : -1;
+}
+
+static void check_int(struct reader map, const char* key, int64_t expected)
+{
+    struct reader value;
+    uint64_t argument;
+    if (!find(map, key, &value)) {
+        CHECK(false, "%s missing", key);
+        return;
+    }
+
+    int major = read_head(&value, &argument);
+    int64_t decoded;
+    if (major == CBOR_UNSIGNED)
+        decoded = (int64_t)argument;
+    else if (major == CBOR_NEGATIVE)
+        decoded = -1 - (int64_t)argument;
+    else {
+        CHECK(false, "%s is not an integer", key);
+        return;
+    }
+
+    CHECK(decoded == expected, "%s is %lld instead of %lld", key, (long long)decoded, (long long)expected);
+}
+
+static void check_float(struct reader value, const char* name, float expected)
+{
+    uint8_t initial = value.p < value.end ? *value.p : 0;
+    uint64_t argument;
+
+    if (read_head(&value, &argument) != CBOR_SIMPLE || (initial & 0x1F) != 26) {
+        CHECK(false, "%s is not a float", name);
+        return;
+    }
+
+    uint32_t bits = (uint32_t)argument;
+    float decoded;
+    memcpy(&decoded, &bits, sizeof(decoded));
+
+    CHECK(decoded == expected, "%s is %f instead of %f", name, decoded, expected);
+}
+
+static void check_text_value(struct reader value, const char* name, const char* expected)
+{
+    uint64_t len;
+    if (read_head(&value, &len) != CBOR_TEXT || (uint64_t)(value.end - value.p) < len) {
+        CHECK(false, "%s is not a text string", name);
+        return;
+    }
+
+    CHECK(len == strlen(expected) && memcmp(value.p, expected, len) == 0, "%s is \"%.*s\" instead of \"%s\"", name, (int)len, value.p, expected);
+}
+
+static void check_text(struct reader map, const char* key, const char* expected)
+{
+    struct reader value;
+    if (!find(map, key, &value)) {
+        CHECK(false, "%s missing", key);
+        return;
+    }
+
+    check_text_value(value, key, expected);
+}
+
+/// Renders the document into a temporary file and reads it back
+static size_t render(DeviceList* list, uint8_t* data, size_t size)
+{
+    FILE* file = tmpfile();
+    if (!file)
+        return 0;
+
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    dup2(fileno(file), STDOUT_FILENO);
+
+    output(list, false, OUTPUT_CBOR);
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    rewind(file);
+    size_t len = fread(data, 1, size, file);
+    fclose(file);
+
+    return len;
+}
+
+static void check_document(const uint8_t* data, size_t len, const struct device* device, FeatureRequest* requests)
+{
+    struct reader document = { data, data + len };
+
+    struct reader end = document;
+    CHECK(skip(&end) && end.p == document.end, "the document is malformed or followed by other data");
+
+    check_text(document, "name", "HeadsetControl");
+    check_text(document, "api_version", "1.2");
+    check_int(document, "device_count", 1);
+
+    // sidetone and lights
+    struct reader actions = NO_READER, action;
+    CHECK(find(document, "actions", &actions) && array_length(actions) == 2, "not two actions");
+    for (int i = 0; i < 2 && element(actions, (uint64_t)i, &action); i++) {
+        FeatureRequest* request = &requests[i];
+
+        check_text(action, "capability", capabilities_str_enum[request->cap]);
+        check_text(action, "device", device->device_name);
+        check_text(action, "status", request->result.status == FEATURE_SUCCESS ? "success" : "failure");
+        if (request->result.status != FEATURE_SUCCESS)
+            check_text(action, "error_message", request->result.message);
+    }
+
+    struct reader devices, headset;
+    if (!find(document, "devices", &devices) || !element(devices, 0, &headset)) {
+        CHECK(false, "the device is missing");
+        return;
+    }
+
+    check_text(headset, "device", device->device_name);
+    check_text(headset, "vendor", "HeadsetControl");
+    check_int(headset, "id_vendor", VENDOR_TESTDEVICE);
+    check_int(headset, "id_product", PRODUCT_TESTDEVICE);
+
+    struct reader capabilities = NO_READER;
+    int capabilities_amount = 0;
+    for (int i = 0; i < NUM_CAPABILITIES; i++)
+        capabilities_amount += (device->capabilities & B(i)) != 0;
+    CHECK(find(headset, "capabilities", &capabilities) && array_length(capabilities) == capabilities_amount, "not %d capabilities", capabilities_amount);
+
+    struct reader equalizer, presets = NO_READER, values = NO_READER, value = NO_READER;
+    if (find(headset, "equalizer", &equalizer)) {
+        check_int(equalizer, "bands", device->equalizer->bands_count);
+        check_int(equalizer, "min", device->equalizer->bands_min);
+        CHECK(find(equalizer, "step", &value), "step missing");
+        check_float(value, "step", device->equalizer->bands_step);
+    } else {
+        CHECK(false, "equalizer missing");
+    }
+
+    check_int(headset, "equalizer_presets_count", device->eqaulizer_presets->count);
+    CHECK(find(headset, "equalizer_presets", &presets), "equalizer_presets missing");
+    for (int i = 0; i < device->eqaulizer_presets->count && failures == 0; i++) {
+        const EqualizerPreset* preset = &device->eqaulizer_presets->presets[i];
+
+        CHECK(find(presets, preset->name, &values) && array_length(values) == device->equalizer->bands_count, "preset %s missing", preset->name);
+        for (int j = 0; j < device->equalizer->bands_count && element(values, (uint64_t)j, &value); j++)
+            check_float(value, preset->name, preset->values[j]);
+    }
+
+    FeatureRequest* battery = &requests[2];
+    FeatureRequest* chatmix = &requests[3];
+
+    if (test_profile == 0) {
+        struct reader battery_map;
+        if (find(headset, "battery", &battery_map)) {
+            check_text(battery_map, "status", "BATTERY_AVAILABLE");
+            check_int(battery_map, "level", battery->result.value);
+        } else {
+            CHECK(false, "battery missing");
+        }
+        check_int(headset, "chatmix", chatmix->result.value);
+        check_text(headset, "status", "success");
+    } else {
+        struct reader errors;
+        if (find(headset, "errors", &errors)) {
+            check_text(errors, "battery", battery->result.message);
+            check_text(errors, "chatmix", chatmix->result.message);
+        } else {
+            CHECK(false, "errors missing");
+        }
+        check_text(headset, "status", "partial");
+    }
+}
+
+int main()
+{
+    init_devices();
+
+    static struct device devices[MAX_HEADSETS];
+    if (find_devices(devices, MAX_HEADSETS, NULL, 0, 1) != 1) {
+        fprintf(stderr, "Test device not found\n");
+        return 1;
+    }
+
+    int sidetone = 64, lights = 1, request = 1;
+
+    FeatureRequest requests[] = {
+        { CAP_SIDETONE, CAPABILITYTYPE_ACTION, &sidetone, true, {} },
+        { CAP_LIGHTS, CAPABILITYTYPE_ACTION, &lights, true, {} },
+        { CAP_BATTERY_STATUS, CAPABILITYTYPE_INFO, &request, true, {} },
+        { CAP_CHATMIX_STATUS, CAPABILITYTYPE_INFO, &request, true, {} },
+    };
+    int size = sizeof(requests) / sizeof(requests[0]);
+
+    DeviceList list = { requests, size, &devices[0], 1 };
+
+    static uint8_t data[64 * 1024];
+
+    for (test_profile = 0; test_profile <= 1; test_profile++) {
+        devices[0].test_profile = test_profile;
+        run_feature_pass(&devices[0], requests, size, 0, ~0);
+
+        size_t len = render(&list, data, sizeof(data));
+        CHECK(len > 0, "nothing was printed");
+
+        check_document(data, len, &devices[0], requests);
+    }
+
+    if (failures == 0)
+        printf("The documents of both profiles decode to the device and its results\n");
+
+    return failures != 0;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdio.h>
+
+/**
+ * Checks of the tests: a failed check is reported and counted, and the test
+ * goes on. A test returns failures != 0 from main().
+ *
+ * Define CHECK_CONTEXT() before including this header to print where the
+ * check failed (e.g. the test profile) in front of the message.
+ */
+
+#ifndef CHECK_CONTEXT
+#define CHECK_CONTEXT()
+#endif
+
+static int failures = 0;
+
+#define CHECK(condition, ...)             \
+    do {                                  \
+        if (!(condition)) {               \
+            CHECK_CONTEXT();              \
+            fprintf(stderr, __VA_ARGS__); \
+            fprintf(stderr, "\n");        \
+            failures++;                   \
+        }                                 \
+    } while (0)
@@ -0,0 +1,87 @@
+#include "../src/device_registry.h"
+#include "../src/feature.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * Checks that headsets of the same model are driven with their own state.
+ *
+ * Four copies of the test device get different profiles and timeouts, and
+ * run_feature_passes() runs them at once, one thread each, over and over. Every
+ * headset must get the results of its own profile.
+ */
+
+#define HEADSETS 4
+#define PASSES 2000
+
+static const int profiles[HEADSETS] = { 0, 1, 2, 3 };
+
+/// Results of the test device for a profile, see headsetcontrol_test.c
+static const struct {
+    FeatureStatus battery_status;
+    int battery;
+    FeatureStatus chatmix_status;
+    int chatmix;
+} expected[HEADSETS] = {
+    { FEATURE_SUCCESS, 42, FEATURE_SUCCESS, 42 },
+    { FEATURE_ERROR, BATTERY_HIDERROR, FEATURE_ERROR, -1 },
+    { FEATURE_INFO, 50, FEATURE_ERROR, -1 },
+    { FEATURE_SUCCESS, 64, FEATURE_SUCCESS, 42 },
+};
+
+int main()
+{
+    init_devices();
+
+    static struct device devices[HEADSETS];
+    static FeatureRequest device_requests[HEADSETS][2];
+    FeatureRequest* requests[HEADSETS];
+    int request = 1;
+
+    for (int d = 0; d < HEADSETS; d++) {
+        if (get_device(&devices[d], VENDOR_TESTDEVICE, PRODUCT_TESTDEVICE) != 0) {
+            fprintf(stderr, "Test device not found\n");
+            return 1;
+        }
+        devices[d].test_profile = profiles[d];
+        devices[d].timeout_ms   = 1000 + d;
+
+        requests[d] = device_requests[d];
+    }
+
+    int failures = 0;
+
+    for (int pass = 0; pass < PASSES && failures == 0; pass++) {
+        for (int d = 0; d < HEADSETS; d++) {
+            device_requests[d][0] = (FeatureRequest) { CAP_BATTERY_STATUS, CAPABILITYTYPE_INFO, &request, true, {} };
+            device_requests[d][1] = (FeatureRequest) { CAP_CHATMIX_STATUS, CAPABILITYTYPE_INFO, &request, true, {} };
+        }
+
+        int results[HEADSETS];
+        run_feature_passes(devices, requests, HEADSETS, 2, 0, NULL, results);
+
+        for (int d = 0; d < HEADSETS; d++) {
+            const FeatureResult* battery = &device_requests[d][0].result;
+            const FeatureResult* chatmix = &device_requests[d][1].result;
+
+            if (battery->status != expected[d].battery_status || battery->value != expected[d].battery
+                || chatmix->status != expected[d].chatmix_status || chatmix->value != expected[d].chatmix) {
+                fprintf(stderr, "pass %d, profile %d: battery %d (status %d), chatmix %d (status %d)\n",
+                    pass, profiles[d], battery->value, battery->status, chatmix->value, chatmix->status);
+                failures++;
+            }
+        }
+    }
+
+    // the state of the headsets only applies during their driver calls
+    if (device_current() != NULL || device_timeout() != hsc_device_timeout) {
+        fprintf(stderr, "A headset is still current after the passes\n");
+        failures++;
+    }
+
+    if (failures == 0)
+        printf("%d passes of %d test devices with different profiles at once\n", PASSES, HEADSETS);
+
+    return failures != 0;
+}
@@ -0,0 +1,186 @@
+#include "../src/device_registry.h"
+#include "../src/feature.h"
+#include "../src/feature_queue.h"
+#include "check.h"
+
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Checks the queue of feature requests on test devices.
+ *
+ * Two headsets answer at once and one never answers (test profile 6, its reads
+ * wait for the whole timeout). Submitting must not wait for any of them, the
+ * answering headsets must complete while the other one is still busy, requests
+ * waiting behind it must time out or be cancelled, and the fd must be readable
+ * exactly while completions are waiting. Settings must reach the drivers with
+ * the values they had when they were submitted.
+ */
+
+#define HEADSETS 3
+#define SLOW 2
+#define SLOW_MS 300
+
+#define BANDS 10
+
+static const int profiles[HEADSETS] = { 0, 3, 6 };
+
+/// What the drivers of the settings received, written by the thread of their headset
+static int sent_sidetone    = -1;
+static int sent_bands_count = -1;
+static float sent_bands[BANDS];
+
+static int record_sidetone(hid_device* device_handle, uint8_t num)
+{
+    sent_sidetone = num;
+    return 1;
+}
+
+static int record_equalizer(hid_device* device_handle, struct equalizer_settings* settings)
+{
+    sent_bands_count = settings->size;
+    for (int i = 0; i < settings->size && i < BANDS; i++)
+        sent_bands[i] = settings->bands_values[i];
+    return 1;
+}
+
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static bool fd_readable(feature_queue* queue, int timeout_ms)
+{
+    struct pollfd pfd = { feature_queue_fd(queue), POLLIN, 0 };
+    return poll(&pfd, 1, timeout_ms) == 1;
+}
+
+/// Waits on the fd for the next completion
+static bool next_completion(feature_queue* queue, struct feature_completion* completion)
+{
+    if (!fd_readable(queue, 5000))
+        return false;
+
+    return feature_queue_complete(queue, completion, 1) == 1;
+}
+
+int main()
+{
+    init_devices();
+
+    static struct device devices[HEADSETS];
+    for (int d = 0; d < HEADSETS; d++) {
+        if (get_device(&devices[d], VENDOR_TESTDEVICE, PRODUCT_TESTDEVICE) != 0) {
+            fprintf(stderr, "Test device not found\n");
+            return 1;
+        }
+        devices[d].test_profile = profiles[d];
+    }
+    devices[SLOW].send_sidetone  = record_sidetone;
+    devices[SLOW].send_equalizer = record_equalizer;
+
+    feature_queue* queue = feature_queue_open();
+    CHECK(queue != NULL, "no queue");
+    if (!queue)
+        return 1;
+
+    CHECK(!fd_readable(queue, 0), "readable without completions");
+
+    int request                    = 1;
+    const FeatureRequest battery   = { CAP_BATTERY_STATUS, CAPABILITYTYPE_INFO, &request, true, {} };
+    struct feature_completion done = { 0 };
+
+    // the slow headset first, the others must not wait for it
+    double start = now_ms();
+    uint64_t ids[HEADSETS];
+    for (int d = HEADSETS - 1; d >= 0; d--)
+        ids[d] = feature_queue_submit(queue, &devices[d], &battery, SLOW_MS, &devices[d]);
+    CHECK(now_ms() - start < SLOW_MS / 2, "submitting waited for the headsets");
+
+    for (int n = 0; n < HEADSETS; n++) {
+        CHECK(next_completion(queue, &done), "completion %d missing", n);
+
+        int d = (int)(done.device - devices);
+        CHECK(d >= 0 && d < HEADSETS && done.id == ids[d] && done.user_data == &devices[d], "completion of an unknown request");
+        CHECK(done.request.cap == CAP_BATTERY_STATUS && done.request.param == NULL, "not the battery request");
+
+        if (d == SLOW) {
+            CHECK(n == HEADSETS - 1, "the slow headset completed before the others");
+            CHECK(done.request.result.status == FEATURE_ERROR && done.request.result.value == BATTERY_TIMEOUT,
+                "slow headset: battery %d (status %d)", done.request.result.value, done.request.result.status);
+            CHECK(now_ms() - start >= SLOW_MS - 10, "the read of the slow headset didn't get the timeout of the request");
+        } else {
+            CHECK(done.request.result.status == FEATURE_SUCCESS && done.request.result.value == (d == 0 ? 42 : 64),
+                "headset %d: battery %d (status %d)", d, done.request.result.value, done.request.result.status);
+        }
+    }
+    CHECK(!fd_readable(queue, 0), "readable after collecting every completion");
+
+    // behind a request of the slow headset: one times out, one is cancelled
+    uint64_t running   = feature_queue_submit(queue, &devices[SLOW], &battery, SLOW_MS, NULL);
+    uint64_t too_late  = feature_queue_submit(queue, &devices[SLOW], &battery, SLOW_MS / 3, NULL);
+    uint64_t cancelled = feature_queue_submit(queue, &devices[SLOW], &battery, 5000, NULL);
+
+    // the settings are copied, not read when they run after the slow request
+    int sidetone                       = 64;
+    float bands[BANDS]                 = { 0 };
+    struct equalizer_settings settings = { BANDS, bands };
+    for (int i = 0; i < BANDS; i++)
+        bands[i] = i - 4.5f;
+
+    uint64_t setting   = feature_queue_submit(queue, &devices[SLOW], &(FeatureRequest) { CAP_SIDETONE, CAPABILITYTYPE_ACTION, &sidetone, true, {} }, 1000, NULL);
+    uint64_t equalizer = feature_queue_submit(queue, &devices[SLOW], &(FeatureRequest) { CAP_EQUALIZER, CAPABILITYTYPE_ACTION, &settings, true, {} }, 1000, NULL);
+
+    sidetone = -1;
+    memset(bands, 0, sizeof(bands));
+    settings.size         = 0;
+    settings.bands_values = NULL;
+
+    CHECK(running && too_late && cancelled && setting && equalizer, "submitting failed");
+    CHECK(feature_queue_cancel(queue, cancelled) == 0, "a waiting request wasn't cancelled");
+    CHECK(feature_queue_cancel(queue, cancelled) == -1, "a request was cancelled twice");
+
+    // once the slow read started
+    struct timespec started = { 0, 50 * 1000000L };
+    nanosleep(&started, NULL);
+    CHECK(feature_queue_cancel(queue, running) == -1, "a running request was cancelled");
+
+    for (int n = 0; n < 5; n++) {
+        CHECK(next_completion(queue, &done), "completion %d missing", n);
+        const FeatureResult* result = &done.request.result;
+
+        if (done.id == cancelled) {
+            CHECK(result->status == FEATURE_NOT_PROCESSED, "cancelled request: status %d", result->status);
+        } else if (done.id == too_late) {
+            CHECK(result->status == FEATURE_ERROR && strstr(result->message, "Timed out"), "request behind the slow one: %s", result->message);
+        } else if (done.id == running) {
+            CHECK(result->status == FEATURE_ERROR && result->value == BATTERY_TIMEOUT, "slow request: %s", result->message);
+        } else if (done.id == setting || done.id == equalizer) {
+            CHECK(result->status == FEATURE_SUCCESS && done.pass_result >= 0, "setting: %s", result->message);
+        } else {
+            CHECK(false, "completion of an unknown request");
+        }
+    }
+    CHECK(!fd_readable(queue, 0), "readable after collecting every completion");
+    CHECK(feature_queue_wait(queue, 10) == 0, "waited for a completion which never comes");
+
+    // collecting the completions ordered the writes of the drivers before these reads
+    CHECK(sent_sidetone == 64, "the driver got sidetone %d instead of the submitted 64", sent_sidetone);
+    CHECK(sent_bands_count == BANDS, "the driver got %d equalizer bands instead of %d", sent_bands_count, BANDS);
+    for (int i = 0; i < BANDS && sent_bands_count == BANDS; i++)
+        CHECK(sent_bands[i] == i - 4.5f, "the driver got %.1f for band %d instead of %.1f", sent_bands[i], i, i - 4.5f);
+
+    // closing drops what didn't start and waits for what runs
+    feature_queue_submit(queue, &devices[SLOW], &battery, SLOW_MS, NULL);
+    feature_queue_submit(queue, &devices[SLOW], &battery, SLOW_MS, NULL);
+    feature_queue_close(queue);
+
+    if (failures == 0)
+        printf("Requests of %d test devices completed through the queue\n", HEADSETS);
+
+    return failures != 0;
+}
@@ -0,0 +1,106 @@
+#include "../src/device_registry.h"
+#include "../src/feature.h"
+#include "../src/output.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * Checks that the passes of --follow allocate nothing once warmed up.
+ *
+ * Runs the feature requests and the output of every format on the test device
+ * over and over, counting the allocations of the whole process by replacing
+ * glibc's malloc, calloc and realloc.
+ */
+
+/// Passes before counting, e.g. stdio allocates its buffer on the first output
+#define WARMUP_PASSES 3
+#define COUNTED_PASSES 100
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+static unsigned long allocations = 0;
+
+void* malloc(size_t size)
+{
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t nmemb, size_t size)
+{
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(nmemb, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+static unsigned long run_passes(struct device* device, FeatureRequest* requests, int size, OutputType type, int passes)
+{
+    DeviceList list = { requests, size, device, 1 };
+
+    unsigned long before = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+
+    for (int i = 0; i < passes; i++) {
+        run_feature_pass(device, requests, size, 0, ~0);
+        output(&list, true, type);
+    }
+
+    return __atomic_load_n(&allocations, __ATOMIC_RELAXED) - before;
+}
+
+int main()
+{
+    init_devices();
+
+    static struct device devices[MAX_HEADSETS];
+    if (find_devices(devices, MAX_HEADSETS, NULL, 0, 1) != 1) {
+        fprintf(stderr, "Test device not found\n");
+        return 1;
+    }
+
+    int sidetone = 64, lights = 1, request = 1;
+
+    FeatureRequest requests[] = {
+        { CAP_SIDETONE, CAPABILITYTYPE_ACTION, &sidetone, true, {} },
+        { CAP_LIGHTS, CAPABILITYTYPE_ACTION, &lights, false, {} },
+        { CAP_BATTERY_STATUS, CAPABILITYTYPE_INFO, &request, true, {} },
+        { CAP_CHATMIX_STATUS, CAPABILITYTYPE_INFO, &request, true, {} },
+    };
+    int size = sizeof(requests) / sizeof(requests[0]);
+
+    // only the counts are of interest, not the output (and the errors of profile 1)
+    FILE* report = fdopen(dup(STDERR_FILENO), "w");
+    if (!report || !freopen("/dev/null", "w", stdout) || !freopen("/dev/null", "w", stderr)) {
+        perror("Redirecting the output failed");
+        return 1;
+    }
+
+    const OutputType types[] = { OUTPUT_STANDARD, OUTPUT_SHORT, OUTPUT_JSON, OUTPUT_YAML, OUTPUT_ENV, OUTPUT_NDJSON, OUTPUT_CBOR };
+    const char* type_names[] = { "standard", "short", "json", "yaml", "env", "ndjson", "cbor" };
+
+    int failed = 0;
+
+    // profile 1 makes the requests fail, with error messages
+    for (test_profile = 0; test_profile <= 1; test_profile++) {
+        devices[0].test_profile = test_profile;
+
+        for (int t = 0; t < (int)(sizeof(types) / sizeof(types[0])); t++) {
+            run_passes(&devices[0], requests, size, types[t], WARMUP_PASSES);
+            unsigned long counted = run_passes(&devices[0], requests, size, types[t], COUNTED_PASSES);
+
+            fprintf(report, "profile %d, %s output: %lu allocations in %d passes\n", test_profile, type_names[t], counted, COUNTED_PASSES);
+            if (counted != 0)
+                failed = 1;
+        }
+    }
+
+    return failed;
+}
@@ -0,0 +1,110 @@
+#include "../src/headsetcontrol.h"
+#include "check.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+
+/**
+ * Checks the C API of libheadsetcontrol on the test device.
+ *
+ * Only includes headsetcontrol.h, like programs using the library: opens a
+ * context, enumerates, queries statuses, applies settings and rejects what
+ * doesn't exist, does the same through a queue, then closes the context and
+ * opens another one.
+ */
+
+static void check_context(hsc_context* ctx)
+{
+    struct hsc_device_info info;
+    struct hsc_result result;
+
+    CHECK(hsc_enumerate(ctx) == 1, "not one test device");
+    CHECK(hsc_device_info(ctx, 0, &info) == 0, "no info about the test device");
+    CHECK(info.id_vendor == 0xF00B && info.id_product == 0xA00C, "ids %04x:%04x", info.id_vendor, info.id_product);
+    CHECK(strcmp(info.name, "HeadsetControl Test device") == 0, "name %s", info.name);
+    CHECK(wcslen(info.serial_number) == 0, "the test device has a serial number");
+    CHECK(info.capabilities & HSC_CAP_BIT(HSC_CAP_BATTERY_STATUS), "no battery capability");
+    CHECK(hsc_device_info(ctx, 1, &info) == -1, "info about a second headset");
+
+    CHECK(hsc_query(ctx, 0, HSC_CAP_BATTERY_STATUS, &result) == 0, "battery: %s", result.message);
+    CHECK(result.status == HSC_STATUS_SUCCESS && result.status2 == HSC_BATTERY_AVAILABLE && result.value == 42,
+        "battery %d, status %d, %d", result.value, result.status, result.status2);
+
+    CHECK(hsc_query(ctx, 0, HSC_CAP_CHATMIX_STATUS, &result) == 0 && result.value == 42, "chatmix: %s", result.message);
+
+    hsc_set_timeout(ctx, 100);
+    CHECK(hsc_apply(ctx, 0, HSC_CAP_SIDETONE, 64, &result) == 0 && result.status == HSC_STATUS_SUCCESS, "sidetone: %s", result.message);
+    CHECK(hsc_apply(ctx, 0, HSC_CAP_LIGHTS, 1, &result) == 0, "lights: %s", result.message);
+
+    float bands[10] = { 0 };
+    CHECK(hsc_apply_equalizer(ctx, 0, bands, 10, &result) == 0, "equalizer: %s", result.message);
+
+    // what doesn't exist
+    CHECK(hsc_query(ctx, 0, HSC_CAP_SIDETONE, &result) == -1 && result.status == HSC_STATUS_ERROR, "queried a setting");
+    CHECK(hsc_apply(ctx, 0, HSC_CAP_BATTERY_STATUS, 1, &result) == -1, "applied a status");
+    CHECK(hsc_apply(ctx, 0, HSC_NUM_CAPABILITIES, 1, &result) == -1, "applied an unknown capability");
+    CHECK(hsc_query(ctx, 1, HSC_CAP_BATTERY_STATUS, &result) == -1 && result.message[0] != '\0', "queried a second headset");
+
+    CHECK(strcmp(hsc_capability_name(HSC_CAP_BATTERY_STATUS), "battery") == 0, "name of the battery");
+    CHECK(hsc_capability_name(HSC_NUM_CAPABILITIES) == NULL, "name of an unknown capability");
+}
+
+static void check_queue(hsc_context* ctx)
+{
+    hsc_queue* queue = hsc_queue_open(ctx);
+    CHECK(queue != NULL, "no queue");
+    if (!queue)
+        return;
+
+    float bands[10] = { 0 };
+    int tag         = 0;
+
+    struct hsc_request battery   = { .index = 0, .cap = HSC_CAP_BATTERY_STATUS, .user_data = &tag };
+    struct hsc_request equalizer = { .index = 0, .cap = HSC_CAP_EQUALIZER, .bands = bands, .bands_count = 10, .timeout_ms = 100 };
+    struct hsc_request missing   = { .index = 1, .cap = HSC_CAP_BATTERY_STATUS };
+
+    uint64_t battery_id = hsc_submit(queue, &battery);
+    CHECK(battery_id != 0 && hsc_submit(queue, &equalizer) != 0, "submitting failed");
+    CHECK(hsc_submit(queue, &missing) == 0, "submitted to a second headset");
+
+    struct hsc_completion completions[4];
+    int n = 0;
+    while (n < 2 && hsc_queue_wait(queue, 5000))
+        n += hsc_completions(queue, completions + n, 4 - n);
+    CHECK(n == 2, "%d completions", n);
+
+    for (int i = 0; i < n; i++) {
+        const struct hsc_completion* completion = &completions[i];
+
+        CHECK(completion->index == 0 && completion->result.status == HSC_STATUS_SUCCESS, "queued %s: %s",
+            hsc_capability_name(completion->cap), completion->result.message);
+        if (completion->id == battery_id)
+            CHECK(completion->cap == HSC_CAP_BATTERY_STATUS && completion->user_data == &tag && completion->result.value == 42,
+                "queued battery %d", completion->result.value);
+    }
+
+    hsc_queue_close(queue);
+}
+
+int main()
+{
+    hsc_context* ctx = hsc_open(HSC_OPEN_TEST_DEVICE);
+    CHECK(ctx != NULL, "no context");
+    if (!ctx)
+        return 1;
+
+    check_context(ctx);
+    check_queue(ctx);
+    hsc_close(ctx);
+
+    // the connections were closed with the last context, they are opened again
+    ctx = hsc_open(HSC_OPEN_TEST_DEVICE);
+    check_context(ctx);
+    hsc_close(ctx);
+
+    if (failures == 0)
+        printf("The API works on the test device\n");
+
+    return failures != 0;
+}
@@ -0,0 +1,195 @@
+#include "../src/device_registry.h"
+#include "../src/feature.h"
+#include "../src/status_shm.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Checks that readers of the shared status never see a half written status.
+ *
+ * A writer thread publishes the status of MAX_HEADSETS headsets over and over,
+ * every value derived from the number of the update. Reader threads copy the
+ * status at the same time and check that all values belong to one update, and
+ * that updates never go back.
+ */
+
+#define READERS 3
+#define RUN_MS 1000
+
+static volatile int running = 1;
+
+static struct device devices[MAX_HEADSETS];
+static FeatureRequest device_requests[MAX_HEADSETS][2];
+
+struct reader_stats {
+    unsigned long reads;
+    unsigned long busy;
+    unsigned long torn;
+    unsigned long backwards;
+};
+
+static int battery_of(unsigned update, int d)
+{
+    return (int)((update + d) % 101);
+}
+
+static int chatmix_of(unsigned update, int d)
+{
+    return (int)((update * 7 + d) % 129);
+}
+
+static void* writer_thread(void* arg)
+{
+    unsigned* updates = arg;
+    FeatureRequest* requests[MAX_HEADSETS];
+    int request = 1;
+
+    for (int d = 0; d < MAX_HEADSETS; d++) {
+        requests[d]           = device_requests[d];
+        device_requests[d][0] = (FeatureRequest) { CAP_BATTERY_STATUS, CAPABILITYTYPE_INFO, &request, true, {} };
+        device_requests[d][1] = (FeatureRequest) { CAP_CHATMIX_STATUS, CAPABILITYTYPE_INFO, &request, true, {} };
+    }
+
+    for (unsigned update = 1; __atomic_load_n(&running, __ATOMIC_RELAXED); update++) {
+        for (int d = 0; d < MAX_HEADSETS; d++) {
+            snprintf(devices[d].device_name, sizeof(devices[d].device_name), "update %u", update);
+            devices[d].device_instance = (int)update;
+
+            device_requests[d][0].result = (FeatureResult) { FEATURE_INFO, battery_of(update, d), BATTERY_AVAILABLE, "" };
+            device_requests[d][1].result = (FeatureResult) { FEATURE_INFO, chatmix_of(update, d), 0, "" };
+        }
+
+        status_shm_publish(devices, requests, MAX_HEADSETS, 2);
+        __atomic_store_n(updates, update, __ATOMIC_RELAXED);
+    }
+
+    return NULL;
+}
+
+/// Whether every value of the status belongs to the same update
+static bool consistent(const struct status_shm_status* status, unsigned* update)
+{
+    if (status->device_count != MAX_HEADSETS || sscanf(status->devices[0].device_name, "update %u", update) != 1)
+        return false;
+
+    char name[64];
+    snprintf(name, sizeof(name), "update %u", *update);
+
+    for (int d = 0; d < MAX_HEADSETS; d++) {
+        const struct status_shm_device* device = &status->devices[d];
+
+        if (strcmp(device->device_name, name) != 0 || device->instance != (int32_t)*update
+            || device->idVendor != VENDOR_TESTDEVICE || device->idProduct != PRODUCT_TESTDEVICE
+            || !device->has_battery || device->battery_status != BATTERY_AVAILABLE || device->battery_level != battery_of(*update, d)
+            || !device->has_chatmix || device->chatmix != chatmix_of(*update, d))
+            return false;
+    }
+
+    return true;
+}
+
+static void* reader_thread(void* arg)
+{
+    struct reader_stats* stats = arg;
+    struct status_shm_status copy;
+    unsigned last = 0;
+
+    while (__atomic_load_n(&running, __ATOMIC_RELAXED)) {
+        int res = status_shm_read(&copy);
+        if (res == -2) {
+            stats->busy++;
+            continue;
+        }
+
+        unsigned update = 0;
+        stats->reads++;
+        // the segment vanishing counts as torn as well
+        if (res != 0 || !consistent(&copy, &update))
+            stats->torn++;
+        else if (update < last)
+            stats->backwards++;
+        last = update;
+    }
+
+    return NULL;
+}
+
+int main()
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/headsetcontrol-test-%d", (int)getpid());
+    setenv("HEADSETCONTROL_SHM", name, 1);
+
+    init_devices();
+
+    for (int d = 0; d < MAX_HEADSETS; d++) {
+        if (get_device(&devices[d], VENDOR_TESTDEVICE, PRODUCT_TESTDEVICE) != 0) {
+            fprintf(stderr, "Test device not found\n");
+            return 1;
+        }
+    }
+
+    static struct status_shm_status status;
+    if (status_shm_read(&status) != -1) {
+        fprintf(stderr, "%s exists before anything was published\n", name);
+        return 1;
+    }
+
+    unsigned updates = 0;
+    pthread_t writer;
+    pthread_t readers[READERS];
+    struct reader_stats stats[READERS];
+    memset(stats, 0, sizeof(stats));
+
+    pthread_create(&writer, NULL, writer_thread, &updates);
+    // readers start with a published status
+    while (__atomic_load_n(&updates, __ATOMIC_RELAXED) == 0)
+        usleep(1000);
+
+    for (int i = 0; i < READERS; i++)
+        pthread_create(&readers[i], NULL, reader_thread, &stats[i]);
+
+    struct timespec run = { RUN_MS / 1000, (RUN_MS % 1000) * 1000000L };
+    nanosleep(&run, NULL);
+    __atomic_store_n(&running, 0, __ATOMIC_RELAXED);
+
+    pthread_join(writer, NULL);
+    for (int i = 0; i < READERS; i++)
+        pthread_join(readers[i], NULL);
+
+    int failed = 0;
+    unsigned long reads = 0;
+    for (int i = 0; i < READERS; i++) {
+        printf("reader %d: %lu consistent reads, %lu torn, %lu going back, %lu given up while the writer was busy\n",
+            i, stats[i].reads - stats[i].torn, stats[i].torn, stats[i].backwards, stats[i].busy);
+
+        failed = failed || stats[i].torn != 0 || stats[i].backwards != 0;
+        reads += stats[i].reads;
+    }
+    printf("%u updates published\n", updates);
+
+    // the last update must be readable once the writer stopped
+    unsigned update = 0;
+    if (status_shm_read(&status) != 0 || !consistent(&status, &update) || update != updates) {
+        fprintf(stderr, "The last update isn't readable\n");
+        failed = 1;
+    }
+
+    status_shm_close();
+    if (status_shm_read(&status) != -1) {
+        fprintf(stderr, "%s was not removed\n", name);
+        failed = 1;
+    }
+
+    if (reads == 0) {
+        fprintf(stderr, "Nothing was read\n");
+        failed = 1;
+    }
+
+    return failed;
+}